@@ -0,0 +1,12 @@
+@REM Generates maps of growing size and appends load, memory, locate and frame timings to bench.csv
+make tools
+@IF %ERRORLEVEL% NEQ 0 (echo "Make returned an error: %ERRORLEVEL%" & exit /B)
+echo sectors,walls,load_ms,world_bytes,locate_neighbor_ns,locate_teleport_ns,locate_batch_ns,collide_ns,sight_ns,sight_cached_ns,visit_us,frame_ms> bench.csv
+for %%n in (1000 10000 100000 1000000) do (
+    mapgen -n %%n -t 2 bench_%%n.map
+    mapbench -locates 10000 -o bench.csv bench_%%n.map
+    mapgen -n %%n -t 2 -b bench_%%n.mapb
+    mapbench -locates 10000 -o bench.csv bench_%%n.mapb
+    mapgen -n %%n -t 2 -open bench_open_%%n.map
+    mapbench -locates 10000 -o bench.csv bench_open_%%n.map
+)
@@ -0,0 +1,213 @@
+#include "portals.h"
+#include "geo.h"
+
+#include <math.h>
+#include <assert.h>
+
+// Bodies are upright cylinders swept as circles through the walls near them. Walls are gathered by
+// walking portals out from the body's sector, as far as the move can reach, so the cost follows
+// the walls around the body and not the size of the world. A portal into a sector without a tier
+// the body fits in, stepping up at most step_height, is a wall like any other.
+
+#define MAX_COLLISION_SECTORS 64
+#define MAX_COLLISION_WALLS 256
+#define MAX_COLLISION_SUBSTEPS 64
+#define MAX_COLLISION_SLIDES 4
+
+// bodies stop this far short of what they hit, so rounding never leaves them touching it
+#define COLLISION_SKIN 1e-3f
+
+typedef struct CollisionWalls {
+    unsigned sectors[MAX_COLLISION_SECTORS];
+    unsigned num_sectors;
+    unsigned walls[MAX_COLLISION_WALLS];
+    unsigned num_walls;
+} CollisionWalls;
+
+unsigned getBodyTier(PortalWorld pod, unsigned sector_index, float z, float height, float step_height) {
+    if (sector_index >= pod.num_sectors) return INVALID_SECTOR_INDEX;
+
+    SectorDef sector = pod.sectors[sector_index];
+    for (unsigned i = 0; i < sector.num_tiers; ++i) {
+        float floor = sector.floor_heights[i];
+        if (floor > z + step_height) continue;
+        if (sector.ceiling_heights[i] >= max(z, floor) + height) return i;
+    }
+    return INVALID_SECTOR_INDEX;
+}
+
+static bool addSector(CollisionWalls *walls, unsigned sector_index) {
+    for (unsigned i = 0; i < walls->num_sectors; ++i) {
+        if (walls->sectors[i] == sector_index) return false;
+    }
+    if (walls->num_sectors == MAX_COLLISION_SECTORS) return false;
+    walls->sectors[walls->num_sectors++] = sector_index;
+    return true;
+}
+
+// the walls within reach of point, solid ones and portals the body does not fit through
+static void gatherWalls(PortalWorld pod, const CollisionBody *body, vec2 point, float reach, CollisionWalls *o_walls) {
+    o_walls->num_sectors = 0;
+    o_walls->num_walls   = 0;
+    addSector(o_walls, body->sector);
+
+    for (unsigned s = 0; s < o_walls->num_sectors; ++s) {
+        SectorDef sector = pod.sectors[o_walls->sectors[s]];
+
+        for (unsigned i = sector.start; i < sector.start + sector.length; ++i) {
+            WallGeometry geom = pod.wall_geometry[i];
+            if (segmentPointDistance(pod.wall_lines[i], geom.dir, geom.length, point) > reach) continue;
+
+            unsigned next = pod.wall_nexts[i];
+            bool open     = next < pod.num_sectors && next != o_walls->sectors[s] &&
+                            getBodyTier(pod, next, body->pos[2], body->height, body->step_height) != INVALID_SECTOR_INDEX;
+
+            if (open) {
+                addSector(o_walls, next);
+            } else if (o_walls->num_walls < MAX_COLLISION_WALLS) {
+                o_walls->walls[o_walls->num_walls++] = i;
+            }
+        }
+    }
+}
+
+// earliest time in [0, 1] a circle moving from p by d touches the point, false if it never does
+static bool sweepPoint(vec2 p, vec2 d, const float *point, float radius, float *io_t, vec2 o_normal) {
+    float ox = p[0] - point[0], oy = p[1] - point[1];
+    float b  = ox * d[0] + oy * d[1];
+    if (b >= 0.0f) return false; // moving away
+
+    float a = d[0] * d[0] + d[1] * d[1];
+    float c = ox * ox + oy * oy - radius * radius;
+    float t = 0.0f;
+    if (c > 0.0f) {
+        float disc = b * b - a * c;
+        if (disc < 0.0f) return false;
+        t = (-b - sqrtf(disc)) / a;
+    }
+    if (t >= *io_t) return false;
+
+    float nx  = ox + d[0] * t, ny = oy + d[1] * t;
+    float len = sqrtf(nx * nx + ny * ny);
+    if (len == 0.0f) return false;
+
+    *io_t       = t;
+    o_normal[0] = nx / len;
+    o_normal[1] = ny / len;
+    return true;
+}
+
+// earliest time in [0, 1] a circle moving from p by d touches the front of the wall or its ends
+static bool sweepWall(PortalWorld pod, unsigned wall_index, vec2 p, vec2 d, float radius, float *io_t, vec2 o_normal) {
+    Line line         = pod.wall_lines[wall_index];
+    WallGeometry geom = pod.wall_geometry[wall_index];
+
+    float s0 = geom.normal[0] * p[0] + geom.normal[1] * p[1] - geom.plane;
+    float sd = geom.normal[0] * d[0] + geom.normal[1] * d[1];
+    if (s0 <= -radius) return false; // behind the wall, it belongs to a sector on its other side
+
+    bool hit = false;
+    if (sd < 0.0f && s0 >= 0.0f) {
+        float t  = s0 > radius ? (s0 - radius) / -sd : 0.0f;
+        float cx = p[0] + d[0] * t - line.points[0][0];
+        float cy = p[1] + d[1] * t - line.points[0][1];
+        float u  = cx * geom.dir[0] + cy * geom.dir[1];
+
+        if (t < *io_t && u >= 0.0f && u <= geom.length) {
+            *io_t       = t;
+            o_normal[0] = geom.normal[0];
+            o_normal[1] = geom.normal[1];
+            hit         = true;
+        }
+    }
+
+    hit |= sweepPoint(p, d, line.points[0], radius, io_t, o_normal);
+    hit |= sweepPoint(p, d, line.points[1], radius, io_t, o_normal);
+    return hit;
+}
+
+// one sub-step, sliding along whatever is hit, returns whether anything was
+static bool slideBody(PortalWorld pod, CollisionBody *body, vec2 d) {
+    CollisionWalls walls;
+    float reach = body->radius + sqrtf(d[0] * d[0] + d[1] * d[1]) + COLLISION_SKIN;
+    gatherWalls(pod, body, body->pos, reach, &walls);
+
+    bool blocked = false;
+    for (unsigned slide = 0; slide < MAX_COLLISION_SLIDES; ++slide) {
+        float t = 1.0f;
+        vec2 normal;
+        bool hit = false;
+        for (unsigned i = 0; i < walls.num_walls; ++i) {
+            hit |= sweepWall(pod, walls.walls[i], body->pos, d, body->radius, &t, normal);
+        }
+
+        body->pos[0] += d[0] * t;
+        body->pos[1] += d[1] * t;
+        if (!hit) break;
+
+        // back off the skin and keep what is left of the move along the wall
+        blocked = true;
+        body->pos[0] += normal[0] * COLLISION_SKIN;
+        body->pos[1] += normal[1] * COLLISION_SKIN;
+
+        float rest_x = d[0] * (1.0f - t), rest_y = d[1] * (1.0f - t);
+        float into   = rest_x * normal[0] + rest_y * normal[1];
+        d[0]         = rest_x - normal[0] * min(into, 0.0f);
+        d[1]         = rest_y - normal[1] * min(into, 0.0f);
+        if (d[0] * d[0] + d[1] * d[1] < COLLISION_SKIN * COLLISION_SKIN) break;
+    }
+
+    return blocked;
+}
+
+bool moveBody(PortalWorld pod, CollisionBody *body, vec2 delta) {
+    assert(body != NULL);
+
+    // a body outside the world, or in a sector that is not resident, moves freely until it is back
+    body->sector = getCurrentSector(pod, body->pos, body->sector);
+    if (body->sector >= pod.num_sectors || pod.sectors[body->sector].num_tiers == 0) {
+        body->pos[0] += delta[0];
+        body->pos[1] += delta[1];
+        body->sector = getCurrentSector(pod, body->pos, body->sector);
+        return false;
+    }
+
+    // sub-steps no longer than the radius keep the walls gathered for each close around the body
+    float length       = sqrtf(delta[0] * delta[0] + delta[1] * delta[1]);
+    unsigned num_steps = body->radius > 0.0f ? (unsigned)ceilf(length / body->radius) : 1;
+    num_steps          = clamp(num_steps, 1, MAX_COLLISION_SUBSTEPS);
+
+    bool blocked = false;
+    for (unsigned i = 0; i < num_steps; ++i) {
+        vec2 d        = { delta[0] / num_steps, delta[1] / num_steps };
+        vec2 last_pos = { body->pos[0], body->pos[1] };
+        blocked |= slideBody(pod, body, d);
+
+        // a move that leaves every sector, through a gap in a broken map, is undone
+        unsigned sector = getCurrentSector(pod, body->pos, body->sector);
+        unsigned tier   = getBodyTier(pod, sector, body->pos[2], body->height, body->step_height);
+        if (sector >= pod.num_sectors) {
+            body->pos[0] = last_pos[0];
+            body->pos[1] = last_pos[1];
+            return true;
+        }
+
+        // stepping up onto a higher floor, stepping down is left to whatever moves the body vertically
+        body->sector = sector;
+        if (tier != INVALID_SECTOR_INDEX) {
+            body->tier   = tier;
+            body->pos[2] = max(body->pos[2], pod.sectors[sector].floor_heights[tier]);
+        }
+    }
+
+    return blocked;
+}
+
+void moveBodies(PortalWorld pod, CollisionBody *bodies, const vec2 *deltas, unsigned count) {
+    assert(bodies != NULL || count == 0);
+    assert(deltas != NULL || count == 0);
+
+    for (unsigned i = 0; i < count; ++i) {
+        moveBody(pod, &bodies[i], (float *)deltas[i]);
+    }
+}
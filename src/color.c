@@ -1,33 +1,197 @@
 #include "color.h"
 
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// All products are divided by 255 with exact rounding, so multiplying by 255 is the identity.
+// round(x / 255) for x in [0, 255 * 255]
+#define DIV255(x) ((((x) + 128) + (((x) + 128) >> 8)) >> 8)
+
+// SWAR: a color is viewed as a uint32, with two channels per 16 bit lane
+#define LANE_MASK 0x00FF00FFu
+
+static inline uint32_t colorToBits(Color c) {
+    uint32_t v;
+    memcpy(&v, &c, sizeof(v));
+    return v;
+}
+
+static inline Color bitsToColor(uint32_t v) {
+    Color c;
+    memcpy(&c, &v, sizeof(c));
+    return c;
+}
+
+// DIV255 on both 16 bit lanes at once, lanes must be <= 255 * 255
+static inline uint32_t div255Lanes(uint32_t x) {
+    x += 0x00800080u;
+    x += (x >> 8) & LANE_MASK;
+    return (x >> 8) & LANE_MASK;
+}
+
+static inline uint32_t mulBits(uint32_t c, uint32_t m) {
+    uint32_t rb = div255Lanes((c & LANE_MASK) * m);
+    uint32_t ag = div255Lanes(((c >> 8) & LANE_MASK) * m);
+    return rb | (ag << 8);
+}
+
+static inline uint32_t lerpBits(uint32_t c0, uint32_t c1, uint32_t t) {
+    uint32_t s  = 255 - t;
+    uint32_t rb = div255Lanes((c0 & LANE_MASK) * s + (c1 & LANE_MASK) * t);
+    uint32_t ag = div255Lanes(((c0 >> 8) & LANE_MASK) * s + ((c1 >> 8) & LANE_MASK) * t);
+    return rb | (ag << 8);
+}
+
+#if defined(__SSE2__)
+
+static inline __m128i div255Epi16(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    x = _mm_add_epi16(x, _mm_srli_epi16(x, 8));
+    return _mm_srli_epi16(x, 8);
+}
+
+// four factors, each repeated across the four channels of its pixel
+static inline __m128i loadFactors(const uint8_t *m) {
+    uint32_t bits;
+    memcpy(&bits, m, sizeof(bits));
+    __m128i v = _mm_cvtsi32_si128((int)bits);
+    v         = _mm_unpacklo_epi8(v, v);
+    return _mm_unpacklo_epi16(v, v);
+}
+
+#endif
+
+// each channel has its own factor, which packed lanes cannot multiply, so this takes vector lanes
 Color mixColor(Color c0, Color c1) {
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a          = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)colorToBits(c0)), zero);
+    __m128i b          = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)colorToBits(c1)), zero);
+    return bitsToColor((uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(div255Epi16(_mm_mullo_epi16(a, b)), zero)));
+#elif defined(__ARM_NEON)
+    uint8x8_t a  = vreinterpret_u8_u32(vdup_n_u32(colorToBits(c0)));
+    uint8x8_t b  = vreinterpret_u8_u32(vdup_n_u32(colorToBits(c1)));
+    uint16x8_t x = vmull_u8(a, b);
+    return bitsToColor(vget_lane_u32(vreinterpret_u32_u8(vraddhn_u16(x, vrshrq_n_u16(x, 8))), 0));
+#else
     return (Color){
-        .r = (uint8_t)(((uint16_t)c0.r * (uint16_t)c1.r) >> 8),
-        .g = (uint8_t)(((uint16_t)c0.g * (uint16_t)c1.g) >> 8),
-        .b = (uint8_t)(((uint16_t)c0.b * (uint16_t)c1.b) >> 8),
-        .a = (uint8_t)(((uint16_t)c0.a * (uint16_t)c1.a) >> 8),
+        .r = (uint8_t)DIV255((uint16_t)c0.r * (uint16_t)c1.r),
+        .g = (uint8_t)DIV255((uint16_t)c0.g * (uint16_t)c1.g),
+        .b = (uint8_t)DIV255((uint16_t)c0.b * (uint16_t)c1.b),
+        .a = (uint8_t)DIV255((uint16_t)c0.a * (uint16_t)c1.a),
     };
+#endif
 }
 
 Color mulColor(Color c0, uint8_t m) {
-        return (Color){
-        .r = (uint8_t)(((uint16_t)c0.r * (uint16_t)m) >> 8),
-        .g = (uint8_t)(((uint16_t)c0.g * (uint16_t)m) >> 8),
-        .b = (uint8_t)(((uint16_t)c0.b * (uint16_t)m) >> 8),
-        .a = (uint8_t)(((uint16_t)c0.a * (uint16_t)m) >> 8),
-    };
+    return bitsToColor(mulBits(colorToBits(c0), m));
 }
 
 Color lerpColor(Color c0, Color c1, uint8_t t) {
-    uint8_t s = 255 - t;
+    return bitsToColor(lerpBits(colorToBits(c0), colorToBits(c1), t));
+}
 
-    Color a = mulColor(c0, s);
-    Color b = mulColor(c1, t);
+//
+//      SPANS
+//
 
-    return (Color){
-        .r = a.r + b.r,
-        .g = a.g + b.g,
-        .b = a.b + b.b,
-        .a = a.a + b.a,
-    };
-}
\ No newline at end of file
+void mulColorSpan(Color *colors, const uint8_t *m, unsigned n) {
+    unsigned i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i c  = _mm_loadu_si128((const __m128i *)&colors[i]);
+        __m128i mv = loadFactors(&m[i]);
+
+        __m128i lo = div255Epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(mv, zero)));
+        __m128i hi = div255Epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(mv, zero)));
+
+        _mm_storeu_si128((__m128i *)&colors[i], _mm_packus_epi16(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 2 <= n; i += 2) {
+        uint8x8_t c  = vld1_u8((const uint8_t *)&colors[i]);
+        uint8x8_t mv = vreinterpret_u8_u32(vset_lane_u32(m[i + 1] * 0x01010101u, vdup_n_u32(m[i] * 0x01010101u), 1));
+
+        uint16x8_t x = vmull_u8(c, mv);
+        vst1_u8((uint8_t *)&colors[i], vraddhn_u16(x, vrshrq_n_u16(x, 8)));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        colors[i] = bitsToColor(mulBits(colorToBits(colors[i]), m[i]));
+    }
+}
+
+void mixColorSpan(Color *colors, const Color *m, unsigned n) {
+    unsigned i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= n; i += 4) {
+        __m128i c  = _mm_loadu_si128((const __m128i *)&colors[i]);
+        __m128i mv = _mm_loadu_si128((const __m128i *)&m[i]);
+
+        __m128i lo = div255Epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), _mm_unpacklo_epi8(mv, zero)));
+        __m128i hi = div255Epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), _mm_unpackhi_epi8(mv, zero)));
+
+        _mm_storeu_si128((__m128i *)&colors[i], _mm_packus_epi16(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 2 <= n; i += 2) {
+        uint8x8_t c  = vld1_u8((const uint8_t *)&colors[i]);
+        uint8x8_t mv = vld1_u8((const uint8_t *)&m[i]);
+
+        uint16x8_t x = vmull_u8(c, mv);
+        vst1_u8((uint8_t *)&colors[i], vraddhn_u16(x, vrshrq_n_u16(x, 8)));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        colors[i] = mixColor(colors[i], m[i]);
+    }
+}
+
+void lerpColorSpan(Color *colors, const Color *targets, const uint8_t *t, unsigned n) {
+    unsigned i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+    for (; i + 4 <= n; i += 4) {
+        __m128i c0 = _mm_loadu_si128((const __m128i *)&colors[i]);
+        __m128i c1 = _mm_loadu_si128((const __m128i *)&targets[i]);
+        __m128i tv = loadFactors(&t[i]);
+
+        __m128i t_lo = _mm_unpacklo_epi8(tv, zero);
+        __m128i t_hi = _mm_unpackhi_epi8(tv, zero);
+
+        // c0 * (255 - t) + c1 * t never exceeds 255 * 255, so the sum stays within 16 bits
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c0, zero), _mm_sub_epi16(full, t_lo)),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(c1, zero), t_lo));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c0, zero), _mm_sub_epi16(full, t_hi)),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(c1, zero), t_hi));
+
+        _mm_storeu_si128((__m128i *)&colors[i], _mm_packus_epi16(div255Epi16(lo), div255Epi16(hi)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 2 <= n; i += 2) {
+        uint8x8_t c0 = vld1_u8((const uint8_t *)&colors[i]);
+        uint8x8_t c1 = vld1_u8((const uint8_t *)&targets[i]);
+        uint8x8_t tv = vreinterpret_u8_u32(vset_lane_u32(t[i + 1] * 0x01010101u, vdup_n_u32(t[i] * 0x01010101u), 1));
+
+        uint16x8_t x = vmlal_u8(vmull_u8(c0, vmvn_u8(tv)), c1, tv);
+        vst1_u8((uint8_t *)&colors[i], vraddhn_u16(x, vrshrq_n_u16(x, 8)));
+    }
+#endif
+
+    for (; i < n; ++i) {
+        colors[i] = bitsToColor(lerpBits(colorToBits(colors[i]), colorToBits(targets[i]), t[i]));
+    }
+}
@@ -19,6 +19,12 @@ typedef struct Color {
 #define COLOR_CYAN ((Color){ .r = 0, .g = 255, .b = 255, .a = 255 })
 #define COLOR_PURPLE ((Color){ .r = 255, .g = 0, .b = 255, .a = 255 })
 
+// channel products are divided by 255 and rounded to nearest
 Color lerpColor(Color c0, Color c1, uint8_t t);
 Color mixColor(Color c0, Color c1);
 Color mulColor(Color c0, uint8_t m);
+
+// in place over n pixels, using SSE2 or NEON when available
+void mulColorSpan(Color *colors, const uint8_t *m, unsigned n);
+void mixColorSpan(Color *colors, const Color *m, unsigned n);
+void lerpColorSpan(Color *colors, const Color *targets, const uint8_t *t, unsigned n);
@@ -4,13 +4,104 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <assert.h>
 
-Color *g_pixels = NULL;
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+Color *g_pixels          = NULL;
+uint16_t *g_depth_buffer = NULL;
+int g_screen_width       = DEFAULT_SCREEN_WIDTH;
+int g_screen_height      = DEFAULT_SCREEN_HEIGHT;
 
 Color **getPixelBufferPtr() {
     return &g_pixels;
 }
 
+void setRenderTarget(RenderTarget target) {
+    assert(target.width >= MIN_SCREEN_SIZE && target.width <= MAX_SCREEN_SIZE);
+    assert(target.height >= MIN_SCREEN_SIZE && target.height <= MAX_SCREEN_SIZE);
+
+    g_pixels        = target.pixels;
+    g_depth_buffer  = target.depth_buffer;
+    g_screen_width  = target.width;
+    g_screen_height = target.height;
+}
+
+bool parseResolution(const char *text, int *o_width, int *o_height) {
+    int width, height;
+    char end;
+    if (sscanf(text, "%dx%d%c", &width, &height, &end) != 2) return false;
+    if (width < MIN_SCREEN_SIZE || width > MAX_SCREEN_SIZE || height < MIN_SCREEN_SIZE || height > MAX_SCREEN_SIZE) return false;
+
+    *o_width  = width;
+    *o_height = height;
+    return true;
+}
+
+void clearFrame(uint16_t *depth_buffer, const Color *color) {
+    // every byte of DEPTH_CLEAR is the same
+    memset(depth_buffer, 0xff, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(*depth_buffer));
+    if (color == NULL) return;
+
+    unsigned i = 0;
+#if defined(__SSE2__)
+    uint32_t bits;
+    memcpy(&bits, color, sizeof(bits));
+    const __m128i c = _mm_set1_epi32((int)bits);
+    for (; i + 4 <= SCREEN_WIDTH * SCREEN_HEIGHT; i += 4) {
+        _mm_storeu_si128((__m128i *)&g_pixels[i], c);
+    }
+#endif
+    for (; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
+        g_pixels[i] = *color;
+    }
+}
+
+// eight depths at a time, a block the frame covered entirely is skipped without touching its pixels
+void fillUncovered(const uint16_t *depth_buffer, Color color) {
+    unsigned i = 0;
+#if defined(__SSE2__)
+    const __m128i clear = _mm_set1_epi16((short)DEPTH_CLEAR);
+    for (; i + 8 <= SCREEN_WIDTH * SCREEN_HEIGHT; i += 8) {
+        __m128i hole = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)&depth_buffer[i]), clear);
+        int mask     = _mm_movemask_epi8(hole);
+        if (mask == 0) continue;
+
+        for (unsigned k = 0; k < 8; ++k) {
+            if ((mask >> (k * 2)) & 1) g_pixels[i + k] = color;
+        }
+    }
+#endif
+    for (; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
+        if (depth_buffer[i] == DEPTH_CLEAR) g_pixels[i] = color;
+    }
+}
+
+// pixels are fogged in runs of this many, the factors and targets of a run live on the stack
+#define FOG_RUN 256
+
+void fogFrame(const uint16_t *depth_buffer, Color color) {
+    Color targets[FOG_RUN];
+    uint8_t amounts[FOG_RUN];
+    for (unsigned k = 0; k < FOG_RUN; ++k) {
+        targets[k] = color;
+    }
+
+    unsigned num_pixels = SCREEN_WIDTH * SCREEN_HEIGHT;
+    for (unsigned i = 0; i < num_pixels; i += FOG_RUN) {
+        unsigned n = min(num_pixels - i, FOG_RUN);
+
+        // the top byte of the depth is how far toward the far plane the pixel is, DEPTH_CLEAR the whole way
+        for (unsigned k = 0; k < n; ++k) {
+            amounts[k] = depth_buffer[i + k] >> 8;
+        }
+        lerpColorSpan(&g_pixels[i], targets, amounts, n);
+    }
+}
+
 void setPixel(unsigned x, unsigned y, Color color) {
     if (x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT) return;
     g_pixels[x + y * SCREEN_WIDTH] = color;
@@ -25,69 +116,108 @@ Color getPixel(unsigned x, unsigned y) {
     return g_pixels[x + y * SCREEN_WIDTH];
 }
 
-// https://en.wikipedia.org/wiki/Bresenham%27s_line_algorithm
+Color sampleImage(Image image, unsigned x, unsigned y) {
+    if (x >= image.width || y >= image.height) return (Color){};
+    Color res;
+    unsigned i = x + y * image.width;
+    res        = image.data[i];
+    return res;
+}
+
+// Liang-Barsky against one edge of the screen, narrowing the part of the line from t0 to t1 inside it
+static bool clipLineEdge(float p, float q, float *t0, float *t1) {
+    if (p == 0.0f) return q >= 0.0f;
 
-void _plotLineHigh(int x0, int y0, int x1, int y1, Color color);
-void _plotLineLow(int x0, int y0, int x1, int y1, Color color);
-void drawLine(int x0, int y0, int x1, int y1, Color color) {
-    if (abs(y1 - y0) < abs(x1 - x0)) {
-        if (x0 > x1)
-            _plotLineLow(x1, y1, x0, y0, color);
-        else
-            _plotLineLow(x0, y0, x1, y1, color);
+    float t = q / p;
+    if (p < 0.0f) {
+        if (t > *t1) return false;
+        *t0 = max(*t0, t);
     } else {
-        if (y0 > y1)
-            _plotLineHigh(x1, y1, x0, y0, color);
-        else
-            _plotLineHigh(x0, y0, x1, y1, color);
+        if (t < *t0) return false;
+        *t1 = min(*t1, t);
     }
+    return true;
 }
 
-//
-//      INTERNAL
-//
-
-void _plotLineHigh(int x0, int y0, int x1, int y1, Color color) {
-    int dx = x1 - x0;
-    int dy = y1 - y0;
-    int xi = 1;
-    if (dx < 0) {
-        xi = -1;
-        dx = -dx;
-    }
-    int D = (2 * dx) - dy;
-    int x = x0;
-
-    for (int y = y0; y <= y1; ++y) {
-        setPixel(x, y, color);
-        if (D > 0) {
-            x = x + xi;
-            D = D + (2 * (dx - dy));
-        } else {
-            D = D + 2 * dx;
-        }
+// Clipped to the screen first, so the rasterizer writes whole runs of a row without checking each
+// pixel. Lines mostly or entirely off screen cost no more than their visible part.
+void drawLine(int x0, int y0, int x1, int y1, Color color) {
+    float fx0 = x0, fy0 = y0;
+    float dx = x1 - x0, dy = y1 - y0;
+    float t0 = 0.0f, t1 = 1.0f;
+
+    if (!clipLineEdge(-dx, fx0, &t0, &t1) || !clipLineEdge(dx, (SCREEN_WIDTH - 1) - fx0, &t0, &t1) ||
+        !clipLineEdge(-dy, fy0, &t0, &t1) || !clipLineEdge(dy, (SCREEN_HEIGHT - 1) - fy0, &t0, &t1)) {
+        return;
     }
-}
 
-void _plotLineLow(int x0, int y0, int x1, int y1, Color color) {
-    int dx = x1 - x0;
-    int dy = y1 - y0;
-    int yi = 1;
-    if (dy < 0) {
-        yi = -1;
-        dy = -dy;
+    if (t0 > 0.0f) {
+        x0 = (int)(fx0 + dx * t0 + 0.5f);
+        y0 = (int)(fy0 + dy * t0 + 0.5f);
+    }
+    if (t1 < 1.0f) {
+        x1 = (int)(fx0 + dx * t1 + 0.5f);
+        y1 = (int)(fy0 + dy * t1 + 0.5f);
     }
+    x0 = clamp(x0, 0, SCREEN_WIDTH - 1);
+    y0 = clamp(y0, 0, SCREEN_HEIGHT - 1);
+    x1 = clamp(x1, 0, SCREEN_WIDTH - 1);
+    y1 = clamp(y1, 0, SCREEN_HEIGHT - 1);
 
-    int D = (2 * dy) - dx;
-    int y = y0;
+    // Bresenham, walking along the longer axis from the lower end
+    // https://en.wikipedia.org/wiki/Bresenham%27s_line_algorithm
+    if (abs(y1 - y0) < abs(x1 - x0)) {
+        if (x0 > x1) {
+            swap(int, x0, x1);
+            swap(int, y0, y1);
+        }
+
+        int step_x = x1 - x0;
+        int step_y = abs(y1 - y0);
+        int stride = y1 > y0 ? SCREEN_WIDTH : -SCREEN_WIDTH;
+        int D      = 2 * step_y - step_x;
 
-    for (int x = x0; x <= x1; ++x) {
-        setPixel(x, y, color);
-        if (D > 0) {
-            y = y + yi;
-            D = D + (2 * (dy - dx));
-        } else {
-            D = D + 2 * dy;
+        // a run of the row is filled each time the line steps to the next one
+        Color *row = g_pixels + y0 * SCREEN_WIDTH;
+        int start  = x0;
+        for (int x = x0; x < x1; ++x) {
+            if (D > 0) {
+                for (int i = start; i <= x; ++i) {
+                    row[i] = color;
+                }
+                row += stride;
+                start = x + 1;
+                D += 2 * (step_y - step_x);
+            } else {
+                D += 2 * step_y;
+            }
+        }
+        for (int i = start; i <= x1; ++i) {
+            row[i] = color;
+        }
+    } else {
+        if (y0 > y1) {
+            swap(int, x0, x1);
+            swap(int, y0, y1);
+        }
+
+        int step_x = abs(x1 - x0);
+        int step_y = y1 - y0;
+        int xi     = x1 > x0 ? 1 : -1;
+        int D      = 2 * step_x - step_y;
+
+        Color *pixel = g_pixels + x0 + y0 * SCREEN_WIDTH;
+        for (int y = y0;; ++y) {
+            *pixel = color;
+            if (y == y1) break;
+
+            pixel += SCREEN_WIDTH;
+            if (D > 0) {
+                pixel += xi;
+                D += 2 * (step_x - step_y);
+            } else {
+                D += 2 * step_x;
+            }
         }
     }
-}
\ No newline at end of file
+}
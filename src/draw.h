@@ -4,11 +4,16 @@
 #include "color.h"
 #include <stdbool.h>
 
-#define RESOLUTION_DIVISOR 2
-#define SCREEN_WIDTH (640 / RESOLUTION_DIVISOR)
-#define SCREEN_HEIGHT (480 / RESOLUTION_DIVISOR)
-#define PIXEL_SIZE (2 * RESOLUTION_DIVISOR)
-// #define PIXEL_SIZE (1)
+// Frames are drawn at the size of the render target, which can change from one frame to the next.
+// The window has a size of its own and frames are stretched to fill it when presented.
+#define DEFAULT_SCREEN_WIDTH 320
+#define DEFAULT_SCREEN_HEIGHT 240
+#define MIN_SCREEN_SIZE 16
+#define MAX_SCREEN_SIZE 8192
+
+#define SCREEN_WIDTH g_screen_width
+#define SCREEN_HEIGHT g_screen_height
+extern int g_screen_width, g_screen_height;
 
 #define SCREEN_WIDTH_HALF (SCREEN_WIDTH * 0.5)
 #define SCREEN_HEIGHT_HALF (SCREEN_HEIGHT * 0.5)
@@ -19,7 +24,9 @@
 #define FAR_PLANE 100.0f
 #define NEAR_PLANE 0.3f
 
-#define FLOAT_TO_DEPTH(z) ((z / FAR_PLANE) * (uint16_t)(~0))
+// The renderer never writes DEPTH_CLEAR, so a pixel still holding it after a frame was not covered.
+#define DEPTH_CLEAR ((uint16_t)~0)
+#define FLOAT_TO_DEPTH(z) (min((z) / FAR_PLANE, 1.0f) * (uint16_t)(DEPTH_CLEAR - 1))
 
 typedef struct Image {
     Color *data;
@@ -31,6 +38,25 @@ Color sampleImage(Image image, unsigned x, unsigned y);
 
 Color **getPixelBufferPtr();
 
+typedef struct RenderTarget {
+    Color *pixels;
+    uint16_t *depth_buffer;
+    int width, height;
+} RenderTarget;
+
+// Points drawing at the target until the next call, made by the thread drawing frames
+void setRenderTarget(RenderTarget target);
+// "WxH", within MIN_SCREEN_SIZE and MAX_SCREEN_SIZE
+bool parseResolution(const char *text, int *o_width, int *o_height);
+
+// Starts a frame, filling the depth buffer with DEPTH_CLEAR and the pixels with color unless it is
+// NULL. Skipping the pixels relies on fillUncovered to paint what the frame leaves untouched.
+void clearFrame(uint16_t *depth_buffer, const Color *color);
+void fillUncovered(const uint16_t *depth_buffer, Color color);
+// Blends every pixel toward color by its depth, which also paints the pixels the frame left
+// uncovered in color, so it stands in for fillUncovered.
+void fogFrame(const uint16_t *depth_buffer, Color color);
+
 void setPixel(unsigned x, unsigned y, Color color);
 void setPixelI(unsigned i, Color color);
 Color getPixel(unsigned x, unsigned y);
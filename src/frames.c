@@ -0,0 +1,188 @@
+#include "frames.h"
+#include "util.h"
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <malloc.h>
+#include <assert.h>
+
+typedef enum FrameState {
+    FRAME_FREE,
+    FRAME_DRAWING,
+    FRAME_READY,
+    FRAME_PRESENTING,
+} FrameState;
+
+// The lock guards everything but the pixels, which belong to whichever side has the buffer.
+struct FrameQueue {
+    SDL_mutex *lock;
+    SDL_cond *changed;
+    bool closed;
+
+    Color *pixels[NUM_FRAME_BUFFERS];
+    FrameState states[NUM_FRAME_BUFFERS];
+    uint64_t started[NUM_FRAME_BUFFERS]; // performance counter when drawing began
+    unsigned widths[NUM_FRAME_BUFFERS], heights[NUM_FRAME_BUFFERS];
+    unsigned max_width, max_height;
+
+    unsigned ready[NUM_FRAME_BUFFERS]; // drawn buffers, oldest first
+    unsigned ready_head, num_ready;
+    unsigned drawing, presenting;
+
+    unsigned presented, drawn;
+    uint64_t latency_sum, latency_max, draw_sum;
+};
+
+FrameQueue *createFrameQueue(unsigned width, unsigned height) {
+    FrameQueue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) return NULL;
+
+    queue->lock    = SDL_CreateMutex();
+    queue->changed = SDL_CreateCond();
+    bool ok        = queue->lock != NULL && queue->changed != NULL;
+    for (unsigned i = 0; i < NUM_FRAME_BUFFERS; ++i) {
+        queue->pixels[i] = calloc((size_t)width * height, sizeof(*queue->pixels[i]));
+        ok               = ok && queue->pixels[i] != NULL;
+    }
+
+    if (!ok) {
+        printf("ERROR: Failed to create %u frame buffers of %ux%u\n", NUM_FRAME_BUFFERS, width, height);
+        destroyFrameQueue(queue);
+        return NULL;
+    }
+
+    queue->drawing    = NUM_FRAME_BUFFERS;
+    queue->presenting = NUM_FRAME_BUFFERS;
+    queue->max_width  = width;
+    queue->max_height = height;
+    return queue;
+}
+
+void destroyFrameQueue(FrameQueue *queue) {
+    if (queue == NULL) return;
+
+    for (unsigned i = 0; i < NUM_FRAME_BUFFERS; ++i) {
+        free(queue->pixels[i]);
+    }
+    if (queue->lock != NULL) SDL_DestroyMutex(queue->lock);
+    if (queue->changed != NULL) SDL_DestroyCond(queue->changed);
+    free(queue);
+}
+
+void closeFrameQueue(FrameQueue *queue) {
+    SDL_LockMutex(queue->lock);
+    queue->closed = true;
+    SDL_CondBroadcast(queue->changed);
+    SDL_UnlockMutex(queue->lock);
+}
+
+Color *beginFrame(FrameQueue *queue) {
+    SDL_LockMutex(queue->lock);
+    assert(queue->drawing == NUM_FRAME_BUFFERS);
+
+    unsigned buffer = NUM_FRAME_BUFFERS;
+    while (!queue->closed) {
+        for (buffer = 0; buffer < NUM_FRAME_BUFFERS && queue->states[buffer] != FRAME_FREE; ++buffer) {}
+        if (buffer < NUM_FRAME_BUFFERS) break;
+        SDL_CondWait(queue->changed, queue->lock);
+    }
+
+    Color *pixels = NULL;
+    if (!queue->closed) {
+        queue->states[buffer]  = FRAME_DRAWING;
+        queue->started[buffer] = SDL_GetPerformanceCounter();
+        queue->drawing         = buffer;
+        pixels                 = queue->pixels[buffer];
+    }
+    SDL_UnlockMutex(queue->lock);
+
+    return pixels;
+}
+
+void submitFrame(FrameQueue *queue, unsigned width, unsigned height) {
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    SDL_LockMutex(queue->lock);
+    assert(queue->drawing < NUM_FRAME_BUFFERS);
+    assert(width <= queue->max_width && height <= queue->max_height);
+
+    unsigned buffer = queue->drawing;
+    unsigned tail   = (queue->ready_head + queue->num_ready) % NUM_FRAME_BUFFERS;
+
+    queue->states[buffer]  = FRAME_READY;
+    queue->widths[buffer]  = width;
+    queue->heights[buffer] = height;
+    queue->ready[tail]     = buffer;
+    queue->num_ready += 1;
+    queue->drawing = NUM_FRAME_BUFFERS;
+    queue->draw_sum += now - queue->started[buffer];
+    queue->drawn += 1;
+
+    SDL_CondBroadcast(queue->changed);
+    SDL_UnlockMutex(queue->lock);
+}
+
+Color *acquireFrame(FrameQueue *queue, unsigned timeout_ms, unsigned *o_width, unsigned *o_height) {
+    assert(o_width != NULL && o_height != NULL);
+
+    SDL_LockMutex(queue->lock);
+    assert(queue->presenting == NUM_FRAME_BUFFERS);
+
+    if (queue->num_ready == 0 && !queue->closed) SDL_CondWaitTimeout(queue->changed, queue->lock, timeout_ms);
+
+    Color *pixels = NULL;
+    if (queue->num_ready > 0 && !queue->closed) {
+        unsigned buffer   = queue->ready[queue->ready_head];
+        queue->ready_head = (queue->ready_head + 1) % NUM_FRAME_BUFFERS;
+        queue->num_ready -= 1;
+
+        queue->states[buffer] = FRAME_PRESENTING;
+        queue->presenting     = buffer;
+        pixels                = queue->pixels[buffer];
+        *o_width              = queue->widths[buffer];
+        *o_height             = queue->heights[buffer];
+    }
+    SDL_UnlockMutex(queue->lock);
+
+    return pixels;
+}
+
+void releaseFrame(FrameQueue *queue) {
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    SDL_LockMutex(queue->lock);
+    assert(queue->presenting < NUM_FRAME_BUFFERS);
+
+    unsigned buffer  = queue->presenting;
+    uint64_t latency = now - queue->started[buffer];
+    queue->latency_sum += latency;
+    queue->latency_max = max(queue->latency_max, latency);
+    queue->presented += 1;
+
+    queue->states[buffer] = FRAME_FREE;
+    queue->presenting     = NUM_FRAME_BUFFERS;
+
+    SDL_CondBroadcast(queue->changed);
+    SDL_UnlockMutex(queue->lock);
+}
+
+FrameQueueStats takeFrameQueueStats(FrameQueue *queue) {
+    double ms_per_count = 1000.0 / SDL_GetPerformanceFrequency();
+
+    SDL_LockMutex(queue->lock);
+    FrameQueueStats stats = {
+        .presented      = queue->presented,
+        .latency_ms     = queue->presented > 0 ? queue->latency_sum * ms_per_count / queue->presented : 0.0,
+        .max_latency_ms = queue->latency_max * ms_per_count,
+        .draw_ms        = queue->drawn > 0 ? queue->draw_sum * ms_per_count / queue->drawn : 0.0,
+    };
+    queue->presented   = 0;
+    queue->latency_sum = 0;
+    queue->latency_max = 0;
+    queue->drawn       = 0;
+    queue->draw_sum    = 0;
+    SDL_UnlockMutex(queue->lock);
+
+    return stats;
+}
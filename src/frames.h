@@ -0,0 +1,36 @@
+#pragma once
+
+#include "color.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NUM_FRAME_BUFFERS 3
+
+// A ring of software framebuffers between a thread drawing frames and the thread presenting them.
+// One buffer can be drawn while another waits and a third is uploaded, so neither side waits on the
+// other unless it is a whole frame ahead. Frames are presented in the order they were drawn.
+typedef struct FrameQueue FrameQueue;
+
+typedef struct FrameQueueStats {
+    unsigned presented;
+    double latency_ms; // average from starting to draw a frame to releasing it, once uploaded
+    double max_latency_ms;
+    double draw_ms; // average from starting to draw a frame to submitting it
+} FrameQueueStats;
+
+FrameQueue *createFrameQueue(unsigned width, unsigned height);
+void destroyFrameQueue(FrameQueue *queue);
+// wakes whoever is waiting, beginFrame and acquireFrame return NULL from then on
+void closeFrameQueue(FrameQueue *queue);
+
+// drawing side, waits for a free buffer, which fits any frame up to the size the queue was created with
+Color *beginFrame(FrameQueue *queue);
+void submitFrame(FrameQueue *queue, unsigned width, unsigned height);
+
+// presenting side, waits at most timeout_ms for a drawn frame, rows are width pixels apart
+Color *acquireFrame(FrameQueue *queue, unsigned timeout_ms, unsigned *o_width, unsigned *o_height);
+void releaseFrame(FrameQueue *queue);
+
+// since the last call
+FrameQueueStats takeFrameQueueStats(FrameQueue *queue);
@@ -1,28 +1,38 @@
 #include "geo.h"
 #include <stdlib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// rays are tested against this many walls at a time
+#define POLY_BATCH 64
+
 bool pointInPoly(Line *lines, unsigned num_lines, vec2 point) {
     vec2 ray[2] = { { point[0], point[1] }, { point[0] - 1.0f, point[1] } };
-    vec2 line[2];
-    float t;
+    float ts[POLY_BATCH];
 
     unsigned num_intersections = 0;
 
     // Point in polygon casts ray to left and counts number of intersections, odd inside, even out
 
-    for (unsigned i = 0; i < num_lines; ++i) {
-        line[0][0] = lines[i].points[0][0];
-        line[0][1] = lines[i].points[0][1];
-        line[1][0] = lines[i].points[1][0];
-        line[1][1] = lines[i].points[1][1];
+    for (unsigned first = 0; first < num_lines; first += POLY_BATCH) {
+        unsigned count = min(num_lines - first, POLY_BATCH);
+        if (intersectSegmentsRay(&lines[first], count, ray, ts) == 0) continue;
+
+        for (unsigned i = 0; i < count; ++i) {
+            float t   = ts[i];
+            Line line = lines[first + i];
+            if (t < 0.0f) continue;
 
-        if (intersectSegmentRay(line, ray, &t)) {
             // If hitting a vertex exactly, only count if other vertex is above the ray
             if (t != 0.0f && t != 1.0f) {
                 ++num_intersections;
-            } else if (t == 1.0f && line[0][1] > ray[0][1]) {
+            } else if (t == 1.0f && line.points[0][1] > ray[0][1]) {
                 ++num_intersections;
-            } else if (line[1][1] > ray[0][1]) {
+            } else if (line.points[1][1] > ray[0][1]) {
                 ++num_intersections;
             }
         }
@@ -31,14 +41,44 @@ bool pointInPoly(Line *lines, unsigned num_lines, vec2 point) {
     return num_intersections % 2 == 1;
 }
 
-bool pointInConvexPoly(vec2 *vertices, unsigned num_vertices, vec2 point) {
-    for (unsigned i = 1; i < num_vertices; ++i) {
-        vec2 a = { vertices[i - 1][0], vertices[i - 1][1] };
-        vec2 b = { vertices[i][0], vertices[i][1] };
-        if (cross32d(a, b, point) > 0.0f) return false;
+// Walls must wind with the inside on their left, as sectors do. Points on a wall are inside.
+// Four walls at a time, transposed into x0, y0, x1, y1 lanes. The cross products are the same
+// expression as cross32d, so every path agrees on points exactly on a wall.
+bool pointInConvexPoly(Line *lines, unsigned num_lines, vec2 point) {
+    unsigned i = 0;
+
+#if defined(__SSE2__)
+    const __m128 px = _mm_set1_ps(point[0]);
+    const __m128 py = _mm_set1_ps(point[1]);
+    for (; i + 4 <= num_lines; i += 4) {
+        __m128 x0 = _mm_loadu_ps(lines[i + 0].points[0]);
+        __m128 y0 = _mm_loadu_ps(lines[i + 1].points[0]);
+        __m128 x1 = _mm_loadu_ps(lines[i + 2].points[0]);
+        __m128 y1 = _mm_loadu_ps(lines[i + 3].points[0]);
+        _MM_TRANSPOSE4_PS(x0, y0, x1, y1);
+
+        __m128 cross = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(x1, x0), _mm_sub_ps(py, y0)), _mm_mul_ps(_mm_sub_ps(y1, y0), _mm_sub_ps(px, x0)));
+        if (_mm_movemask_ps(_mm_cmplt_ps(cross, _mm_setzero_ps())) != 0) return false;
     }
+#elif defined(__ARM_NEON)
+    const float32x4_t px = vdupq_n_f32(point[0]);
+    const float32x4_t py = vdupq_n_f32(point[1]);
+    for (; i + 4 <= num_lines; i += 4) {
+        float32x4x4_t l = vld4q_f32(lines[i].points[0]);
 
-    return true;
+        float32x4_t cross = vsubq_f32(vmulq_f32(vsubq_f32(l.val[2], l.val[0]), vsubq_f32(py, l.val[1])),
+                                      vmulq_f32(vsubq_f32(l.val[3], l.val[1]), vsubq_f32(px, l.val[0])));
+        uint32x4_t outside = vcltq_f32(cross, vdupq_n_f32(0.0f));
+        uint32x2_t any     = vorr_u32(vget_low_u32(outside), vget_high_u32(outside));
+        if ((vget_lane_u32(any, 0) | vget_lane_u32(any, 1)) != 0) return false;
+    }
+#endif
+
+    for (; i < num_lines; ++i) {
+        if (cross32d(lines[i].points[0], lines[i].points[1], point) < 0.0f) return false;
+    }
+
+    return num_lines > 0;
 }
 
 bool intersectSegmentSegment(vec2 line0[2], vec2 line1[2], float *o_t) {
@@ -133,4 +173,104 @@ bool intersectSegmentRay(vec2 line[2], vec2 ray[2], float *o_t) {
     }
 
     return true;
-}
\ No newline at end of file
+}
+
+float segmentPointDistance(Line line, vec2 dir, float length, vec2 point) {
+    float u = (point[0] - line.points[0][0]) * dir[0] + (point[1] - line.points[0][1]) * dir[1];
+    u       = clamp(u, 0.0f, length);
+
+    float dx = point[0] - (line.points[0][0] + dir[0] * u);
+    float dy = point[1] - (line.points[0][1] + dir[1] * u);
+    return sqrtf(dx * dx + dy * dy);
+}
+
+// Four segments at a time, transposed like pointInConvexPoly. Flipping the sign bits of negative
+// denominators is the scalar version's multiply by signum, so both round the same way.
+unsigned intersectSegmentsRay(const Line *lines, unsigned num_lines, vec2 ray[2], float *o_ts) {
+    float x3 = ray[0][0], y3 = ray[0][1];
+    float x4 = ray[1][0], y4 = ray[1][1];
+
+    unsigned num_hits = 0;
+    unsigned i        = 0;
+
+#if defined(__SSE2__)
+    const __m128 rx   = _mm_set1_ps(x3);
+    const __m128 ry   = _mm_set1_ps(y3);
+    const __m128 rdx  = _mm_set1_ps(x3 - x4);
+    const __m128 rdy  = _mm_set1_ps(y3 - y4);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 miss = _mm_set1_ps(-1.0f);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= num_lines; i += 4) {
+        __m128 x1 = _mm_loadu_ps(lines[i + 0].points[0]);
+        __m128 y1 = _mm_loadu_ps(lines[i + 1].points[0]);
+        __m128 x2 = _mm_loadu_ps(lines[i + 2].points[0]);
+        __m128 y2 = _mm_loadu_ps(lines[i + 3].points[0]);
+        _MM_TRANSPOSE4_PS(x1, y1, x2, y2);
+
+        __m128 dx = _mm_sub_ps(x1, x2), dy = _mm_sub_ps(y1, y2);
+        __m128 ox = _mm_sub_ps(x1, rx), oy = _mm_sub_ps(y1, ry);
+
+        __m128 denom = _mm_sub_ps(_mm_mul_ps(dx, rdy), _mm_mul_ps(dy, rdx));
+        __m128 tn    = _mm_sub_ps(_mm_mul_ps(ox, rdy), _mm_mul_ps(oy, rdx));
+        __m128 un    = _mm_sub_ps(_mm_mul_ps(ox, dy), _mm_mul_ps(oy, dx));
+
+        __m128 s = _mm_and_ps(denom, sign);
+        tn       = _mm_xor_ps(tn, s);
+        un       = _mm_xor_ps(un, s);
+        denom    = _mm_xor_ps(denom, s);
+
+        // t is segment, u is ray.
+        __m128 out = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(tn, zero), _mm_cmpgt_ps(tn, denom)), _mm_cmplt_ps(un, zero));
+        __m128 hit = _mm_andnot_ps(out, _mm_cmpneq_ps(denom, zero));
+
+        __m128 t = _mm_div_ps(tn, denom);
+        _mm_storeu_ps(&o_ts[i], _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, miss)));
+        num_hits += __builtin_popcount(_mm_movemask_ps(hit));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float32x4_t rx   = vdupq_n_f32(x3);
+    const float32x4_t ry   = vdupq_n_f32(y3);
+    const float32x4_t rdx  = vdupq_n_f32(x3 - x4);
+    const float32x4_t rdy  = vdupq_n_f32(y3 - y4);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t miss = vdupq_n_f32(-1.0f);
+    const uint32x4_t sign  = vdupq_n_u32(0x80000000u);
+    for (; i + 4 <= num_lines; i += 4) {
+        float32x4x4_t l = vld4q_f32(lines[i].points[0]);
+
+        float32x4_t dx = vsubq_f32(l.val[0], l.val[2]), dy = vsubq_f32(l.val[1], l.val[3]);
+        float32x4_t ox = vsubq_f32(l.val[0], rx), oy = vsubq_f32(l.val[1], ry);
+
+        float32x4_t denom = vsubq_f32(vmulq_f32(dx, rdy), vmulq_f32(dy, rdx));
+        float32x4_t tn    = vsubq_f32(vmulq_f32(ox, rdy), vmulq_f32(oy, rdx));
+        float32x4_t un    = vsubq_f32(vmulq_f32(ox, dy), vmulq_f32(oy, dx));
+
+        uint32x4_t s = vandq_u32(vreinterpretq_u32_f32(denom), sign);
+        tn           = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(tn), s));
+        un           = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(un), s));
+        denom        = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(denom), s));
+
+        // t is segment, u is ray.
+        uint32x4_t out = vorrq_u32(vorrq_u32(vcltq_f32(tn, zero), vcgtq_f32(tn, denom)), vcltq_f32(un, zero));
+        uint32x4_t hit = vbicq_u32(vmvnq_u32(vceqq_f32(denom, zero)), out);
+
+        vst1q_f32(&o_ts[i], vbslq_f32(hit, vdivq_f32(tn, denom), miss));
+        num_hits += vaddvq_u32(vshrq_n_u32(hit, 31));
+    }
+#endif
+
+    for (; i < num_lines; ++i) {
+        vec2 line[2] = {
+            { lines[i].points[0][0], lines[i].points[0][1] },
+            { lines[i].points[1][0], lines[i].points[1][1] },
+        };
+        if (intersectSegmentRay(line, ray, &o_ts[i])) {
+            ++num_hits;
+        } else {
+            o_ts[i] = -1.0f;
+        }
+    }
+
+    return num_hits;
+}
@@ -8,8 +8,16 @@ typedef struct Line {
 }Line;
 
 bool pointInPoly(Line *lines, unsigned num_lines, vec2 point);
-bool pointInConvexPoly(vec2 *vertices, unsigned num_vertices, vec2 point);
+bool pointInConvexPoly(Line *lines, unsigned num_lines, vec2 point);
 
 bool intersectSegmentSegment(vec2 line0[2], vec2 line1[2], float *o_t);
 bool intersectSegmentLine(vec2 line0[2], vec2 line1[2], float *o_t);
-bool intersectSegmentRay(vec2 line[2], vec2 ray[2], float *o_t);
\ No newline at end of file
+bool intersectSegmentRay(vec2 line[2], vec2 ray[2], float *o_t);
+// dir is the unit direction from the line's first point to its second, length the distance between them
+float segmentPointDistance(Line line, vec2 dir, float length, vec2 point);
+
+// Tests one ray against many segments at once, with the same results as intersectSegmentRay for
+// each. The tests are exact: parallel segments miss, the ends of a segment and the ray's origin are
+// hit, and any tolerance is left to the caller. Writes each segment's t, or -1 for segments the
+// ray misses, and returns the number hit.
+unsigned intersectSegmentsRay(const Line *lines, unsigned num_lines, vec2 ray[2], float *o_ts);
\ No newline at end of file
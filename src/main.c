@@ -3,11 +3,19 @@
 #include <lodepng.h>
 
 #include "portals.h"
+#include "reload.h"
+#include "stream.h"
+#include "sim.h"
+#include "frames.h"
+#include "resolution.h"
+#include "pacing.h"
+#include "maplayer.h"
 #include "color.h"
 #include "draw.h"
 #include "util.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <malloc.h>
 #include <stdint.h>
@@ -15,6 +23,11 @@
 #include <assert.h>
 
 #define WORLD_SCALE 5.0f
+#define WORLD_PATH "res/maps/map0.map"
+#define WORLD_STREAM_MEMORY (64u << 20)
+#define FRAME_WAIT_MS 4
+// the window starts at about this width, frames are stretched to whatever size it is
+#define WINDOW_WIDTH 1280
 
 #ifdef MEMDEBUG
 void *d_malloc(size_t s) {
@@ -67,72 +80,263 @@ typedef struct WallDraw {
     vec2 uv_coords[2];
 } WallDraw;
 
-uint16_t *g_depth_buffer;
-
 Image g_image_array[3];
 Image g_sky_image_array[1];
 
 bool g_render_occlusion = false;
 
+// what is drawn besides the world, toggled by the main thread
+#define RENDER_DEPTH 1
+#define RENDER_MAP 2
+#define RENDER_OVERLAY 4
+#define RENDER_OCCLUSION 8
+#define RENDER_FULL_CLEAR 16
+#define RENDER_FOG 32
+
+// what distant walls fade into with fog on
+#define FOG_COLOR RGB(96, 104, 112)
+
+typedef struct RenderThreadData {
+    Simulation *sim;
+    FrameQueue *frames;
+    WorldStream *stream;
+    uint16_t *depth_buffer;
+    int full_width, full_height;
+    float budget_ms; // 0 draws every frame at the full size
+    Image font;
+    unsigned font_char_width;
+    SDL_atomic_t flags;
+} RenderThreadData;
+
+// draws frames into the queue's buffers until it is closed, uploading and presenting them is up to the main thread
+static int renderThread(void *data) {
+    RenderThreadData *render = data;
+
+    WorldStream *stream                 = render->stream;
+    Image main_font                     = render->font;
+    const unsigned MAIN_FONT_CHAR_WIDTH = render->font_char_width;
+    uint16_t *const depth_buffer        = render->depth_buffer;
+
+    char print_buffer[128];
+    mat3 view_mat;
+
+    ResolutionController resolution;
+    initResolutionController(&resolution, render->full_width, render->full_height, render->budget_ms);
+
+    // built the first time the map is shown and whenever the walls change after that
+    MapLayer map_layer;
+    memset(&map_layer, 0, sizeof(map_layer));
+
+    Color *pixels;
+    while ((pixels = beginFrame(render->frames)) != NULL) {
+        uint64_t frame_start = SDL_GetPerformanceCounter();
+
+        RenderTarget target = { .pixels = pixels, .depth_buffer = depth_buffer, .width = resolution.width, .height = resolution.height };
+        setRenderTarget(target);
+
+        int flags           = SDL_AtomicGet(&render->flags);
+        bool render_depth   = flags & RENDER_DEPTH;
+        bool render_map     = flags & RENDER_MAP;
+        bool render_overlay = flags & RENDER_OVERLAY;
+        bool render_fog     = flags & RENDER_FOG;
+        g_render_occlusion  = flags & RENDER_OCCLUSION;
+
+        // Unless the whole screen is cleared, only what the renderer leaves uncovered is painted
+        // afterwards. The occlusion view tints whatever is already there, so it always clears.
+        Color clear_color = RGB(0, 0, 0);
+        bool full_clear   = (flags & RENDER_FULL_CLEAR) || g_render_occlusion;
+        clearFrame(depth_buffer, full_clear ? &clear_color : NULL);
+
+        // the world holds still until the frame is drawn
+        Camera cam;
+        PortalWorld pod = lockSimWorld(render->sim, &cam);
+
+        mat3 cam_translation, cam_rotation;
+        mat3Translate(VEC2(-cam.pos[0], -cam.pos[1]), cam_translation);
+        mat3Rotate(-cam.rot, cam_rotation);
+        mat3Mul(cam_rotation, cam_translation, view_mat);
+
+        renderPortalWorld(pod, cam);
+        if (render_fog) {
+            fogFrame(depth_buffer, FOG_COLOR);
+        } else if (!full_clear) {
+            fillUncovered(depth_buffer, clear_color);
+        }
+
+        if (render_depth) {
+            for (unsigned i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
+                float z = depth_buffer[i] * 255.0f / (uint16_t)~0;
+                setPixelI(i, RGB(z, z, z));
+            }
+        }
+
+        if (render_map) { // Render map overlay
+            updateMapLayer(&map_layer, pod);
+            drawMapLayer(&map_layer, cam);
+
+            // vec2 screen_cam_pos = { cam.pos[0], cam.pos[1] };
+            vec2 screen_cam_pos = { 0.0f, 0.0f };
+            screen_cam_pos[0] += SCREEN_WIDTH * 0.5f;
+            screen_cam_pos[1] += SCREEN_HEIGHT * 0.5f;
+
+            // drawLine(screen_cam_pos[0], screen_cam_pos[1], screen_cam_pos[0] + cam.rot_sin * 4.0f, screen_cam_pos[1] + -cam.rot_cos * 4.0f, COLOR_YELLOW);
+            drawLine(screen_cam_pos[0], screen_cam_pos[1], screen_cam_pos[0] + 0.0f, screen_cam_pos[1] + -4.0f, COLOR_YELLOW);
+            setPixel(screen_cam_pos[0], screen_cam_pos[1], COLOR_RED);
+        }
+
+        if (render_overlay && cam.sector < pod.num_sectors) {
+            snprintf(print_buffer, sizeof(print_buffer), "SECTOR: %i", cam.sector);
+            renderText(print_buffer, 1, 1, COLOR_BLACK, main_font, MAIN_FONT_CHAR_WIDTH);
+            renderText(print_buffer, 0, 0, COLOR_WHITE, main_font, MAIN_FONT_CHAR_WIDTH);
+
+            snprintf(print_buffer, sizeof(print_buffer), "CEIL: %f", pod.sectors[cam.sector].ceiling_heights[cam.tier]);
+            renderText(print_buffer, 1, 24 + 1, COLOR_BLACK, main_font, MAIN_FONT_CHAR_WIDTH);
+            renderText(print_buffer, 0, 24, COLOR_WHITE, main_font, MAIN_FONT_CHAR_WIDTH);
+
+            snprintf(print_buffer, sizeof(print_buffer), "FLOOR: %f", pod.sectors[cam.sector].floor_heights[cam.tier]);
+            renderText(print_buffer, 1, 24 * 2 + 1, COLOR_BLACK, main_font, MAIN_FONT_CHAR_WIDTH);
+            renderText(print_buffer, 0, 24 * 2, COLOR_WHITE, main_font, MAIN_FONT_CHAR_WIDTH);
+
+            snprintf(print_buffer, sizeof(print_buffer), "PITCH: %f", cam.pitch);
+            renderText(print_buffer, 1, 24 * 3 + 1, COLOR_BLACK, main_font, MAIN_FONT_CHAR_WIDTH);
+            renderText(print_buffer, 0, 24 * 3, COLOR_WHITE, main_font, MAIN_FONT_CHAR_WIDTH);
+
+            // whatever is under the middle of the screen
+            static const char *hit_names[] = { "NOTHING", "WALL", "FLOOR", "CEILING", "OUTSIDE" };
+            RayHit look;
+            castRay(pod, cam.pos, cam.forward, INFINITY, cam.sector, &look);
+            snprintf(print_buffer, sizeof(print_buffer), "LOOK: %s %i IN %i AT %.2f", hit_names[look.type],
+                     look.type == RAY_HIT_WALL ? (int)look.wall : (int)look.tier, look.sector, look.distance);
+            renderText(print_buffer, 1, 24 * 4 + 1, COLOR_BLACK, main_font, MAIN_FONT_CHAR_WIDTH);
+            renderText(print_buffer, 0, 24 * 4, COLOR_WHITE, main_font, MAIN_FONT_CHAR_WIDTH);
+
+            if (stream != NULL) {
+                WorldStreamStats stats = getWorldStreamStats(stream);
+                snprintf(print_buffer, sizeof(print_buffer), "REGIONS: %u/%u %zuK", stats.resident_regions, stats.num_regions, stats.resident_bytes >> 10);
+                renderText(print_buffer, 1, 24 * 5 + 1, COLOR_BLACK, main_font, MAIN_FONT_CHAR_WIDTH);
+                renderText(print_buffer, 0, 24 * 5, COLOR_WHITE, main_font, MAIN_FONT_CHAR_WIDTH);
+            }
+        }
+
+        unlockSimWorld(render->sim);
+        submitFrame(render->frames, target.width, target.height);
+
+        if (render->budget_ms > 0.0f) {
+            float frame_ms = (SDL_GetPerformanceCounter() - frame_start) * 1000.0f / SDL_GetPerformanceFrequency();
+            updateResolution(&resolution, frame_ms);
+        }
+    }
+
+    freeMapLayer(&map_layer);
+
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
 
+    // lightware [-res WxH] [-budget ms] [-pace uncapped|vsync|fixed|adaptive] [-hz n] [-histogram path] [map]
+    // -budget lowers the resolution of frames that take longer than ms to draw, down to a quarter per side
+    // -hz is the rate for fixed pacing, the histogram of frame times is written to -histogram or printed on exit
+    const char *world_path     = WORLD_PATH;
+    const char *histogram_path = NULL;
+    int full_width             = DEFAULT_SCREEN_WIDTH;
+    int full_height            = DEFAULT_SCREEN_HEIGHT;
+    float budget_ms            = 0.0f;
+    PacingMode pacing_mode     = PACING_VSYNC;
+    float target_hz            = 60.0f;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-res") == 0 && i + 1 < argc) {
+            if (!parseResolution(argv[++i], &full_width, &full_height)) {
+                printf("ERROR: Resolution %s is not WxH from %i to %i\n", argv[i], MIN_SCREEN_SIZE, MAX_SCREEN_SIZE);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+            budget_ms = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-pace") == 0 && i + 1 < argc) {
+            if (!parsePacingMode(argv[++i], &pacing_mode)) {
+                printf("ERROR: Pacing %s is not uncapped, vsync, fixed or adaptive\n", argv[i]);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "-hz") == 0 && i + 1 < argc) {
+            target_hz = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-histogram") == 0 && i + 1 < argc) {
+            histogram_path = argv[++i];
+        } else {
+            world_path = argv[i];
+        }
+    }
+
     SDL_Init(SDL_INIT_VIDEO);
 
+    int window_scale   = max(WINDOW_WIDTH / full_width, 1);
     SDL_Window *window = SDL_CreateWindow("Lightware",
                                           SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                          SCREEN_WIDTH * PIXEL_SIZE, SCREEN_HEIGHT * PIXEL_SIZE,
+                                          full_width * window_scale, full_height * window_scale,
                                           SDL_WINDOW_RESIZABLE);
 
-    // Create a renderer with V-Sync enabled.
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, 0); //SDL_RENDERER_PRESENTVSYNC);
+    // V-Sync is switched on and off with the pacing mode
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, pacing_mode == PACING_VSYNC ? SDL_RENDERER_PRESENTVSYNC : 0);
+
+    SDL_DisplayMode display_mode;
+    float display_hz = 0.0f;
+    if (SDL_GetCurrentDisplayMode(max(SDL_GetWindowDisplayIndex(window), 0), &display_mode) == 0) display_hz = display_mode.refresh_rate;
+
+    FramePacer pacer;
+    initFramePacer(&pacer, pacing_mode, target_hz, display_hz);
 
     SDL_SetRenderDrawColor(renderer, 15, 5, 20, 255);
-    SDL_RenderSetLogicalSize(renderer, SCREEN_WIDTH, SCREEN_HEIGHT);
+    SDL_RenderSetLogicalSize(renderer, full_width, full_height);
     SDL_RenderSetIntegerScale(renderer, SDL_TRUE);
 
+    // smaller frames are uploaded to the top left corner and stretched from there
     SDL_Texture *screen_texture = SDL_CreateTexture(renderer,
                                                     SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
-                                                    SCREEN_WIDTH, SCREEN_HEIGHT);
+                                                    full_width, full_height);
 
-    uint16_t *const depth_buffer = (uint16_t *)malloc(SCREEN_HEIGHT * SCREEN_WIDTH * sizeof(*depth_buffer));
+    uint16_t *const depth_buffer = (uint16_t *)malloc((size_t)full_width * full_height * sizeof(*depth_buffer));
     if (depth_buffer == NULL) return -2;
-    g_depth_buffer = depth_buffer;
+
+    // frames are drawn on the render thread, the main thread only uploads and presents them
+    FrameQueue *frames = createFrameQueue(full_width, full_height);
+    if (frames == NULL) return -2;
 
     const int8_t *keys      = (const int8_t *)SDL_GetKeyboardState(NULL);
     int8_t *const last_keys = (int8_t *)malloc(SDL_NUM_SCANCODES * sizeof(*last_keys));
     if (last_keys == NULL) return -2;
 
     int pitch;
-    unsigned int frame = 0;
 
     uint64_t ticks;
-    uint64_t last_ticks = SDL_GetTicks64();
-    float delta;
 
-    uint64_t next_fps_print = 1000;
-    unsigned last_fps_frame = 0;
+    uint64_t next_fps_print = SDL_GetTicks64() + 1000;
+    unsigned last_fps_tick  = 0;
+
+    // the size of the last frame presented
+    unsigned frame_width = full_width, frame_height = full_height;
 
     /////////////////////////////////////////////////////////////
     /////////////////////////////////////////////////////////////
     /////////////////////////////////////////////////////////////
 
-    bool render_depth   = false;
-    bool render_map     = false;
-    bool render_overlay = false;
-
-    Image main_font;
-    const unsigned MAIN_FONT_CHAR_WIDTH = 16;
-    if (!readPng("res/fonts/vhs.png", &main_font)) return -1;
+    RenderThreadData render;
+    render.frames          = frames;
+    render.depth_buffer    = depth_buffer;
+    render.full_width      = full_width;
+    render.full_height     = full_height;
+    render.budget_ms       = budget_ms;
+    render.font_char_width = 16;
+    SDL_AtomicSet(&render.flags, 0);
+    if (!readPng("res/fonts/vhs.png", &render.font)) return -1;
 
     if (!readPng("res/textures/wall.png", &g_image_array[0])) return -1;
     if (!readPng("res/textures/floor.png", &g_image_array[1])) return -1;
     if (!readPng("res/textures/ceiling.png", &g_image_array[2])) return -1;
     if (!readPng("res/textures/MUNSKY01.png", &g_sky_image_array[0])) return -1;
 
-    char print_buffer[128];
-
     Camera cam;
     cam.sector = -1;
+    cam.tier   = 0;
     cam.pos[0] = 0.0f;
     cam.pos[1] = 0.0f;
     cam.pos[2] = 1.65f;
@@ -140,10 +344,32 @@ int main(int argc, char *argv[]) {
     cam.pitch  = 0.0f;
     cam.fov    = 90.0f * TO_RADS;
 
-    mat3 view_mat;
+    // paged worlds are streamed around the camera
+    WorldReloader *reloader = NULL;
+    WorldStream *stream     = NULL;
 
     PortalWorld pod;
-    if (!loadWorld("res/maps/map0.map", &pod, WORLD_SCALE)) return -3;
+    if (isWorldPaged(world_path)) {
+        stream = openWorldStream(world_path, WORLD_SCALE, WORLD_STREAM_MEMORY, &pod);
+        if (stream == NULL) return -3;
+    } else {
+        if (!loadWorld(world_path, &pod, WORLD_SCALE)) return -3;
+
+        // saving the map reloads it in the background, L forces a full reload
+        reloader = startWorldReloader(world_path, pod, WORLD_SCALE);
+    }
+
+    // the simulation owns the world, the reloader and the stream from here on, frames only read them
+    Simulation *sim = startSimulation(pod, cam, reloader, stream);
+    if (sim == NULL) return -4;
+
+    render.sim    = sim;
+    render.stream = stream;
+    SDL_Thread *render_thread = SDL_CreateThread(renderThread, "render", &render);
+    if (render_thread == NULL) {
+        printf("ERROR: Failed to create render thread: %s\n", SDL_GetError());
+        return -4;
+    }
 
     /////////////////////////////////////////////////////////////
     /////////////////////////////////////////////////////////////
@@ -151,14 +377,17 @@ int main(int argc, char *argv[]) {
 
     while (1) {
 
-        ticks      = SDL_GetTicks64();
-        delta      = (float)(ticks - last_ticks) / 1000.0f;
-        last_ticks = ticks;
+        ticks = SDL_GetTicks64();
 
         if (ticks >= next_fps_print) {
             next_fps_print += 1000;
-            printf("FPS: %4u   MS: %f\n", frame - last_fps_frame, 1.0 / (frame - last_fps_frame));
-            last_fps_frame = frame;
+            unsigned sim_ticks    = getSimTicks(sim);
+            FrameQueueStats stats = takeFrameQueueStats(frames);
+            printf("FPS: %4u   MS: %.2f   TICKS: %u   LATENCY: %.1f/%.1f   RES: %ux%u   PACE: %s %.0f\n", stats.presented, stats.draw_ms,
+                   sim_ticks - last_fps_tick, stats.latency_ms, stats.max_latency_ms, frame_width, frame_height,
+                   getPacingModeName(pacer.mode), getPacingHz(&pacer));
+            last_fps_tick = sim_ticks;
+            adaptFramePacer(&pacer, stats.draw_ms);
         }
 
         for (unsigned i = 0; i < SDL_NUM_SCANCODES; ++i) {
@@ -171,242 +400,102 @@ int main(int argc, char *argv[]) {
         }
 
         {
-            if (keys[SDL_SCANCODE_L] && !last_keys[SDL_SCANCODE_L]) {
-                PortalWorld pod2;
-                if (loadWorld("res/maps/map0.map", &pod2, WORLD_SCALE)) {
-                    freeWorld(pod);
-                    pod = pod2;
-                    printf("Reloaded world\n");
-                } else {
-                    printf("Failed to reload world\n");
-                }
+            if (keys[SDL_SCANCODE_L] && !last_keys[SDL_SCANCODE_L] && reloader != NULL) {
+                requestWorldReload(reloader);
             }
 
+            // only this thread changes the flags, the render thread reads them once per frame
+            int flags = SDL_AtomicGet(&render.flags);
+
             if (keys[SDL_SCANCODE_P] && !last_keys[SDL_SCANCODE_P]) {
-                render_depth = !render_depth;
+                flags ^= RENDER_DEPTH;
             }
 
             if (keys[SDL_SCANCODE_O] && !last_keys[SDL_SCANCODE_O]) {
-                g_render_occlusion = !g_render_occlusion;
+                flags ^= RENDER_OCCLUSION;
             }
 
             if (keys[SDL_SCANCODE_M] && !last_keys[SDL_SCANCODE_M]) {
-                render_map = !render_map;
+                flags ^= RENDER_MAP;
             }
 
             if (keys[SDL_SCANCODE_X] && !last_keys[SDL_SCANCODE_X]) {
-                render_overlay = !render_overlay;
+                flags ^= RENDER_OVERLAY;
             }
 
-            float input_h   = keys[SDL_SCANCODE_D] - keys[SDL_SCANCODE_A];
-            float input_v   = keys[SDL_SCANCODE_S] - keys[SDL_SCANCODE_W];
-            float input_z   = keys[SDL_SCANCODE_SPACE] - keys[SDL_SCANCODE_LSHIFT];
-            float input_fov = keys[SDL_SCANCODE_Q] - keys[SDL_SCANCODE_Z];
-            float input_p   = keys[SDL_SCANCODE_UP] - keys[SDL_SCANCODE_DOWN];
-            float input_r   = keys[SDL_SCANCODE_RIGHT] - keys[SDL_SCANCODE_LEFT];
-
-            cam.rot += input_r * delta * 2.0f;
-            cam.rot_cos = cosf(cam.rot);
-            cam.rot_sin = sinf(cam.rot);
-
-            cam.pitch += input_p * delta;
-            cam.pitch = clamp(cam.pitch, -1.0f, 1.0f);
-
-            cam.fov += input_fov * delta * 0.5f;
-            cam.fov = clamp(cam.fov, 30.0f * TO_RADS, 120.0f * TO_RADS);
-
-            cam.forward[0] = cam.rot_sin;
-            cam.forward[1] = -cam.rot_cos;
-            cam.forward[2] = atanf(cam.pitch);
-            normalize3d(cam.forward);
-
-            vec2 movement = { cam.rot_cos * input_h + -cam.rot_sin * input_v, cam.rot_sin * input_h + cam.rot_cos * input_v };
-
-            vec2 new_pos = {
-                cam.pos[0] + movement[0] * delta * 10.0f,
-                cam.pos[1] + movement[1] * delta * 10.0f,
-            };
-
-            // player collision
-            if (cam.sector < pod.num_sectors) {
-                SectorDef sector = pod.sectors[cam.sector];
-                float t;
-
-                for (unsigned i = 0; i < sector.length; ++i) {
-                    Line wall_line     = pod.wall_lines[sector.start + i];
-                    unsigned wall_next = pod.wall_nexts[sector.start + i];
-                    if (wall_next < pod.num_sectors) continue; // TODO: step height
-
-                    vec2 wall_norm;
-                    {
-                        vec2 d    = { wall_line.points[1][0] - wall_line.points[0][0], wall_line.points[1][1] - wall_line.points[0][1] };
-                        float len = dot2d(d, d);
-                        if (len != 0) {
-                            len = sqrtf(len);
-                            d[0] /= len;
-                            d[1] /= len;
-                            wall_norm[0] = -d[1];
-                            wall_norm[1] = d[0];
-                        }
-                    }
-
-                    Line movement_line = {
-                        .points = {
-                            { cam.pos[0], cam.pos[1] },
-                            { new_pos[0] - wall_norm[0], new_pos[1] - wall_norm[1] },
-                        },
-                    };
-
-                    if (intersectSegmentSegment(movement_line.points, wall_line.points, &t)) {
-                        vec2 intersect_point = {
-                            lerp(movement_line.points[0][0], movement_line.points[1][0], t),
-                            lerp(movement_line.points[0][1], movement_line.points[1][1], t),
-                        };
-                        new_pos[0] = intersect_point[0] + wall_norm[0];
-                        new_pos[1] = intersect_point[1] + wall_norm[1];
-                    }
-                }
+            if (keys[SDL_SCANCODE_C] && !last_keys[SDL_SCANCODE_C]) {
+                flags ^= RENDER_FULL_CLEAR;
             }
 
-            cam.pos[0] = new_pos[0];
-            cam.pos[1] = new_pos[1];
-            cam.pos[2] += input_z * delta * 10.0f;
-
-            // printf("%f, %f\n", cam.pos[0], cam.pos[1]);
-
-            cam.sector = getCurrentSector(pod, cam.pos, cam.sector);
-            cam.tier   = getSectorTier(pod, cam.pos[2], cam.sector);
-
-            if (cam.sector < pod.num_sectors) {
-                if (cam.tier >= pod.sectors[cam.sector].num_tiers) cam.tier = 0;
-
-                // cam.pos[2] = pod.sectors[cam.sector].floor_heights[0] + 1.65f;
-                // cam.pos[2] = pod.sectors[cam.sector].floor_height + 0.5f;
-
-                float input_ceil  = keys[SDL_SCANCODE_R] - keys[SDL_SCANCODE_E];
-                float input_floor = keys[SDL_SCANCODE_Y] - keys[SDL_SCANCODE_T];
-
-                pod.sectors[cam.sector].ceiling_heights[cam.tier] += input_ceil * delta;
-                pod.sectors[cam.sector].floor_heights[cam.tier] += input_floor * delta;
-            } else {
-                cam.sector = 0;
-                cam.tier   = 0;
-            }
-        }
-
-        mat3 cam_translation, cam_rotation;
-        mat3Translate(VEC2(-cam.pos[0], -cam.pos[1]), cam_translation);
-        mat3Rotate(-cam.rot, cam_rotation);
-        mat3Mul(cam_rotation, cam_translation, view_mat);
-
-        ////////////////////////////////////////////////
-        //      RENDER
-        ////////////////////////////////////////////////
-
-        SDL_RenderClear(renderer);
-        SDL_LockTexture(screen_texture, NULL, (void **)getPixelBufferPtr(), &pitch);
-
-        // clear screen
-        for (unsigned i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
-            setPixelI(i, RGB(0, 0, 0));
-            depth_buffer[i] = ~0;
-        }
-
-        renderPortalWorld(pod, cam);
-
-        if (render_depth) {
-            for (unsigned i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; ++i) {
-                float z = depth_buffer[i] * 255.0f / (uint16_t)~0;
-                setPixelI(i, RGB(z, z, z));
+            if (keys[SDL_SCANCODE_F] && !last_keys[SDL_SCANCODE_F]) {
+                flags ^= RENDER_FOG;
             }
-        }
-
-        if (render_map) { // Render map overlay
-            for (unsigned i = 0; i < pod.num_sectors; ++i) {
-                SectorDef sector = pod.sectors[i];
-
-                for (unsigned k = 0; k < sector.length; ++k) {
-                    vec2 wall_points[2];
-                    wall_points[0][0]  = pod.wall_lines[sector.start + k].points[0][0];
-                    wall_points[0][1]  = pod.wall_lines[sector.start + k].points[0][1];
-                    wall_points[1][0]  = pod.wall_lines[sector.start + k].points[1][0];
-                    wall_points[1][1]  = pod.wall_lines[sector.start + k].points[1][1];
-                    unsigned wall_next = pod.wall_nexts[sector.start + k];
-
-                    vec2 world_space[2];
-                    vec2 view_tspace[2];
-                    vec2 view_space[2];
-                    vec2 screen_pos[2];
-
-                    for (unsigned j = 0; j < 2; ++j) {
-                        world_space[j][0] = wall_points[j][0];
-                        world_space[j][1] = wall_points[j][1];
-                    }
 
-                    // mat3MulVec2(view_mat, world_space[0], view_space[0]);
-                    // mat3MulVec2(view_mat, world_space[1], view_space[1]);
-                    for (unsigned pi = 0; pi < 2; ++pi) {
-                        // translate by negative cam_pos
-                        view_tspace[pi][0] = world_space[pi][0] - cam.pos[0];
-                        view_tspace[pi][1] = world_space[pi][1] - cam.pos[1];
-
-                        // rotate by negative cam_rot
-                        // Normal:
-                        //  cos -sin
-                        //  sin  cos
-                        view_space[pi][0] = cam.rot_cos * view_tspace[pi][0] + cam.rot_sin * view_tspace[pi][1];
-                        view_space[pi][1] = -cam.rot_sin * view_tspace[pi][0] + cam.rot_cos * view_tspace[pi][1];
-                    }
+            SDL_AtomicSet(&render.flags, flags);
 
-                    for (unsigned j = 0; j < 2; ++j) {
-                        screen_pos[j][0] = view_space[j][0] + SCREEN_WIDTH * 0.5f;
-                        screen_pos[j][1] = view_space[j][1] + SCREEN_HEIGHT * 0.5f;
-                    }
-
-                    drawLine(screen_pos[0][0], screen_pos[0][1], screen_pos[1][0], screen_pos[1][1], wall_next < pod.num_sectors ? COLOR_PURPLE : COLOR_WHITE);
-                    setPixel(screen_pos[0][0], screen_pos[0][1], COLOR_BLACK);
-                    setPixel(screen_pos[1][0], screen_pos[1][1], COLOR_BLACK);
-                }
+            if (keys[SDL_SCANCODE_V] && !last_keys[SDL_SCANCODE_V]) {
+                setPacingMode(&pacer, (pacer.mode + 1) % NUM_PACING_MODES);
+                SDL_RenderSetVSync(renderer, pacer.mode == PACING_VSYNC);
             }
 
-            // vec2 screen_cam_pos = { cam.pos[0], cam.pos[1] };
-            vec2 screen_cam_pos = { 0.0f, 0.0f };
-            screen_cam_pos[0] += SCREEN_WIDTH * 0.5f;
-            screen_cam_pos[1] += SCREEN_HEIGHT * 0.5f;
-
-            // drawLine(screen_cam_pos[0], screen_cam_pos[1], screen_cam_pos[0] + cam.rot_sin * 4.0f, screen_cam_pos[1] + -cam.rot_cos * 4.0f, COLOR_YELLOW);
-            drawLine(screen_cam_pos[0], screen_cam_pos[1], screen_cam_pos[0] + 0.0f, screen_cam_pos[1] + -4.0f, COLOR_YELLOW);
-            setPixel(screen_cam_pos[0], screen_cam_pos[1], COLOR_RED);
+            SimInput input = {
+                .move_h        = keys[SDL_SCANCODE_D] - keys[SDL_SCANCODE_A],
+                .move_v        = keys[SDL_SCANCODE_S] - keys[SDL_SCANCODE_W],
+                .move_z        = keys[SDL_SCANCODE_SPACE] - keys[SDL_SCANCODE_LSHIFT],
+                .turn          = keys[SDL_SCANCODE_RIGHT] - keys[SDL_SCANCODE_LEFT],
+                .pitch         = keys[SDL_SCANCODE_UP] - keys[SDL_SCANCODE_DOWN],
+                .zoom          = keys[SDL_SCANCODE_Q] - keys[SDL_SCANCODE_Z],
+                .raise_ceiling = keys[SDL_SCANCODE_R] - keys[SDL_SCANCODE_E],
+                .raise_floor   = keys[SDL_SCANCODE_Y] - keys[SDL_SCANCODE_T],
+            };
+            setSimInput(sim, input);
         }
 
-        if (render_overlay && cam.sector < pod.num_sectors) {
-            snprintf(print_buffer, sizeof(print_buffer), "SECTOR: %i", cam.sector);
-            renderText(print_buffer, 1, 1, COLOR_BLACK, main_font, MAIN_FONT_CHAR_WIDTH);
-            renderText(print_buffer, 0, 0, COLOR_WHITE, main_font, MAIN_FONT_CHAR_WIDTH);
+        ////////////////////////////////////////////////
+        //      PRESENT
+        ////////////////////////////////////////////////
 
-            snprintf(print_buffer, sizeof(print_buffer), "CEIL: %f", pod.sectors[cam.sector].ceiling_heights[cam.tier]);
-            renderText(print_buffer, 1, 24 + 1, COLOR_BLACK, main_font, MAIN_FONT_CHAR_WIDTH);
-            renderText(print_buffer, 0, 24, COLOR_WHITE, main_font, MAIN_FONT_CHAR_WIDTH);
+        // drawn frames stay queued until they are nearly due, reading input meanwhile
+        if (sleepBeforeFrame(&pacer, FRAME_WAIT_MS)) continue;
 
-            snprintf(print_buffer, sizeof(print_buffer), "FLOOR: %f", pod.sectors[cam.sector].floor_heights[cam.tier]);
-            renderText(print_buffer, 1, 24 * 2 + 1, COLOR_BLACK, main_font, MAIN_FONT_CHAR_WIDTH);
-            renderText(print_buffer, 0, 24 * 2, COLOR_WHITE, main_font, MAIN_FONT_CHAR_WIDTH);
+        // a short wait keeps input responsive when drawing falls behind
+        Color *pixels = acquireFrame(frames, FRAME_WAIT_MS, &frame_width, &frame_height);
+        if (pixels == NULL) continue;
 
-            snprintf(print_buffer, sizeof(print_buffer), "PITCH: %f", cam.pitch);
-            renderText(print_buffer, 1, 24 * 3 + 1, COLOR_BLACK, main_font, MAIN_FONT_CHAR_WIDTH);
-            renderText(print_buffer, 0, 24 * 3, COLOR_WHITE, main_font, MAIN_FONT_CHAR_WIDTH);
+        SDL_Rect frame_rect = { 0, 0, frame_width, frame_height };
+        Uint8 *texture_pixels;
+        SDL_LockTexture(screen_texture, &frame_rect, (void **)&texture_pixels, &pitch);
+        for (unsigned y = 0; y < frame_height; ++y) {
+            memcpy(texture_pixels + (size_t)y * pitch, pixels + y * frame_width, frame_width * sizeof(*pixels));
         }
-
         SDL_UnlockTexture(screen_texture);
-        SDL_RenderCopy(renderer, screen_texture, NULL, NULL);
-        SDL_RenderPresent(renderer);
+        releaseFrame(frames);
 
-        frame += 1;
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, screen_texture, &frame_rect, NULL);
+        waitForFrame(&pacer);
+        SDL_RenderPresent(renderer);
+        framePresented(&pacer);
     }
 
 _success_exit:
+    closeFrameQueue(frames);
+    SDL_WaitThread(render_thread, NULL);
+    destroyFrameQueue(frames);
+
+    pod = stopSimulation(sim);
+    stopWorldReloader(reloader);
+    closeWorldStream(stream);
     freeWorld(pod);
 
+    FILE *histogram = histogram_path != NULL ? fopen(histogram_path, "w") : stdout;
+    if (histogram != NULL) {
+        writeFrameHistogram(&pacer, histogram);
+        if (histogram != stdout) fclose(histogram);
+    } else {
+        printf("ERROR: Failed to open %s\n", histogram_path);
+    }
+
     free(last_keys);
     free(depth_buffer);
     SDL_DestroyTexture(screen_texture);
@@ -450,10 +539,3 @@ bool readPng(const char *path, Image *out) {
     return true;
 }
 
-Color sampleImage(Image image, unsigned x, unsigned y) {
-    if (x >= image.width || y >= image.height) return (Color){};
-    Color res;
-    unsigned i = x + y * image.width;
-    res        = image.data[i];
-    return res;
-}
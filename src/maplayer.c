@@ -0,0 +1,177 @@
+#include "maplayer.h"
+#include "draw.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAP_LINES_PER_CELL 4
+// small enough cells would make the cells in view cost more than the lines in them
+#define MAP_MIN_CELL_SIZE 8.0f
+#define MAP_MAX_GRID_SIZE 1024
+
+void freeMapLayer(MapLayer *layer) {
+    free(layer->lines);
+    free(layer->cell_starts);
+    free(layer->cell_lines);
+    free(layer->stamps);
+    memset(layer, 0, sizeof(*layer));
+}
+
+// the cells a line's bounds overlap, false when they are off the grid
+static bool lineCellRange(const MapLayer *layer, Line line, unsigned o_lo[2], unsigned o_hi[2]) {
+    for (unsigned axis = 0; axis < 2; ++axis) {
+        float lo   = (min(line.points[0][axis], line.points[1][axis]) - layer->origin[axis]) / layer->cell_size;
+        float hi   = (max(line.points[0][axis], line.points[1][axis]) - layer->origin[axis]) / layer->cell_size;
+        unsigned n = axis == 0 ? layer->width : layer->height;
+        if (hi < 0.0f || lo >= n) return false;
+
+        o_lo[axis] = (unsigned)clamp(lo, 0.0f, (float)(n - 1));
+        o_hi[axis] = (unsigned)clamp(hi, 0.0f, (float)(n - 1));
+    }
+    return true;
+}
+
+bool updateMapLayer(MapLayer *layer, PortalWorld pod) {
+    if (layer->built && layer->generation == pod.generation && layer->wall_edits == pod.wall_edits) {
+        return true;
+    }
+
+    freeMapLayer(layer);
+    layer->lines  = malloc(max(pod.num_walls, 1) * sizeof(*layer->lines));
+    layer->stamps = calloc(max(pod.num_walls, 1), sizeof(*layer->stamps));
+    if (layer->lines == NULL || layer->stamps == NULL) goto _fail;
+
+    // a portal with a twin in a resident sector is left to whichever of the pair comes first
+    vec2 lo = { INFINITY, INFINITY }, hi = { -INFINITY, -INFINITY };
+    for (unsigned i = 0; i < pod.num_sectors; ++i) {
+        SectorDef sector = pod.sectors[i];
+        if (sector.num_tiers == 0) continue; // not resident
+
+        for (unsigned k = sector.first_portal; k < sector.first_portal + sector.num_portals; ++k) {
+            Portal portal = pod.portals[k];
+            if (portal.twin < portal.wall && portal.sector < pod.num_sectors && pod.sectors[portal.sector].num_tiers > 0) {
+                layer->stamps[portal.wall] = 1;
+            }
+        }
+
+        for (unsigned w = sector.start; w < sector.start + sector.length; ++w) {
+            if (layer->stamps[w] != 0) continue;
+
+            Line line = pod.wall_lines[w];
+            layer->lines[layer->num_lines++] = (MapLine){
+                .line  = line,
+                .color = pod.wall_nexts[w] < pod.num_sectors ? COLOR_PURPLE : COLOR_WHITE,
+            };
+
+            for (unsigned p = 0; p < 2; ++p) {
+                lo[0] = min(lo[0], line.points[p][0]);
+                lo[1] = min(lo[1], line.points[p][1]);
+                hi[0] = max(hi[0], line.points[p][0]);
+                hi[1] = max(hi[1], line.points[p][1]);
+            }
+        }
+    }
+    memset(layer->stamps, 0, max(pod.num_walls, 1) * sizeof(*layer->stamps));
+
+    // cells of about MAP_LINES_PER_CELL lines each
+    if (layer->num_lines == 0) {
+        lo[0] = lo[1] = hi[0] = hi[1] = 0.0f;
+    }
+    float extent       = max(max(hi[0] - lo[0], hi[1] - lo[1]), MAP_MIN_CELL_SIZE);
+    float area         = max(hi[0] - lo[0], MAP_MIN_CELL_SIZE) * max(hi[1] - lo[1], MAP_MIN_CELL_SIZE);
+    float cell_size    = sqrtf(area * MAP_LINES_PER_CELL / max(layer->num_lines, 1));
+    layer->cell_size   = max(max(cell_size, MAP_MIN_CELL_SIZE), extent / MAP_MAX_GRID_SIZE);
+    layer->origin[0]   = lo[0];
+    layer->origin[1]   = lo[1];
+    layer->width       = min((unsigned)((hi[0] - lo[0]) / layer->cell_size) + 1, MAP_MAX_GRID_SIZE);
+    layer->height      = min((unsigned)((hi[1] - lo[1]) / layer->cell_size) + 1, MAP_MAX_GRID_SIZE);
+    unsigned num_cells = layer->width * layer->height;
+
+    layer->cell_starts = calloc(num_cells + 1, sizeof(*layer->cell_starts));
+    if (layer->cell_starts == NULL) goto _fail;
+
+    // Counts become the end of each cell, and filling from the last line back walks every end to
+    // its cell's start, which leaves the lines of a cell in order.
+    unsigned cell_lo[2], cell_hi[2];
+    for (unsigned i = 0; i < layer->num_lines; ++i) {
+        lineCellRange(layer, layer->lines[i].line, cell_lo, cell_hi);
+        for (unsigned y = cell_lo[1]; y <= cell_hi[1]; ++y) {
+            for (unsigned x = cell_lo[0]; x <= cell_hi[0]; ++x) {
+                layer->cell_starts[x + y * layer->width] += 1;
+            }
+        }
+    }
+    for (unsigned i = 1; i < num_cells; ++i) {
+        layer->cell_starts[i] += layer->cell_starts[i - 1];
+    }
+    layer->cell_starts[num_cells] = layer->cell_starts[num_cells - 1];
+
+    layer->cell_lines = malloc(max(layer->cell_starts[num_cells], 1) * sizeof(*layer->cell_lines));
+    if (layer->cell_lines == NULL) goto _fail;
+
+    for (unsigned i = layer->num_lines; i-- > 0;) {
+        lineCellRange(layer, layer->lines[i].line, cell_lo, cell_hi);
+        for (unsigned y = cell_lo[1]; y <= cell_hi[1]; ++y) {
+            for (unsigned x = cell_lo[0]; x <= cell_hi[0]; ++x) {
+                layer->cell_lines[--layer->cell_starts[x + y * layer->width]] = i;
+            }
+        }
+    }
+
+    layer->epoch      = 0;
+    layer->num_walls  = pod.num_walls;
+    layer->generation = pod.generation;
+    layer->wall_edits = pod.wall_edits;
+    layer->built      = true;
+    return true;
+
+_fail:
+    printf("ERROR: Failed to build the map layer for %u walls\n", pod.num_walls);
+    freeMapLayer(layer);
+    return false;
+}
+
+void drawMapLayer(MapLayer *layer, Camera cam) {
+    if (!layer->built || layer->num_lines == 0) return;
+
+    // stamps are only cleared for real once the epochs wrap
+    if (++layer->epoch == 0) {
+        memset(layer->stamps, 0, layer->num_walls * sizeof(*layer->stamps));
+        layer->epoch = 1;
+    }
+
+    // every cell that overlaps the circle around the screen, which covers it at any rotation
+    vec2 center  = { SCREEN_WIDTH * 0.5f, SCREEN_HEIGHT * 0.5f };
+    float radius = sqrtf(center[0] * center[0] + center[1] * center[1]);
+    Line view    = { .points = { { cam.pos[0] - radius, cam.pos[1] - radius }, { cam.pos[0] + radius, cam.pos[1] + radius } } };
+    unsigned cell_lo[2], cell_hi[2];
+    if (!lineCellRange(layer, view, cell_lo, cell_hi)) return;
+
+    for (unsigned y = cell_lo[1]; y <= cell_hi[1]; ++y) {
+        for (unsigned x = cell_lo[0]; x <= cell_hi[0]; ++x) {
+            unsigned cell = x + y * layer->width;
+
+            for (unsigned i = layer->cell_starts[cell]; i < layer->cell_starts[cell + 1]; ++i) {
+                unsigned line_index = layer->cell_lines[i];
+                if (layer->stamps[line_index] == layer->epoch) continue;
+                layer->stamps[line_index] = layer->epoch;
+
+                MapLine map_line = layer->lines[line_index];
+                vec2 screen_pos[2];
+                for (unsigned p = 0; p < 2; ++p) {
+                    // translate by negative cam_pos, rotate by negative cam_rot
+                    float tx         = map_line.line.points[p][0] - cam.pos[0];
+                    float ty         = map_line.line.points[p][1] - cam.pos[1];
+                    screen_pos[p][0] = cam.rot_cos * tx + cam.rot_sin * ty + center[0];
+                    screen_pos[p][1] = -cam.rot_sin * tx + cam.rot_cos * ty + center[1];
+                }
+
+                drawLine(screen_pos[0][0], screen_pos[0][1], screen_pos[1][0], screen_pos[1][1], map_line.color);
+                setPixel(screen_pos[0][0], screen_pos[0][1], COLOR_BLACK);
+                setPixel(screen_pos[1][0], screen_pos[1][1], COLOR_BLACK);
+            }
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "portals.h"
+#include "color.h"
+
+typedef struct MapLine {
+    Line line;
+    Color color;
+} MapLine;
+
+// The top down map's lines in world space, one per wall with a portal drawn from one side only,
+// bucketed in a grid so a frame only looks at the cells around the camera. It is rebuilt when the
+// world's walls change, which the world's generation and wall edit counter tell along with a reload
+// or a region streaming in, and not when only heights do.
+typedef struct MapLayer {
+    MapLine *lines;
+    unsigned num_lines;
+
+    vec2 origin;
+    float cell_size;
+    unsigned width, height;
+    unsigned *cell_starts; // width * height + 1 offsets into cell_lines
+    unsigned *cell_lines;
+
+    unsigned *stamps; // the draw each line was last drawn in, as lines can be in several cells
+    unsigned epoch;
+
+    // what it was built from
+    unsigned num_walls;
+    unsigned generation;
+    unsigned wall_edits;
+    bool built;
+} MapLayer;
+
+void freeMapLayer(MapLayer *layer);
+// rebuilds the layer if the world's walls are not the ones it was built from
+bool updateMapLayer(MapLayer *layer, PortalWorld pod);
+// the lines within sight of the screen, centered on the camera and turned with it, a pixel per unit
+void drawMapLayer(MapLayer *layer, Camera cam);
@@ -0,0 +1,198 @@
+#include "pacing.h"
+#include "util.h"
+
+#include <SDL2/SDL.h>
+
+#include <string.h>
+#include <assert.h>
+
+#define PACING_DEFAULT_DISPLAY_HZ 60.0f
+// sleeps are trusted this close to the deadline before any have been measured
+#define PACING_INITIAL_SLACK_MS 2
+// spinning stops at this fraction of a period, a sleep waking up later than that is a hitch rather than the timer
+#define PACING_MAX_SLACK 4
+// adaptive pacing drops a rate when more than one frame in this many misses
+#define PACING_MISS_RATIO 20
+// and climbs back when drawing takes at most this much of the higher rate's period
+#define PACING_CLIMB_FRACTION 0.75
+
+static const char *s_mode_names[NUM_PACING_MODES] = { "uncapped", "vsync", "fixed", "adaptive" };
+
+static bool isTimed(PacingMode mode) {
+    return mode == PACING_FIXED || mode == PACING_ADAPTIVE;
+}
+
+static void updatePeriod(FramePacer *pacer) {
+    pacer->period   = max((uint64_t)(SDL_GetPerformanceFrequency() / getPacingHz(pacer)), 1);
+    pacer->next_due = 0;
+}
+
+void initFramePacer(FramePacer *o_pacer, PacingMode mode, float target_hz, float display_hz) {
+    assert(o_pacer != NULL);
+    assert(mode < NUM_PACING_MODES);
+    memset(o_pacer, 0, sizeof(*o_pacer));
+
+    o_pacer->mode        = mode;
+    o_pacer->target_hz   = target_hz > 0.0f ? target_hz : PACING_DEFAULT_DISPLAY_HZ;
+    o_pacer->display_hz  = display_hz > 0.0f ? display_hz : PACING_DEFAULT_DISPLAY_HZ;
+    o_pacer->divisor     = 1;
+    o_pacer->sleep_slack = SDL_GetPerformanceFrequency() * PACING_INITIAL_SLACK_MS / 1000;
+    updatePeriod(o_pacer);
+}
+
+void setPacingMode(FramePacer *pacer, PacingMode mode) {
+    assert(mode < NUM_PACING_MODES);
+    pacer->mode         = mode;
+    pacer->divisor      = 1;
+    pacer->last_present = 0; // the switch is not a missed frame
+    updatePeriod(pacer);
+}
+
+const char *getPacingModeName(PacingMode mode) {
+    return mode < NUM_PACING_MODES ? s_mode_names[mode] : "unknown";
+}
+
+bool parsePacingMode(const char *name, PacingMode *o_mode) {
+    for (unsigned i = 0; i < NUM_PACING_MODES; ++i) {
+        if (strcmp(name, s_mode_names[i]) == 0) {
+            *o_mode = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+float getPacingHz(const FramePacer *pacer) {
+    switch (pacer->mode) {
+    case PACING_VSYNC: return pacer->display_hz;
+    case PACING_ADAPTIVE: return pacer->display_hz / pacer->divisor;
+    default: return pacer->target_hz;
+    }
+}
+
+// Sleeps for up to max_ms but no closer to the next frame than the slack, returns when it woke up.
+// Each sleep grows the slack at once to how late it woke and otherwise shrinks it slowly.
+static uint64_t sleepCalibrated(FramePacer *pacer, uint64_t now, unsigned max_ms) {
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    if (pacer->next_due <= now + pacer->sleep_slack) return now;
+
+    Uint32 sleep_ms = (Uint32)min((pacer->next_due - now - pacer->sleep_slack) * 1000 / frequency, max_ms);
+    if (sleep_ms == 0) return now;
+
+    SDL_Delay(sleep_ms);
+    uint64_t woke      = SDL_GetPerformanceCounter();
+    uint64_t expected  = now + sleep_ms * frequency / 1000;
+    uint64_t overshoot = woke > expected ? woke - expected : 0;
+    pacer->sleep_slack = min(max(overshoot, pacer->sleep_slack - pacer->sleep_slack / 16), pacer->period / PACING_MAX_SLACK);
+    return woke;
+}
+
+bool sleepBeforeFrame(FramePacer *pacer, unsigned max_ms) {
+    if (!isTimed(pacer->mode) || pacer->next_due == 0) return false;
+
+    uint64_t now = sleepCalibrated(pacer, SDL_GetPerformanceCounter(), max_ms);
+    return pacer->next_due > now + pacer->sleep_slack + SDL_GetPerformanceFrequency() / 1000;
+}
+
+void waitForFrame(FramePacer *pacer) {
+    if (!isTimed(pacer->mode)) return;
+
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    // more than a whole period behind, start the schedule over rather than rush to catch up
+    if (pacer->next_due == 0 || now > pacer->next_due + pacer->period) {
+        pacer->next_due = now;
+        return;
+    }
+
+    for (uint64_t slept = 0; slept != now;) {
+        slept = now;
+        now   = sleepCalibrated(pacer, now, ~0u);
+    }
+
+    while (now < pacer->next_due) {
+        SDL_CPUPauseInstruction();
+        now = SDL_GetPerformanceCounter();
+    }
+}
+
+void framePresented(FramePacer *pacer) {
+    uint64_t now = SDL_GetPerformanceCounter();
+
+    if (pacer->last_present != 0) {
+        uint64_t interval = now - pacer->last_present;
+        double ms         = interval * 1000.0 / SDL_GetPerformanceFrequency();
+        unsigned bucket   = min((unsigned)(ms / PACING_BUCKET_MS), PACING_NUM_BUCKETS - 1);
+        bool missed       = interval > pacer->period + pacer->period / 2;
+
+        pacer->histogram[bucket] += 1;
+        pacer->frames += 1;
+        pacer->missed += missed;
+        pacer->total += interval;
+        pacer->longest = max(pacer->longest, interval);
+        pacer->recent_frames += 1;
+        pacer->recent_missed += missed;
+    }
+    pacer->last_present = now;
+
+    // the schedule keeps to multiples of the period from where it started, so presents do not drift
+    if (isTimed(pacer->mode) && pacer->next_due != 0) pacer->next_due += pacer->period;
+}
+
+void adaptFramePacer(FramePacer *pacer, double draw_ms) {
+    if (pacer->mode == PACING_ADAPTIVE && pacer->recent_frames > 0) {
+        unsigned divisor = pacer->divisor;
+        if (pacer->recent_missed * PACING_MISS_RATIO > pacer->recent_frames) {
+            divisor = min(divisor + 1, PACING_MAX_DIVISOR);
+        } else if (divisor > 1 && draw_ms < PACING_CLIMB_FRACTION * 1000.0 * (divisor - 1) / pacer->display_hz) {
+            divisor -= 1;
+        }
+
+        if (divisor != pacer->divisor) {
+            pacer->divisor = divisor;
+            updatePeriod(pacer);
+        }
+    }
+
+    pacer->recent_frames = 0;
+    pacer->recent_missed = 0;
+}
+
+static double histogramPercentile(const FramePacer *pacer, double fraction) {
+    unsigned target = (unsigned)(pacer->frames * fraction);
+    unsigned seen   = 0;
+    for (unsigned i = 0; i < PACING_NUM_BUCKETS; ++i) {
+        seen += pacer->histogram[i];
+        if (seen > target) return (i + 1) * PACING_BUCKET_MS;
+    }
+    return PACING_NUM_BUCKETS * PACING_BUCKET_MS;
+}
+
+void writeFrameHistogram(const FramePacer *pacer, FILE *out) {
+    double ms_per_count = 1000.0 / SDL_GetPerformanceFrequency();
+
+    fprintf(out, "PACING: %s %.1fhz\n", getPacingModeName(pacer->mode), getPacingHz(pacer));
+    fprintf(out, "FRAMES: %u   MISSED: %u   AVERAGE: %.2fms   LONGEST: %.2fms\n", pacer->frames, pacer->missed,
+            pacer->frames > 0 ? pacer->total * ms_per_count / pacer->frames : 0.0, pacer->longest * ms_per_count);
+    if (pacer->frames == 0) return;
+
+    fprintf(out, "P50: %.1fms   P95: %.1fms   P99: %.1fms\n", histogramPercentile(pacer, 0.5), histogramPercentile(pacer, 0.95),
+            histogramPercentile(pacer, 0.99));
+
+    unsigned most = 0;
+    for (unsigned i = 0; i < PACING_NUM_BUCKETS; ++i) {
+        most = max(most, pacer->histogram[i]);
+    }
+
+    // each row is the frames up to that many milliseconds apart, the last those further apart
+    for (unsigned i = 0; i < PACING_NUM_BUCKETS; ++i) {
+        if (pacer->histogram[i] == 0) continue;
+        bool last = i == PACING_NUM_BUCKETS - 1;
+
+        char bar[41];
+        unsigned length = (unsigned)((uint64_t)pacer->histogram[i] * (sizeof(bar) - 1) / most);
+        memset(bar, '#', length);
+        bar[length] = '\0';
+        fprintf(out, "%s%6.1f %8u %s\n", last ? ">" : " ", (i + !last) * PACING_BUCKET_MS, pacer->histogram[i], bar);
+    }
+}
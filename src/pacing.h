@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum PacingMode {
+    PACING_UNCAPPED, // presents frames as soon as they are drawn
+    PACING_VSYNC,    // presenting waits for the display
+    PACING_FIXED,    // presents at the target rate
+    PACING_ADAPTIVE, // presents at the display rate divided by the smallest divisor drawing keeps up with
+    NUM_PACING_MODES,
+} PacingMode;
+
+#define PACING_BUCKET_MS 0.5
+#define PACING_NUM_BUCKETS 200 // the last also counts anything longer
+#define PACING_MAX_DIVISOR 4
+
+// Decides when the main thread presents, and keeps a histogram of the time between presents over
+// the whole run. Waiting sleeps most of the way and spins the rest, with the spin sized by how
+// late sleeps have been waking up lately. A frame misses its deadline when it comes more than half
+// a period late. Frames the pacer holds back are held in the frame queue, so drawing slows down
+// with presenting instead of spinning ahead.
+typedef struct FramePacer {
+    PacingMode mode;
+    float target_hz, display_hz;
+    unsigned divisor;
+
+    uint64_t period; // performance counts between presents, for the mode
+    uint64_t next_due, last_present;
+    uint64_t sleep_slack;
+
+    unsigned histogram[PACING_NUM_BUCKETS];
+    unsigned frames, missed;
+    uint64_t total, longest;
+    unsigned recent_frames, recent_missed; // since the last adaptFramePacer
+} FramePacer;
+
+// display_hz is 0 when unknown, which treats the display as 60hz
+void initFramePacer(FramePacer *o_pacer, PacingMode mode, float target_hz, float display_hz);
+void setPacingMode(FramePacer *pacer, PacingMode mode);
+const char *getPacingModeName(PacingMode mode);
+bool parsePacingMode(const char *name, PacingMode *o_mode);
+float getPacingHz(const FramePacer *pacer);
+
+// Sleeps at most max_ms while the next frame is not due, so the caller can do other things in
+// between. Returns false once the frame is near enough that waitForFrame should take over.
+bool sleepBeforeFrame(FramePacer *pacer, unsigned max_ms);
+// returns once the next frame is due, right away unless the mode paces with timers
+void waitForFrame(FramePacer *pacer);
+void framePresented(FramePacer *pacer);
+
+// Every so often, with how long frames took to draw since the last call. Adaptive pacing drops
+// to a lower rate when frames miss and climbs back when drawing would fit the higher one.
+void adaptFramePacer(FramePacer *pacer, double draw_ms);
+
+void writeFrameHistogram(const FramePacer *pacer, FILE *out);
@@ -23,306 +23,104 @@ typedef struct WallAttribute {
 
 bool clipWall(vec2 clip_plane[2], Line *wall, WallAttribute attr[2]);
 
-#define MIN_WORLD_VERSION 1
-#define MAX_WORLD_VERSION 1
-bool loadWorld(const char *path, PortalWorld *o_world, float scale) {
-    assert(path != NULL);
-    assert(o_world != NULL);
-
-    FILE *file = fopen(path, "r");
-    if (file == NULL) {
-        printf("ERROR: Failed to open %s\n", path);
-        return false;
-    }
-    printf("Opened %s\n", path);
-
-    unsigned wall_index = 0;
-    char line[1024];
-    char *line_tmp;
-    size_t line_size = 1024;
-
-    unsigned version = 0;
-    unsigned unsigned_buff0;
-    int num_read;
-    char directive_name[64];
-
-    unsigned num_sectors_read = 0;
-    unsigned num_walls_read   = 0;
-
-    SectorDef tmp_sector;
-
-    memset(o_world, 0, sizeof(*o_world));
-
-    enum state_e {
-        state_version,
-        state_open,
-        state_sectors,
-        state_walls,
-    } state = state_version;
-
-    while (fgets(line, line_size, file) != NULL) {
-        ++wall_index;
-        num_read = sscanf(line, "%64s", directive_name);
-        if (num_read == EOF) continue;
-        if (strcmp(directive_name, "//") == 0) continue;
-
-        // printf("%s: %s", directive_name, line);
-
-        switch (state) {
-            case state_version:
-                if (strcmp(directive_name, "VERSION") == 0) {
-                    num_read = sscanf(line, "%*s %u", &version);
-                    if (num_read != 1) {
-                        printf("ERROR:%u: 'VERSION' expects one unsigned parameter\n", wall_index);
-                        return false;
-                    }
-
-                    if (version < MIN_WORLD_VERSION || version > MAX_WORLD_VERSION) {
-                        printf("ERROR:%u: Version number of %u is not supported: min %u to max %u.\n", wall_index, version, MIN_WORLD_VERSION, MAX_WORLD_VERSION);
-                        return false;
-                    }
-
-                    state = state_open;
-                } else {
-                    printf("ERROR:%u: Expected first directive to be 'VERSION'\n", wall_index);
-                    return false;
-                }
-                break;
-                ///////////////////////////////////////////////////////////////////////////////////////////////////
-            case state_open:
-                if (strcmp(directive_name, "SECTORS") == 0) {
-                    num_read = sscanf(line, "%*s %u", &unsigned_buff0);
-
-                    if (num_read != 1) {
-                        printf("ERROR:%u: 'SECTORS' expects one unsigned parameter\n", wall_index);
-                        return false;
-                    }
-
-                    o_world->num_sectors += unsigned_buff0;
-                    o_world->sectors = realloc(o_world->sectors, o_world->num_sectors * sizeof(*o_world->sectors));
-                    state            = state_sectors;
-
-                } else if (strcmp(directive_name, "WALLS") == 0) {
-                    num_read = sscanf(line, "%*s %u", &unsigned_buff0);
-
-                    if (num_read != 1) {
-                        printf("ERROR:%u: 'WALLS' expects one unsigned parameter\n", wall_index);
-                        return false;
-                    }
-
-                    o_world->num_walls += unsigned_buff0;
-                    o_world->wall_lines       = realloc(o_world->wall_lines, o_world->num_walls * sizeof(*o_world->wall_lines));
-                    o_world->wall_nexts       = realloc(o_world->wall_nexts, o_world->num_walls * sizeof(*o_world->wall_nexts));
-                    o_world->wall_is_skys     = realloc(o_world->wall_is_skys, o_world->num_walls * sizeof(*o_world->wall_is_skys));
-                    o_world->wall_texture_ids = realloc(o_world->wall_texture_ids, o_world->num_walls * sizeof(*o_world->wall_texture_ids));
-
-                    state = state_walls;
-                } else {
-                    printf("ERROR:%u: Unknown or unexpected directive: %s\n", wall_index, directive_name);
-                    return false;
-                }
-                break;
-                ///////////////////////////////////////////////////////////////////////////////////////////////////
-            case state_sectors:
-                if (strcmp(directive_name, "END") == 0) {
-                    state = state_open;
-                    break;
-                }
-                if (num_sectors_read + 1 > o_world->num_sectors) {
-                    o_world->num_sectors += 10;
-                    o_world->sectors = realloc(o_world->sectors, o_world->num_sectors * sizeof(*o_world->sectors));
-                }
-
-                num_read = sscanf(line, "%u %u %u", &tmp_sector.start, &tmp_sector.length, &tmp_sector.num_tiers);
-                if (num_read != 3) {
-                    printf("ERROR:%u: Ill-formed sector definition\n", wall_index);
-                    return false;
-                }
-
-                if (tmp_sector.num_tiers < 1) {
-                    printf("ERROR:%u: Sectors require at least one tier\n", wall_index);
-                    return false;
-                }
-
-                tmp_sector.floor_heights       = malloc(tmp_sector.num_tiers * sizeof(*tmp_sector.floor_heights));
-                tmp_sector.ceiling_heights     = malloc(tmp_sector.num_tiers * sizeof(*tmp_sector.ceiling_heights));
-                tmp_sector.is_skys             = malloc(tmp_sector.num_tiers * sizeof(*tmp_sector.is_skys));
-                tmp_sector.floor_texture_ids   = malloc(tmp_sector.num_tiers * sizeof(*tmp_sector.floor_texture_ids));
-                tmp_sector.ceiling_texture_ids = malloc(tmp_sector.num_tiers * sizeof(*tmp_sector.ceiling_texture_ids));
-
-                line_tmp = line;
-
-                for (unsigned i = 0; i < tmp_sector.num_tiers; ++i) {
-                    // skip to next tier def
-                    line_tmp = strchr(line_tmp, '|') + 1;
-
-                    num_read = sscanf(line_tmp, "%f %f %u %u %u",
-                                      &tmp_sector.floor_heights[i],
-                                      &tmp_sector.ceiling_heights[i],
-                                      &unsigned_buff0,
-                                      &tmp_sector.floor_texture_ids[i],
-                                      &tmp_sector.ceiling_texture_ids[i]);
-
-                    if (num_read != 5) {
-                        printf("ERROR:%u: Ill-formed sector tier definition\n", wall_index);
-                        return false;
-                    }
-
-                    tmp_sector.is_skys[i] = unsigned_buff0 != 0;
-                }
-
-                o_world->sectors[num_sectors_read] = tmp_sector;
-                ++num_sectors_read;
-                break;
-                ///////////////////////////////////////////////////////////////////////////////////////////////////
-            case state_walls:
-                if (strcmp(directive_name, "END") == 0) {
-                    state = state_open;
-                    break;
-                }
-                if (num_walls_read + 1 > o_world->num_walls) {
-                    o_world->num_walls += 10;
-                    o_world->wall_lines       = realloc(o_world->wall_lines, o_world->num_walls * sizeof(*o_world->wall_lines));
-                    o_world->wall_nexts       = realloc(o_world->wall_nexts, o_world->num_walls * sizeof(*o_world->wall_nexts));
-                    o_world->wall_is_skys     = realloc(o_world->wall_is_skys, o_world->num_walls * sizeof(*o_world->wall_is_skys));
-                    o_world->wall_texture_ids = realloc(o_world->wall_texture_ids, o_world->num_walls * sizeof(*o_world->wall_texture_ids));
-                }
-
-                num_read = sscanf(line, "%f %f %f %f %u %u %u",
-                                  &o_world->wall_lines[num_walls_read].points[0][0],
-                                  &o_world->wall_lines[num_walls_read].points[0][1],
-                                  &o_world->wall_lines[num_walls_read].points[1][0],
-                                  &o_world->wall_lines[num_walls_read].points[1][1],
-                                  &o_world->wall_nexts[num_walls_read],
-                                  &unsigned_buff0,
-                                  &o_world->wall_texture_ids[num_walls_read]);
-
-                if (num_read != 7) {
-                    printf("ERROR:%u: Ill-formed wall definition\n", wall_index);
-                    return false;
-                }
+extern uint16_t *g_depth_buffer;
 
-                o_world->wall_is_skys[num_walls_read] = unsigned_buff0 != 0;
+#define FLASHLIGHT_CUTOFF 0.98f
+#define FLASHLIGHT_OUTER_CUTOFF 0.9f
+#define AMBIENT 0.05f
+static float s_flashlight_power;
 
-                if (o_world->wall_nexts[num_walls_read] == 0) {
-                    o_world->wall_nexts[num_walls_read] = INVALID_SECTOR_INDEX;
-                } else {
-                    o_world->wall_nexts[num_walls_read] -= 1;
-                }
+extern Image g_image_array[3];
+extern Image g_sky_image_array[1];
 
-                o_world->wall_lines[num_walls_read].points[0][0] *= scale;
-                o_world->wall_lines[num_walls_read].points[0][1] *= scale;
-                o_world->wall_lines[num_walls_read].points[1][0] *= scale;
-                o_world->wall_lines[num_walls_read].points[1][1] *= scale;
+extern bool g_render_occlusion;
 
-                ++num_walls_read;
-                break;
-                ///////////////////////////////////////////////////////////////////////////////////////////////////
-            default:
-                assert(false && "Unhandled state!");
+// View space positions of the world's vertices, valid for the frame they were stamped in.
+// A vertex shared by several walls or both sides of a portal is transformed once per frame.
+static vec2 *s_view_vertices;
+static unsigned *s_view_stamps;
+static unsigned s_view_capacity;
+static unsigned s_view_frame;
+
+static bool beginViewCache(unsigned num_vertices) {
+    if (num_vertices > s_view_capacity) {
+        // fresh zeroed blocks rather than realloc, so the pages of vertices never seen stay untouched,
+        // which keeps the cache cheap for paged worlds where only a few regions are resident
+        vec2 *view_vertices   = malloc(num_vertices * sizeof(*view_vertices));
+        unsigned *view_stamps = calloc(num_vertices, sizeof(*view_stamps));
+        if (view_vertices == NULL || view_stamps == NULL) {
+            free(view_vertices);
+            free(view_stamps);
+            return false;
         }
-    }
 
-    fclose(file);
-
-    o_world->num_sectors = num_sectors_read;
-    o_world->num_walls   = num_walls_read;
-
-    // printf("PARSED\n");
-    // printf("VERSION: %u\n", version);
-    // printf("SECTORS: %u\n", o_world->num_sectors);
-    // for (unsigned i = 0; i < o_world->num_sectors; ++i) {
-    //     SectorDef sector = o_world->sectors[i];
-    //     printf("start: %u length: %u tiers: %u ", sector.start, sector.length, sector.num_tiers);
-    //     for (unsigned j = 0; j < sector.num_tiers; ++j) {
-    //         printf("floor height: %f ceiling height: %f ", sector.floor_heights[j], sector.ceiling_heights[j]);
-    //     }
-    //     printf("\n");
-    // }
-
-    // printf("WALLS: %u\n", o_world->num_walls);
-    // for (unsigned i = 0; i < o_world->num_walls; ++i) {
-    //     Line line = o_world->wall_lines[i];
-    //     printf("(%f, %f) (%f, %f) %u\n", line.points[0][0], line.points[0][1], line.points[1][0], line.points[1][1], o_world->wall_nexts[i]);
-    // }
+        free(s_view_vertices);
+        free(s_view_stamps);
+        s_view_vertices = view_vertices;
+        s_view_stamps   = view_stamps;
+        s_view_capacity = num_vertices;
+        s_view_frame    = 0;
+    }
 
+    if (++s_view_frame == 0) {
+        memset(s_view_stamps, 0, s_view_capacity * sizeof(*s_view_stamps));
+        s_view_frame = 1;
+    }
     return true;
 }
 
-void freeWorld(PortalWorld world) {
-    free(world.wall_lines);
-    free(world.wall_nexts);
-    free(world.wall_is_skys);
-    free(world.wall_texture_ids);
-
-    for (unsigned i = 0; i < world.num_sectors; ++i) {
-        free(world.sectors[i].floor_heights);
-        free(world.sectors[i].ceiling_heights);
-        free(world.sectors[i].is_skys);
-        free(world.sectors[i].floor_texture_ids);
-        free(world.sectors[i].ceiling_texture_ids);
+// the camera sector's visible set, decoded once per frame
+static uint8_t *s_visible_sectors;
+static unsigned s_visible_capacity;
+
+static const uint8_t *beginVisibleSectors(PortalWorld pod, unsigned sector_index) {
+    unsigned num_bytes = (pod.num_sectors + 7) / 8;
+    if (num_bytes > s_visible_capacity) {
+        uint8_t *visible = realloc(s_visible_sectors, num_bytes);
+        if (visible == NULL) return NULL;
+        s_visible_sectors  = visible;
+        s_visible_capacity = num_bytes;
     }
+    return getVisibleSectors(pod, sector_index, s_visible_sectors) ? s_visible_sectors : NULL;
 }
 
-unsigned getCurrentSector(PortalWorld pod, vec2 point, unsigned last_sector) {
-    if (last_sector < pod.num_sectors) {
-        // look at current sector
-        SectorDef current_sector = pod.sectors[last_sector];
-        Line *test_walls         = &pod.wall_lines[current_sector.start];
-        if (pointInPoly(test_walls, current_sector.length, point)) {
-            return last_sector;
-        }
-
-        // look at neighbors
-        for (unsigned i = 0; i < current_sector.length; ++i) {
-            unsigned wall_index = current_sector.start + i;
-            unsigned wall_next  = pod.wall_nexts[wall_index];
-            if (wall_next < pod.num_sectors) {
-                SectorDef next_sector = pod.sectors[wall_next];
-                Line *test_walls      = &pod.wall_lines[next_sector.start];
-
-                if (pointInPoly(test_walls, next_sector.length, point)) {
-                    return wall_next;
-                }
-            }
-        }
-    }
-
-    // linear lookup
-    for (unsigned s = 0; s < pod.num_sectors; ++s) {
-        SectorDef sector = pod.sectors[s];
-        Line *test_walls = &pod.wall_lines[sector.start];
-        if (pointInPoly(test_walls, sector.length, point)) {
-            return s;
-        }
+// the open span of each screen column, sized for the widest frame drawn so far
+static int *s_window_high;
+static int *s_window_low;
+static int s_window_capacity;
+
+static bool beginWindows(int width) {
+    if (width > s_window_capacity) {
+        int *window_high = realloc(s_window_high, width * sizeof(*window_high));
+        if (window_high == NULL) return false;
+        s_window_high = window_high;
+
+        int *window_low = realloc(s_window_low, width * sizeof(*window_low));
+        if (window_low == NULL) return false;
+        s_window_low      = window_low;
+        s_window_capacity = width;
     }
-
-    return INVALID_SECTOR_INDEX;
+    return true;
 }
 
-unsigned getSectorTier(PortalWorld pod, float z, unsigned sector_id) {
-    SectorDef sector = pod.sectors[sector_id];
-    for (unsigned i = 0; i < sector.num_tiers; ++i) {
-        float sector_world_floor   = sector.floor_heights[i];
-        float sector_world_ceiling = sector.ceiling_heights[i];
+static inline float *viewVertex(PortalWorld pod, Camera cam, unsigned vertex_index) {
+    float *view = s_view_vertices[vertex_index];
+    if (s_view_stamps[vertex_index] != s_view_frame) {
+        s_view_stamps[vertex_index] = s_view_frame;
 
-        if (z >= sector_world_floor && z <= sector_world_ceiling) return i;
+        // translate by negative cam_pos
+        float tx = pod.vertices[vertex_index][0] - cam.pos[0];
+        float ty = pod.vertices[vertex_index][1] - cam.pos[1];
+
+        // rotate by negative cam_rot
+        //  cos -sin
+        //  sin  cos
+        view[0] = cam.rot_cos * tx + cam.rot_sin * ty;
+        view[1] = -cam.rot_sin * tx + cam.rot_cos * ty;
     }
-    return INVALID_SECTOR_INDEX;
+    return view;
 }
 
-extern uint16_t *g_depth_buffer;
-
-#define FLASHLIGHT_CUTOFF 0.98f
-#define FLASHLIGHT_OUTER_CUTOFF 0.9f
-#define AMBIENT 0.05f
-static float s_flashlight_power;
-
-extern Image g_image_array[3];
-extern Image g_sky_image_array[1];
-
-extern bool g_render_occlusion;
-
 bool pixelProgram(WallAttribute attr, Camera cam, unsigned texid, int screen_x, int screen_y, Color *o_color) {
 
     float lighting = AMBIENT;
@@ -347,8 +145,9 @@ bool pixelProgram(WallAttribute attr, Camera cam, unsigned texid, int screen_x,
 
     {
         Image img = g_image_array[texid];
-        float u   = modff(attr.uv[0], NULL);
-        float v   = modff(attr.uv[1], NULL);
+        float whole;
+        float u = modff(attr.uv[0], &whole);
+        float v = modff(attr.uv[1], &whole);
         if (u < 0) u += 1;
         if (v < 0) v += 1;
 
@@ -367,13 +166,19 @@ bool skyPixelProgram(WallAttribute attr, Camera cam, unsigned texid, int screen_
 
     float sky_ar = (float)img.height / (img.width * SKY_SCALE);
 
-    float u = modff(screen_x / (float)SCREEN_WIDTH * sky_ar * ASPECT_RATIO + cam.rot / (2 * M_PI), NULL);
+    float whole;
+    float u = modff(screen_x / (float)SCREEN_WIDTH * sky_ar * ASPECT_RATIO + cam.rot / (2 * M_PI), &whole);
 
     // place base on horizon line
     float v = (screen_y / (float)SCREEN_HEIGHT + 1.0f - cam.pitch) / SKY_SCALE;
     // float v   = (screen_y / (float)SCREEN_HEIGHT + 1.0f - cam.pitch);
     if (u < 0) u += 1;
-    if (v < 0) return false;
+
+    // above the image is the black the screen clears to, drawn so the pixel still counts as covered
+    if (v < 0) {
+        *o_color = COLOR_BLACK;
+        return true;
+    }
 
     unsigned tex_x = (u * (img.width - 1));
     unsigned tex_y = (v * (img.height - 1));
@@ -491,9 +296,23 @@ bool clipTrapPortal(TrapezoidPortal base, TrapezoidPortal *test) {
 
 void renderPortalWorld(PortalWorld pod, Camera cam) {
 #define SECTOR_QUEUE_SIZE 128
+#define MAX_SECTOR_VISITS 4096
     const float TAN_FOV_HALF     = tanf(cam.fov * 0.5f);
     const float INV_TAN_FOV_HALF = 1.0f / TAN_FOV_HALF;
 
+    if (!beginViewCache(pod.num_vertices)) {
+        printf("ERROR: Out of memory for the vertex cache\n");
+        return;
+    }
+
+    if (!beginWindows(SCREEN_WIDTH)) {
+        printf("ERROR: Out of memory for %i screen columns\n", SCREEN_WIDTH);
+        return;
+    }
+
+    // NULL without baked sets, which draws whatever the portals let through
+    const uint8_t *visible = beginVisibleSectors(pod, cam.sector);
+
     // TODO: TEMP
     {
         s_flashlight_power = rand() % 100;
@@ -509,6 +328,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
     unsigned sector_queue_start = 0, sector_queue_end = 0;
     unsigned sector_queue[SECTOR_QUEUE_SIZE];
     unsigned tier_queue[SECTOR_QUEUE_SIZE];
+    unsigned entry_queue[SECTOR_QUEUE_SIZE]; // the wall each sector is seen through
 
     TrapezoidPortal portal_queue[SECTOR_QUEUE_SIZE] = {
         { .min_x = 0, .max_x = SCREEN_WIDTH, .low_y = { 0, 0 }, .high_y = { SCREEN_HEIGHT, SCREEN_HEIGHT } }
@@ -517,28 +337,34 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
     if (cam.sector < pod.num_sectors) {
         sector_queue[sector_queue_end] = cam.sector;
         tier_queue[sector_queue_end]   = cam.tier;
+        entry_queue[sector_queue_end]  = INVALID_WALL_INDEX;
     } else {
         sector_queue[sector_queue_end] = 0;
         tier_queue[sector_queue_end]   = 0;
+        entry_queue[sector_queue_end]  = INVALID_WALL_INDEX;
     }
 
     sector_queue_end = (sector_queue_end + 1) % SECTOR_QUEUE_SIZE;
 
-    int window_high[SCREEN_WIDTH];
-    int window_low[SCREEN_WIDTH];
+    int *const window_high = s_window_high;
+    int *const window_low  = s_window_low;
 
     // loop variables
-    Line view_tspace;
     Line view_space;
     Line ndc_space;
     WallAttribute attr[2];
     bool last_tier = true;
 
     // bredth first traversal of sectors
+    unsigned num_visits = 0;
     while (sector_queue_start != sector_queue_end) {
+        // a camera exactly on a corner of several portals can still see around them in circles
+        if (++num_visits > MAX_SECTOR_VISITS) break;
+
         // pop
         unsigned sector_index  = sector_queue[sector_queue_start];
         unsigned tier_index    = tier_queue[sector_queue_start];
+        unsigned entry_wall    = entry_queue[sector_queue_start];
         TrapezoidPortal portal = portal_queue[sector_queue_start];
 
         sector_queue_start = (sector_queue_start + 1) % SECTOR_QUEUE_SIZE;
@@ -553,6 +379,10 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
         float dist_to_floor   = (cam.pos[2] - sector_world_floor);
         float dist_to_ceiling = (sector_world_ceiling - cam.pos[2]);
 
+        // walls of a concave sector can hide each other, so they are drawn in any order with a
+        // depth test, convex sectors skip it as nothing they draw overlaps
+        bool depth_test = !sector.is_convex;
+
         // calculate occlusion buffer
         {
             for (int x = 0; x < portal.min_x; ++x) {
@@ -576,58 +406,56 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
             }
         }
 
+        // portals are listed in wall order, so they are matched up while walking the walls
+        const Portal *next_portal = &pod.portals[sector.first_portal];
+        const Portal *end_portal  = next_portal + sector.num_portals;
+
         // render every wall
         for (unsigned i = 0; i < sector.length; ++i) {
-            Line wall_line      = pod.wall_lines[sector.start + i];
-            unsigned wall_next  = pod.wall_nexts[sector.start + i];
-            bool wall_is_sky    = pod.wall_is_skys[sector.start + i];
-            unsigned wall_texid = pod.wall_texture_ids[sector.start + i];
+            unsigned *wall_verts   = &pod.wall_vertices[(sector.start + i) * 2];
+            unsigned wall_next     = pod.wall_nexts[sector.start + i];
+            bool wall_is_sky       = pod.wall_is_skys[sector.start + i];
+            unsigned wall_texid    = pod.wall_texture_ids[sector.start + i];
+            WallGeometry wall_geom = pod.wall_geometry[sector.start + i];
 
-            bool is_portal = wall_next != INVALID_SECTOR_INDEX && wall_next != sector_index;
+            bool is_portal       = next_portal != end_portal && next_portal->wall == sector.start + i;
+            unsigned portal_twin = is_portal ? next_portal->twin : INVALID_WALL_INDEX;
+            if (is_portal) ++next_portal;
 
-            // Back face culling
-            {
-                float cross_val = cross2d(
-                    VEC2(wall_line.points[0][0] - wall_line.points[1][0], wall_line.points[0][1] - wall_line.points[1][1]),
-                    VEC2(wall_line.points[0][0] - cam.pos[0], wall_line.points[0][1] - cam.pos[1]));
+            // the wall this sector is seen through is normally culled as a back face, but a camera
+            // exactly on it would look back and forth through it forever
+            if (sector.start + i == entry_wall) continue;
 
-                if (cross_val < 0.0) {
-                    continue; // this wall cannot be seen
-                }
-            }
+            // no sight line from the camera's sector crosses a portal into a sector outside its set,
+            // so neither the portal nor the steps above and below it can show
+            if (is_portal && visible != NULL && !((visible[wall_next >> 3] >> (wall_next & 7)) & 1)) continue;
 
-            float length;
-            {
-                vec2 diff = { wall_line.points[0][0] - wall_line.points[1][0], wall_line.points[0][1] - wall_line.points[1][1] };
-                length    = sqrtf(dot2d(diff, diff));
+            // a neighbor that is not resident, as in a paged world, is drawn as a closed wall
+            if (is_portal && pod.sectors[wall_next].num_tiers == 0) is_portal = false;
+
+            // Back face culling
+            if (dot2d(wall_geom.normal, cam.pos) < wall_geom.plane) {
+                continue; // this wall cannot be seen
             }
 
             attr[0].uv[0] = 0.0f;
-            attr[1].uv[0] = length;
+            attr[1].uv[0] = wall_geom.length;
 
             attr[0].uv[1] = 0.0f;
             attr[1].uv[1] = sector_world_ceiling - sector_world_floor;
 
-            attr[0].world_pos[0] = wall_line.points[0][0];
-            attr[1].world_pos[0] = wall_line.points[1][0];
-            attr[0].world_pos[1] = wall_line.points[0][1];
-            attr[1].world_pos[1] = wall_line.points[1][1];
+            attr[0].world_pos[0] = pod.vertices[wall_verts[0]][0];
+            attr[1].world_pos[0] = pod.vertices[wall_verts[1]][0];
+            attr[0].world_pos[1] = pod.vertices[wall_verts[0]][1];
+            attr[1].world_pos[1] = pod.vertices[wall_verts[1]][1];
             attr[0].world_pos[2] = sector_world_floor;
             attr[1].world_pos[2] = sector_world_ceiling;
 
             // convert to view space
-            {
-                for (unsigned pi = 0; pi < 2; ++pi) {
-                    // translate by negative cam_pos
-                    view_tspace.points[pi][0] = wall_line.points[pi][0] - cam.pos[0];
-                    view_tspace.points[pi][1] = wall_line.points[pi][1] - cam.pos[1];
-
-                    // rotate by negative cam_rot
-                    //  cos -sin
-                    //  sin  cos
-                    view_space.points[pi][0] = cam.rot_cos * view_tspace.points[pi][0] + cam.rot_sin * view_tspace.points[pi][1];
-                    view_space.points[pi][1] = -cam.rot_sin * view_tspace.points[pi][0] + cam.rot_cos * view_tspace.points[pi][1];
-                }
+            for (unsigned pi = 0; pi < 2; ++pi) {
+                float *view              = viewVertex(pod, cam, wall_verts[pi]);
+                view_space.points[pi][0] = view[0];
+                view_space.points[pi][1] = view[1];
             }
 
             // Clip
@@ -679,19 +507,6 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
             start_x = clamp(start_x, 0, SCREEN_WIDTH - 1);
             end_x   = clamp(end_x, 0, SCREEN_WIDTH - 1);
 
-            vec2 wall_norm = { 0.0f, 0.0f };
-            {
-                vec2 d    = { wall_line.points[1][0] - wall_line.points[0][0], wall_line.points[1][1] - wall_line.points[0][1] };
-                float len = dot2d(d, d);
-                if (len != 0) {
-                    len = sqrtf(len);
-                    d[0] /= len;
-                    d[1] /= len;
-                    wall_norm[0] = -d[1];
-                    wall_norm[1] = d[0];
-                }
-            }
-
 
 #ifndef CURRENT_SECTOR_ONLY
 // BUG: Wall gets clipped prior to this, so when close to a portal, the next sector will not be rendered
@@ -730,6 +545,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                         if (clipTrapPortal(portal, &tmp_portal)) {
                             sector_queue[sector_queue_end] = wall_next;
                             tier_queue[sector_queue_end]   = start_tier;
+                            entry_queue[sector_queue_end]  = portal_twin;
                             portal_queue[sector_queue_end] = tmp_portal;
 
                             sector_queue_end = (sector_queue_end + 1) % 128;
@@ -765,6 +581,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                             if (clipTrapPortal(portal, &tmp_portal)) {
                                 sector_queue[sector_queue_end] = wall_next;
                                 tier_queue[sector_queue_end]   = i;
+                                entry_queue[sector_queue_end]  = portal_twin;
                                 portal_queue[sector_queue_end] = tmp_portal;
 
                                 sector_queue_end = (sector_queue_end + 1) % 128;
@@ -799,6 +616,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                             if (clipTrapPortal(portal, &tmp_portal)) {
                                 sector_queue[sector_queue_end] = wall_next;
                                 tier_queue[sector_queue_end]   = i;
+                                entry_queue[sector_queue_end]  = portal_twin;
                                 portal_queue[sector_queue_end] = tmp_portal;
 
                                 sector_queue_end = (sector_queue_end + 1) % 128;
@@ -830,6 +648,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                             y >= window_high[x]) continue;
 
                         int depth_index             = x + y * SCREEN_WIDTH;
+                        if (depth_test && depth > g_depth_buffer[depth_index]) continue;
                         g_depth_buffer[depth_index] = depth;
 
                         if (!g_render_occlusion) {
@@ -885,6 +704,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                             y >= window_high[x]) continue;
 
                         int depth_index             = x + y * SCREEN_WIDTH;
+                        if (depth_test && depth > g_depth_buffer[depth_index]) continue;
                         g_depth_buffer[depth_index] = depth;
 
                         if (!g_render_occlusion) {
@@ -945,6 +765,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                     for (int y = start_y; y < end_y; ++y) {
                         int depth_index = x + y * SCREEN_WIDTH;
 
+                        if (depth_test && depth > g_depth_buffer[depth_index]) continue;
                         g_depth_buffer[depth_index] = depth;
 
                         if (!g_render_occlusion) {
@@ -957,7 +778,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                             WallAttribute attr = {
                                 .uv        = { u, v },
                                 .world_pos = { world_pos[0], world_pos[1], world_pos[2] },
-                                .normal    = { wall_norm[0], wall_norm[1], 0.0f },
+                                .normal    = { wall_geom.normal[0], wall_geom.normal[1], 0.0f },
                             };
                             Color color;
 
@@ -1054,6 +875,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                         for (int y = start_y; y < start_ny; ++y) {
                             int depth_index = x + y * SCREEN_WIDTH;
 
+                            if (depth_test && depth > g_depth_buffer[depth_index]) continue;
                             g_depth_buffer[depth_index] = depth;
 
                             if (!g_render_occlusion) {
@@ -1065,7 +887,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                                 WallAttribute attr = {
                                     .uv        = { u, v },
                                     .world_pos = { world_pos[0], world_pos[1], world_pos[2] },
-                                    .normal    = { wall_norm[0], wall_norm[1], 0.0f },
+                                    .normal    = { wall_geom.normal[0], wall_geom.normal[1], 0.0f },
                                 };
                                 Color color;
 
@@ -1086,6 +908,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                         for (int y = end_ny; y < end_y; ++y) {
                             int depth_index = x + y * SCREEN_WIDTH;
 
+                            if (depth_test && depth > g_depth_buffer[depth_index]) continue;
                             g_depth_buffer[depth_index] = depth;
                             if (!g_render_occlusion) {
                                 float ty     = (float)(y - start_y_real) / (end_y_real - start_y_real);
@@ -1096,7 +919,7 @@ void renderPortalWorld(PortalWorld pod, Camera cam) {
                                 WallAttribute attr = {
                                     .uv        = { u, v },
                                     .world_pos = { world_pos[0], world_pos[1], world_pos[2] },
-                                    .normal    = { wall_norm[0], wall_norm[1], 0.0f },
+                                    .normal    = { wall_geom.normal[0], wall_geom.normal[1], 0.0f },
                                 };
                                 Color color;
 
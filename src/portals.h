@@ -3,7 +3,15 @@
 #include "geo.h"
 #include "util.h"
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define INVALID_SECTOR_INDEX (~0)
+#define INVALID_WALL_INDEX (~0)
+#define INVALID_REGION_INDEX (~0)
+
+#define WORLD_BINARY_MAGIC "LWMB"
+#define WORLD_PAGED_MAGIC "LWMP"
 
 typedef struct Camera {
     float fov;
@@ -22,23 +30,269 @@ typedef struct SectorDef {
     float *floor_heights, *ceiling_heights; // first is world space, next are relative to last ceiling
     bool *is_skys;
     unsigned *floor_texture_ids, *ceiling_texture_ids;
+    unsigned first_portal, num_portals; // range of the world's portals
+    bool is_convex; // a closed loop of left turns, so no wall hides another from inside
 } SectorDef;
 
+// a wall leading into another sector, built at load
+typedef struct Portal {
+    unsigned wall;
+    unsigned sector; // the sector on the other side
+    unsigned twin;   // the neighbor's wall back across the same edge, or INVALID_WALL_INDEX
+} Portal;
+
+// a wall end meeting at a vertex, built at load so moving the vertex finds its walls
+typedef struct VertexWall {
+    unsigned wall_end; // wall * 2 for its start, wall * 2 + 1 for its end
+    unsigned sector;   // the wall's sector, or INVALID_SECTOR_INDEX for a wall outside every sector
+} VertexWall;
+
+// derived from a wall's line at load, kept up to date by moveVertex and setWallLine
+typedef struct WallGeometry {
+    vec2 dir;    // unit direction from points[0] to points[1]
+    vec2 normal; // unit left normal, pointing into the sector
+    float length, inv_length;
+    float plane; // dot(normal, points[0]), the wall faces points where dot(normal, p) >= plane
+    float pad;   // two walls per cache line
+} WallGeometry;
+
+// Uniform grid over sector bounds, built at load to locate points without a starting sector.
+// Cells are about the size of an average sector and list every sector whose bounds overlap them.
+typedef struct SectorGrid {
+    vec2 origin;
+    float cell_size;
+    unsigned width, height;
+    unsigned num_entries;
+    unsigned capacity;      // entries cell_sectors has room for, so moved sectors can be bucketed again
+    unsigned *cell_starts;  // width * height + 1 offsets into cell_sectors
+    unsigned *cell_sectors; // in sector order within each cell
+    bool stale;             // a vertex of a paged world moved cell, lookups scan every sector until the next load
+} SectorGrid;
+
+// Potentially visible sets baked by mapc, one run length encoded bitset of sectors per sector.
+// A sector that is not in the camera sector's set is never drawn.
+typedef struct SectorVisibility {
+    unsigned *offsets; // num_sectors + 1 offsets into data, NULL when the world has no sets
+    uint8_t *data;
+    unsigned size;
+    bool stale; // walls moved since baking, nothing is rejected until the next load
+} SectorVisibility;
+
+typedef enum RayHitType {
+    RAY_HIT_NONE,
+    RAY_HIT_WALL, // includes the parts of a portal above or below the neighbor's tiers
+    RAY_HIT_FLOOR,
+    RAY_HIT_CEILING,
+    RAY_HIT_OUTSIDE, // the ray started outside every sector or tier
+} RayHitType;
+
+typedef struct RayHit {
+    RayHitType type;
+    unsigned sector, tier;
+    unsigned wall; // INVALID_WALL_INDEX unless a wall was hit
+    float distance;
+    vec3 point;
+} RayHit;
+
+// a pair of points for checkLinesOfSight, the sectors start as hints and are replaced by the ones found
+typedef struct SightQuery {
+    vec3 from, to;
+    unsigned from_sector, to_sector;
+} SightQuery;
+
+typedef struct SightKey {
+    unsigned from_sector, to_sector;
+    int cells[6]; // from and to, divided into cells of cell_size
+} SightKey;
+
+typedef struct SightEntry {
+    SightKey key;
+    unsigned generation; // empty unless it matches the cache's
+    bool visible;
+} SightEntry;
+
+// Line of sight results kept across frames, keyed by the sector pair and the cells both points are in.
+// Points sharing cells share an answer. The cache empties itself when the world it is used with is
+// edited or replaced.
+typedef struct SightCache {
+    SightEntry *entries;
+    unsigned capacity; // a power of two, each key has one slot
+    unsigned generation;
+    float inv_cell_size;
+    unsigned world_generation; // the world the entries came from, and how many edits it had then
+    unsigned edits;
+    unsigned hits, misses;
+} SightCache;
+
+// Called for each sector visitSectors reaches, with the portals crossed to get there and a lower bound on
+// the distance walked. Returning false keeps the traversal from going on through the sector.
+typedef bool (*SectorVisitFunc)(unsigned sector_index, unsigned hops, float distance, void *user_data);
+
+typedef struct VisitLimits {
+    float max_distance; // from the origin, measured to the portals crossed
+    unsigned max_hops;
+    unsigned max_sectors;
+} VisitLimits;
+
+// Memory for visitSectors, kept between calls so traversals allocate nothing. One per thread.
+typedef struct SectorVisitor {
+    unsigned *stamps; // the epoch each sector was last reached in
+    unsigned *queue;
+    unsigned *hops;
+    float *distances;
+    unsigned capacity;
+    unsigned epoch;
+} SectorVisitor;
+
+// an upright cylinder moved by moveBody, standing on pos
+typedef struct CollisionBody {
+    vec3 pos;
+    float radius, height;
+    float step_height; // the highest ledge it walks up onto
+    unsigned sector, tier;
+} CollisionBody;
+
+// bytes by category, whether allocated or inside a mapped binary world
+typedef struct WorldMemory {
+    size_t sectors, tiers, walls;
+    size_t derived;   // computed at load, never stored in files
+    size_t visibility;
+    size_t allocated; // the world's arena, including alignment
+    size_t mapped;    // size of the mapped binary world, if any
+} WorldMemory;
+
 typedef struct PortalWorld {
     Line *wall_lines;
     unsigned *wall_nexts;
     bool *wall_is_skys;
     unsigned *wall_texture_ids;
+    WallGeometry *wall_geometry;
+    unsigned *wall_vertices; // two per wall, indices into vertices
+
+    vec2 *vertices; // wall endpoints welded at load, shared by every wall meeting there
+    unsigned *vertex_wall_starts; // num_vertices + 1 offsets into vertex_walls, NULL in paged worlds
+    VertexWall *vertex_walls;
+    Portal *portals;
+    SectorGrid sector_grid;
+    SectorVisibility visibility;
 
     SectorDef *sectors;
 
     unsigned num_walls;
     unsigned num_sectors;
+    unsigned num_vertices;
+    unsigned num_portals;
+
+    void *mapping; // set when walls and tiers point into a mapped binary world
+    size_t mapping_size;
+
+    void *arena; // one allocation owning everything else, freed as a whole
+    WorldMemory memory;
+
+    unsigned generation; // unique to each loaded or copied world, as its arrays' addresses may not be
+    unsigned edits;      // counts changes to geometry and heights, for caches of things derived from them
+    unsigned wall_edits; // counts changes to the walls alone, for caches that do not care about heights
 } PortalWorld;
 
+// a grid cell's worth of sectors in a paged world, along with the ranges of everything they own
+typedef struct WorldRegion {
+    unsigned first_sector, num_sectors;
+    unsigned first_wall, num_walls;
+    unsigned first_tier, num_tiers;
+    unsigned first_vertex, num_vertices; // the vertices this region's walls use first
+    unsigned first_portal, num_portals;
+    unsigned first_neighbor, num_neighbors; // range of region_neighbors, regions its portals lead into
+} WorldRegion;
+
+// The regions of a paged world, which is a PortalWorld whose sectors are only filled in while
+// their region is active. Sectors of inactive regions have no tiers and must not be entered.
+typedef struct PagedWorld {
+    WorldRegion *regions;
+    unsigned *region_neighbors;
+    unsigned *grid; // region of each grid cell, or INVALID_REGION_INDEX
+    unsigned num_regions;
+    unsigned grid_width, grid_height;
+    vec2 grid_origin;
+    float region_size;
+
+    void *records; // sector records activation fills the sector table from
+    float *floor_heights, *ceiling_heights;
+    bool *is_skys;
+    unsigned *floor_texture_ids, *ceiling_texture_ids;
+} PagedWorld;
+
+// picks the text or binary loader from the file contents
 bool loadWorld(const char *path, PortalWorld *o_world, float scale);
+bool loadWorldText(const char *path, PortalWorld *o_world, float scale);
+bool loadWorldBinary(const char *path, PortalWorld *o_world, float scale);
+bool saveWorldBinary(const char *path, PortalWorld world, float scale);
 void freeWorld(PortalWorld world);
+WorldMemory getWorldMemory(PortalWorld world);
+bool isWorldPaged(const char *path);
+void moveVertex(PortalWorld *world, unsigned vertex_index, vec2 pos);
+void setWallLine(PortalWorld *world, unsigned wall_index, Line line);
+void setSectorHeights(PortalWorld *world, unsigned sector_index, unsigned tier, float floor, float ceiling);
+bool copyWorld(PortalWorld world, PortalWorld *o_world);
+
+// Prints every problem found with the world's geometry and returns the number of errors.
+// Warnings are printed but not counted.
+unsigned validateWorld(PortalWorld world);
+// Splits concave sectors into convex pieces joined by portals. A sector's first piece keeps its
+// index, the other pieces are added after the existing sectors with copies of its tiers.
+bool splitConcaveSectors(PortalWorld world, PortalWorld *o_world, unsigned *o_num_split);
+
+// Bakes which sectors each sector may see into a copy of the world, on one thread per CPU when
+// num_threads is 0. Sectors with too many sight lines to follow are saturated and see everything.
+bool bakeVisibility(PortalWorld world, PortalWorld *o_world, unsigned num_threads, unsigned *o_num_saturated);
+// fills (num_sectors + 7) / 8 bytes, false when the world has no usable sets
+bool getVisibleSectors(PortalWorld world, unsigned sector_index, uint8_t *o_bits);
+// true without usable sets
+bool isSectorVisible(PortalWorld world, unsigned from_sector, unsigned to_sector);
+
+// sector level diffing between loads of the same map
+bool sameWorldLayout(PortalWorld a, PortalWorld b);
+bool sectorChanged(PortalWorld a, PortalWorld b, unsigned sector_index);
+void copySector(PortalWorld *o_world, PortalWorld world, unsigned sector_index);
+
+// paged worlds start with every region inactive, freeWorld closes them
+bool saveWorldPaged(const char *path, PortalWorld world, float scale, float region_size);
+bool loadWorldPaged(const char *path, PortalWorld *o_world, PagedWorld *o_paged, float scale);
+// the pages only this region keeps resident, which releasing it hands back
+size_t getRegionSize(PortalWorld world, PagedWorld paged, unsigned region_index);
+void prefetchRegion(PortalWorld world, PagedWorld paged, unsigned region_index);
+bool activateRegion(PortalWorld *world, PagedWorld paged, unsigned region_index);
+void releaseRegion(PortalWorld *world, PagedWorld paged, unsigned region_index);
+unsigned getSectorRegion(PagedWorld paged, unsigned sector_index);
+unsigned findRegion(PagedWorld paged, vec2 point);
 
 unsigned getCurrentSector(PortalWorld pod, vec2 point, unsigned last_sector);
+// the lowest numbered sector holding the point, for things that have no idea where they are
+unsigned findSector(PortalWorld pod, vec2 point);
 unsigned getSectorTier(PortalWorld pod, float z, unsigned sector_id);
+// Locates many things in one call. Each sector starts as the thing's last known sector, or
+// INVALID_SECTOR_INDEX, and is replaced by the one found. Tiers are optional and follow getSectorTier.
+void locateSectors(PortalWorld pod, const vec3 *positions, unsigned count, unsigned *io_sectors, unsigned *o_tiers);
+// Walks a ray through the portals from the sector holding the origin, so the cost follows the
+// sectors crossed. Returns whether anything was hit within max_distance of the origin.
+bool castRay(PortalWorld pod, vec3 origin, vec3 dir, float max_distance, unsigned sector_hint, RayHit *o_hit);
+// whether nothing stands between the points, following portals through the tiers at each crossing
+bool hasLineOfSight(PortalWorld pod, vec3 from, vec3 to, unsigned sector_hint);
+bool createSightCache(SightCache *o_cache, unsigned capacity, float cell_size);
+void freeSightCache(SightCache cache);
+void clearSightCache(SightCache *cache);
+// Answers many line of sight queries, from the cache when it has them. Pairs the baked visible sets
+// rule out are never cast. The cache is optional.
+void checkLinesOfSight(PortalWorld pod, SightCache *cache, SightQuery *queries, unsigned count, bool *o_visible);
+// Sweeps the body by delta, sliding along walls and following portals into the sectors it fits in,
+// stepping up onto floors at most step_height above its feet. Returns whether anything blocked it.
+bool moveBody(PortalWorld pod, CollisionBody *body, vec2 delta);
+void moveBodies(PortalWorld pod, CollisionBody *bodies, const vec2 *deltas, unsigned count);
+// the tier a body fits in with its feet at z, or INVALID_SECTOR_INDEX
+unsigned getBodyTier(PortalWorld pod, unsigned sector_index, float z, float height, float step_height);
+bool createSectorVisitor(SectorVisitor *o_visitor, unsigned num_sectors);
+void freeSectorVisitor(SectorVisitor visitor);
+// Visits the sectors reachable through portals from start_sector, nearest in hops first, within the
+// limits. Sectors that are not resident are never entered. Returns the number visited.
+unsigned visitSectors(PortalWorld pod, SectorVisitor *visitor, unsigned start_sector, vec2 origin, VisitLimits limits,
+                      SectorVisitFunc func, void *user_data);
 void renderPortalWorld(PortalWorld pod, Camera cam);
\ No newline at end of file
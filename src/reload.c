@@ -0,0 +1,219 @@
+#include "reload.h"
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+
+#define RELOAD_POLL_MS 250
+
+typedef struct FileStamp {
+    time_t mtime;
+    off_t size;
+} FileStamp;
+
+// The worker keeps its own copy of the world as it is on disk (base). A reload is diffed against
+// base, not the live world, so only sectors edited in the file are touched. While ready is set the
+// thread applying reloads owns next, adopt and changed, otherwise the worker does. Ready is only
+// written under the lock, but can be read without it to check for a reload without waiting.
+struct WorldReloader {
+    char *path;
+    float scale;
+
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *wake;
+    bool quit;
+    bool requested;
+    SDL_atomic_t ready;
+
+    FileStamp stamp;
+    PortalWorld base;
+
+    PortalWorld next;  // the file's contents, becomes base once applied
+    PortalWorld adopt; // copy of next that replaces the live world when the layout changed
+    bool replace;
+    unsigned *changed;
+    unsigned num_changed;
+};
+
+static bool readFileStamp(const char *path, FileStamp *o_stamp) {
+    struct stat st;
+    if (stat(path, &st) != 0) return false;
+    o_stamp->mtime = st.st_mtime;
+    o_stamp->size  = st.st_size;
+    return true;
+}
+
+// runs without the lock, fills next and either adopt or changed
+static bool prepareReload(WorldReloader *reloader, bool forced) {
+    PortalWorld next;
+    if (!loadWorld(reloader->path, &next, reloader->scale)) {
+        printf("Failed to reload world\n");
+        return false;
+    }
+
+    // a forced reload also throws away runtime edits, which is cheapest as a whole new world
+    reloader->replace     = forced || !sameWorldLayout(reloader->base, next);
+    reloader->num_changed = 0;
+
+    if (reloader->replace) {
+        if (!copyWorld(next, &reloader->adopt)) {
+            freeWorld(next);
+            return false;
+        }
+    } else {
+        unsigned *changed = realloc(reloader->changed, max(next.num_sectors, 1) * sizeof(*changed));
+        if (changed == NULL) {
+            printf("ERROR: Out of memory reloading %s\n", reloader->path);
+            freeWorld(next);
+            return false;
+        }
+        reloader->changed = changed;
+
+        for (unsigned i = 0; i < next.num_sectors; ++i) {
+            if (sectorChanged(reloader->base, next, i)) changed[reloader->num_changed++] = i;
+        }
+
+        if (reloader->num_changed == 0) {
+            freeWorld(next);
+            return false;
+        }
+    }
+
+    reloader->next = next;
+    return true;
+}
+
+static int reloadThread(void *data) {
+    WorldReloader *reloader = data;
+
+    SDL_LockMutex(reloader->lock);
+    while (!reloader->quit) {
+        SDL_CondWaitTimeout(reloader->wake, reloader->lock, RELOAD_POLL_MS);
+        if (reloader->quit) break;
+        if (SDL_AtomicGet(&reloader->ready)) continue; // the last reload has not been applied yet
+
+        FileStamp stamp;
+        bool modified = readFileStamp(reloader->path, &stamp) &&
+                        (stamp.mtime != reloader->stamp.mtime || stamp.size != reloader->stamp.size);
+        bool forced   = reloader->requested;
+        if (!modified && !forced) continue;
+
+        // a half written file fails to parse and is retried on the next save
+        if (modified) reloader->stamp = stamp;
+        reloader->requested = false;
+
+        SDL_UnlockMutex(reloader->lock);
+        bool ready = prepareReload(reloader, forced);
+        SDL_LockMutex(reloader->lock);
+
+        SDL_AtomicSet(&reloader->ready, ready);
+    }
+    SDL_UnlockMutex(reloader->lock);
+
+    return 0;
+}
+
+WorldReloader *startWorldReloader(const char *path, PortalWorld world, float scale) {
+    assert(path != NULL);
+
+    WorldReloader *reloader = calloc(1, sizeof(*reloader));
+    if (reloader == NULL) return NULL;
+
+    size_t path_size = strlen(path) + 1;
+    reloader->path   = malloc(path_size);
+    reloader->scale  = scale;
+    reloader->lock   = SDL_CreateMutex();
+    reloader->wake   = SDL_CreateCond();
+
+    if (reloader->path == NULL || reloader->lock == NULL || reloader->wake == NULL || !copyWorld(world, &reloader->base)) {
+        printf("ERROR: Failed to start reloading %s\n", path);
+        free(reloader->path);
+        if (reloader->lock != NULL) SDL_DestroyMutex(reloader->lock);
+        if (reloader->wake != NULL) SDL_DestroyCond(reloader->wake);
+        free(reloader);
+        return NULL;
+    }
+
+    memcpy(reloader->path, path, path_size);
+    readFileStamp(path, &reloader->stamp);
+
+    reloader->thread = SDL_CreateThread(reloadThread, "world reload", reloader);
+    if (reloader->thread == NULL) {
+        printf("ERROR: Failed to create reload thread: %s\n", SDL_GetError());
+        freeWorld(reloader->base);
+        free(reloader->path);
+        SDL_DestroyMutex(reloader->lock);
+        SDL_DestroyCond(reloader->wake);
+        free(reloader);
+        return NULL;
+    }
+
+    return reloader;
+}
+
+void stopWorldReloader(WorldReloader *reloader) {
+    if (reloader == NULL) return;
+
+    SDL_LockMutex(reloader->lock);
+    reloader->quit = true;
+    SDL_CondSignal(reloader->wake);
+    SDL_UnlockMutex(reloader->lock);
+    SDL_WaitThread(reloader->thread, NULL);
+
+    if (SDL_AtomicGet(&reloader->ready)) {
+        freeWorld(reloader->next);
+        if (reloader->replace) freeWorld(reloader->adopt);
+    }
+    freeWorld(reloader->base);
+
+    free(reloader->changed);
+    free(reloader->path);
+    SDL_DestroyMutex(reloader->lock);
+    SDL_DestroyCond(reloader->wake);
+    free(reloader);
+}
+
+void requestWorldReload(WorldReloader *reloader) {
+    SDL_LockMutex(reloader->lock);
+    reloader->requested = true;
+    SDL_CondSignal(reloader->wake);
+    SDL_UnlockMutex(reloader->lock);
+}
+
+bool isWorldReloadReady(WorldReloader *reloader) {
+    return SDL_AtomicGet(&reloader->ready);
+}
+
+bool applyWorldReload(WorldReloader *reloader, PortalWorld *world) {
+    assert(world != NULL);
+
+    // never wait on the worker, a reload that is still being published is picked up next frame
+    if (SDL_TryLockMutex(reloader->lock) != 0) return false;
+    if (!SDL_AtomicGet(&reloader->ready)) {
+        SDL_UnlockMutex(reloader->lock);
+        return false;
+    }
+
+    if (reloader->replace) {
+        freeWorld(*world);
+        *world = reloader->adopt;
+        printf("Reloaded world\n");
+    } else {
+        for (unsigned i = 0; i < reloader->num_changed; ++i) {
+            copySector(world, reloader->next, reloader->changed[i]);
+        }
+        printf("Reloaded %u changed sectors\n", reloader->num_changed);
+    }
+
+    freeWorld(reloader->base);
+    reloader->base = reloader->next;
+    SDL_AtomicSet(&reloader->ready, false);
+    SDL_UnlockMutex(reloader->lock);
+
+    return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "portals.h"
+
+// Watches a map file and reloads it on a worker thread. Only sectors that changed in the file are
+// copied into the live world, so runtime edits to the other sectors survive a reload.
+typedef struct WorldReloader WorldReloader;
+
+// world is the live world as loaded from path
+WorldReloader *startWorldReloader(const char *path, PortalWorld world, float scale);
+void stopWorldReloader(WorldReloader *reloader);
+
+// reloads even if the file has not changed
+void requestWorldReload(WorldReloader *reloader);
+
+// whether applyWorldReload has a reload to apply, without waiting on anything
+bool isWorldReloadReady(WorldReloader *reloader);
+// call between frames, true if the world was changed
+bool applyWorldReload(WorldReloader *reloader, PortalWorld *world);
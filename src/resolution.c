@@ -0,0 +1,65 @@
+#include "resolution.h"
+#include "draw.h"
+#include "util.h"
+
+#include <math.h>
+#include <string.h>
+#include <assert.h>
+
+#define RESOLUTION_MIN_SCALE 0.25f
+#define RESOLUTION_SMOOTHING 0.1f
+// a hitch counts as at most this many average frames, a scene that really got slower still gets through in a few
+#define RESOLUTION_MAX_SPIKE 2.0f
+#define RESOLUTION_SETTLE_FRAMES 8
+// frames are given some room below the budget before growing, or the size would hover around it
+#define RESOLUTION_HEADROOM 0.85f
+// widths are kept to multiples of this, so small changes in frame time leave the size alone
+#define RESOLUTION_STEP 8
+
+void initResolutionController(ResolutionController *o_controller, int full_width, int full_height, float budget_ms) {
+    assert(o_controller != NULL);
+    memset(o_controller, 0, sizeof(*o_controller));
+
+    o_controller->full_width  = full_width;
+    o_controller->full_height = full_height;
+    o_controller->budget_ms   = budget_ms;
+    o_controller->min_scale   = max(RESOLUTION_MIN_SCALE, (float)MIN_SCREEN_SIZE / min(full_width, full_height));
+    o_controller->scale       = 1.0f;
+    o_controller->width       = full_width;
+    o_controller->height      = full_height;
+}
+
+bool updateResolution(ResolutionController *controller, float frame_ms) {
+    if (controller->average_ms <= 0.0f) {
+        controller->average_ms = frame_ms;
+    } else {
+        frame_ms = min(frame_ms, controller->average_ms * RESOLUTION_MAX_SPIKE);
+        controller->average_ms += (frame_ms - controller->average_ms) * RESOLUTION_SMOOTHING;
+    }
+
+    if (controller->settle > 0) {
+        controller->settle -= 1;
+        return false;
+    }
+
+    float ratio = controller->budget_ms / max(controller->average_ms, 0.001f);
+    if (ratio >= 1.0f && ratio < 1.0f / RESOLUTION_HEADROOM) return false;
+
+    // the scale is per side, the cost goes with the area; growing is held back more than shrinking
+    float scale = controller->scale * sqrtf(ratio >= 1.0f ? ratio * RESOLUTION_HEADROOM : ratio);
+    scale       = clamp(scale, controller->min_scale, 1.0f);
+
+    int width  = (int)(controller->full_width * scale / RESOLUTION_STEP + 0.5f) * RESOLUTION_STEP;
+    width      = clamp(width, MIN_SCREEN_SIZE, controller->full_width);
+    int height = (int)((float)controller->full_height * width / controller->full_width + 0.5f);
+    height     = clamp(height, MIN_SCREEN_SIZE, controller->full_height);
+    if (width == controller->width && height == controller->height) return false;
+
+    // what the last frames would have taken at the new size
+    controller->average_ms *= (float)width * height / ((float)controller->width * controller->height);
+    controller->scale  = scale;
+    controller->width  = width;
+    controller->height = height;
+    controller->settle = RESOLUTION_SETTLE_FRAMES;
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Picks the size the next frame is drawn at so that drawing holds a time budget, from the full
+// size down to min_scale of it. Drawing costs about the same per pixel, so the area follows the
+// ratio of budget to frame time. Frame times are smoothed and the size settles for a few frames
+// after each change, so a single slow frame or a new size's first frames do not make it swing.
+typedef struct ResolutionController {
+    int full_width, full_height;
+    float budget_ms;
+    float min_scale;
+
+    float scale;
+    float average_ms; // smoothed, as if drawn at the current size
+    int width, height;
+    unsigned settle;
+} ResolutionController;
+
+void initResolutionController(ResolutionController *o_controller, int full_width, int full_height, float budget_ms);
+// reports how long the last frame took to draw, returns true when the size for the next one changed
+bool updateResolution(ResolutionController *controller, float frame_ms);
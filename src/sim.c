@@ -0,0 +1,329 @@
+#include "sim.h"
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <math.h>
+#include <malloc.h>
+#include <assert.h>
+
+#define PLAYER_RADIUS 1.0f
+#define PLAYER_HEIGHT 1.8f
+#define PLAYER_EYE_HEIGHT 1.65f
+#define PLAYER_STEP_HEIGHT 0.6f
+
+// ticks run late beyond this many are dropped instead of caught up, after a stall or a breakpoint
+#define SIM_MAX_CATCH_UP 5
+
+// distinct tiers edited between two frames, further edits wait for a tick after the frame
+#define SIM_MAX_HEIGHT_EDITS 16
+
+typedef struct HeightEdit {
+    unsigned sector, tier;
+    float floor, ceiling;
+} HeightEdit;
+
+// The state lock guards the input, the last two cameras, quit and the drawing and writing flags,
+// and is only ever held briefly. The world is never written while a frame is drawn from it. The
+// simulation holds its writes back until the frame is done instead of waiting for it, and the next
+// frame lets them in before it starts, so they land between two frames.
+struct Simulation {
+    SDL_Thread *thread;
+    SDL_mutex *state_lock;
+    SDL_cond *wake;
+    SDL_cond *frame_boundary; // signaled when drawing or writing ends
+    bool quit;
+
+    bool drawing;        // a frame is reading the world
+    bool writing;        // the simulation is writing it
+    bool writes_waiting; // the simulation has writes held back for the frame boundary
+
+    SimInput input;
+    Camera last_cam, cam;
+    uint64_t cam_time; // performance counter when cam was due
+    uint64_t tick_length;
+    unsigned ticks;
+
+    // simulation thread only, frames read pod while drawing
+    PortalWorld pod;
+    WorldReloader *reloader;
+    WorldStream *stream;
+    HeightEdit height_edits[SIM_MAX_HEIGHT_EDITS];
+    unsigned num_height_edits;
+};
+
+static void updateCameraAngles(Camera *cam) {
+    cam->rot_cos    = cosf(cam->rot);
+    cam->rot_sin    = sinf(cam->rot);
+    cam->forward[0] = cam->rot_sin;
+    cam->forward[1] = -cam->rot_cos;
+    cam->forward[2] = atanf(cam->pitch);
+    normalize3d(cam->forward);
+}
+
+// false with writes_waiting set when a frame is being drawn
+static bool beginWorldWrite(Simulation *sim) {
+    SDL_LockMutex(sim->state_lock);
+    bool can_write = !sim->drawing;
+    if (can_write) {
+        sim->writing        = true;
+        sim->writes_waiting = false;
+    } else {
+        sim->writes_waiting = true;
+    }
+    SDL_UnlockMutex(sim->state_lock);
+    return can_write;
+}
+
+static void endWorldWrite(Simulation *sim) {
+    SDL_LockMutex(sim->state_lock);
+    sim->writing = false;
+    SDL_CondBroadcast(sim->frame_boundary);
+    SDL_UnlockMutex(sim->state_lock);
+}
+
+// held edits are made to the world as it is now, so they go in before a reload or region replaces it
+static void writeWorld(Simulation *sim, Camera *cam) {
+    bool reload = sim->reloader != NULL && isWorldReloadReady(sim->reloader);
+    bool stream = sim->stream != NULL && updateWorldStream(sim->stream, sim->pod, cam->pos, cam->sector);
+    if (!reload && !stream && sim->num_height_edits == 0) return;
+    if (!beginWorldWrite(sim)) return;
+
+    for (unsigned i = 0; i < sim->num_height_edits; ++i) {
+        HeightEdit edit = sim->height_edits[i];
+        setSectorHeights(&sim->pod, edit.sector, edit.tier, edit.floor, edit.ceiling);
+    }
+    sim->num_height_edits = 0;
+
+    // swap in a finished reload between ticks, keeping the camera where it was
+    if (reload && applyWorldReload(sim->reloader, &sim->pod)) cam->sector = getCurrentSector(sim->pod, cam->pos, cam->sector);
+    if (stream) applyWorldStream(sim->stream, &sim->pod);
+
+    endWorldWrite(sim);
+}
+
+// edits to the same tier fold into one, each building on the last so none are lost while held
+static void editSectorHeights(Simulation *sim, unsigned sector, unsigned tier, float raise_floor, float raise_ceiling) {
+    HeightEdit *edit = NULL;
+    for (unsigned i = 0; i < sim->num_height_edits; ++i) {
+        if (sim->height_edits[i].sector == sector && sim->height_edits[i].tier == tier) edit = &sim->height_edits[i];
+    }
+
+    if (edit == NULL) {
+        if (sim->num_height_edits == SIM_MAX_HEIGHT_EDITS) return;
+
+        SectorDef def = sim->pod.sectors[sector];
+        edit          = &sim->height_edits[sim->num_height_edits++];
+        *edit         = (HeightEdit){ sector, tier, def.floor_heights[tier], def.ceiling_heights[tier] };
+    }
+
+    edit->floor += raise_floor;
+    edit->ceiling += raise_ceiling;
+}
+
+static void stepSimulation(Simulation *sim, Camera *cam, SimInput input) {
+    const float delta = 1.0f / SIM_TICK_RATE;
+
+    PortalWorld pod = sim->pod;
+
+    cam->rot += input.turn * delta * 2.0f;
+
+    cam->pitch += input.pitch * delta;
+    cam->pitch = clamp(cam->pitch, -1.0f, 1.0f);
+
+    cam->fov += input.zoom * delta * 0.5f;
+    cam->fov = clamp(cam->fov, 30.0f * TO_RADS, 120.0f * TO_RADS);
+
+    updateCameraAngles(cam);
+
+    vec2 movement = { cam->rot_cos * input.move_h + -cam->rot_sin * input.move_v, cam->rot_sin * input.move_h + cam->rot_cos * input.move_v };
+
+    // the camera walks as a body with its feet PLAYER_EYE_HEIGHT below it, flying moves it freely up and down
+    CollisionBody player = {
+        .pos         = { cam->pos[0], cam->pos[1], cam->pos[2] - PLAYER_EYE_HEIGHT },
+        .radius      = PLAYER_RADIUS,
+        .height      = PLAYER_HEIGHT,
+        .step_height = PLAYER_STEP_HEIGHT,
+        .sector      = cam->sector,
+        .tier        = cam->tier,
+    };
+    vec2 step = { movement[0] * delta * 10.0f, movement[1] * delta * 10.0f };
+    moveBody(pod, &player, step);
+
+    cam->pos[0] = player.pos[0];
+    cam->pos[1] = player.pos[1];
+    cam->pos[2] = player.pos[2] + PLAYER_EYE_HEIGHT + input.move_z * delta * 10.0f;
+
+    cam->sector = getCurrentSector(pod, cam->pos, player.sector);
+
+    if (cam->sector < pod.num_sectors) {
+        cam->tier = getSectorTier(pod, cam->pos[2], cam->sector);
+        if (cam->tier >= pod.sectors[cam->sector].num_tiers) cam->tier = 0;
+
+        if (input.raise_ceiling != 0.0f || input.raise_floor != 0.0f) {
+            editSectorHeights(sim, cam->sector, cam->tier, input.raise_floor * delta, input.raise_ceiling * delta);
+        }
+    } else {
+        // a streamed world may not have the fallback sector's region yet, the write below asks for it
+        cam->sector = 0;
+        cam->tier   = 0;
+    }
+
+    writeWorld(sim, cam);
+}
+
+static int simThread(void *data) {
+    Simulation *sim = data;
+
+    SDL_LockMutex(sim->state_lock);
+    Camera cam        = sim->cam;
+    uint64_t next_due = sim->cam_time + sim->tick_length;
+
+    while (!sim->quit) {
+        // a frame is waiting to start until the held writes are in
+        if (sim->writes_waiting && !sim->drawing) {
+            SDL_UnlockMutex(sim->state_lock);
+            writeWorld(sim, &cam);
+            SDL_LockMutex(sim->state_lock);
+
+            sim->writes_waiting = false;
+            SDL_CondBroadcast(sim->frame_boundary);
+        }
+
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (now < next_due) {
+            uint64_t wait_ms = (next_due - now) * 1000 / SDL_GetPerformanceFrequency();
+            SDL_CondWaitTimeout(sim->wake, sim->state_lock, (Uint32)max(wait_ms, 1));
+            continue;
+        }
+
+        for (unsigned i = 0; i < SIM_MAX_CATCH_UP && now >= next_due && !sim->quit; ++i) {
+            SimInput input = sim->input;
+            SDL_UnlockMutex(sim->state_lock);
+            stepSimulation(sim, &cam, input);
+            SDL_LockMutex(sim->state_lock);
+
+            sim->last_cam = sim->cam;
+            sim->cam      = cam;
+            sim->cam_time = next_due;
+            sim->ticks += 1;
+            next_due += sim->tick_length;
+        }
+
+        if (now >= next_due) next_due = now + sim->tick_length;
+    }
+    SDL_UnlockMutex(sim->state_lock);
+
+    return 0;
+}
+
+Simulation *startSimulation(PortalWorld world, Camera cam, WorldReloader *reloader, WorldStream *stream) {
+    Simulation *sim = calloc(1, sizeof(*sim));
+    if (sim == NULL) return NULL;
+
+    updateCameraAngles(&cam);
+    sim->pod         = world;
+    sim->reloader    = reloader;
+    sim->stream      = stream;
+    sim->last_cam    = cam;
+    sim->cam         = cam;
+    sim->cam_time    = SDL_GetPerformanceCounter();
+    sim->tick_length = max(SDL_GetPerformanceFrequency() / SIM_TICK_RATE, 1);
+    sim->state_lock     = SDL_CreateMutex();
+    sim->wake           = SDL_CreateCond();
+    sim->frame_boundary = SDL_CreateCond();
+
+    if (sim->state_lock == NULL || sim->wake == NULL || sim->frame_boundary == NULL) {
+        printf("ERROR: Failed to create simulation locks: %s\n", SDL_GetError());
+        goto _fail;
+    }
+
+    sim->thread = SDL_CreateThread(simThread, "simulation", sim);
+    if (sim->thread == NULL) {
+        printf("ERROR: Failed to create simulation thread: %s\n", SDL_GetError());
+        goto _fail;
+    }
+
+    return sim;
+
+_fail:
+    if (sim->state_lock != NULL) SDL_DestroyMutex(sim->state_lock);
+    if (sim->wake != NULL) SDL_DestroyCond(sim->wake);
+    if (sim->frame_boundary != NULL) SDL_DestroyCond(sim->frame_boundary);
+    free(sim);
+    return NULL;
+}
+
+PortalWorld stopSimulation(Simulation *sim) {
+    SDL_LockMutex(sim->state_lock);
+    sim->quit = true;
+    SDL_CondSignal(sim->wake);
+    SDL_UnlockMutex(sim->state_lock);
+    SDL_WaitThread(sim->thread, NULL);
+
+    PortalWorld world = sim->pod;
+    SDL_DestroyMutex(sim->state_lock);
+    SDL_DestroyCond(sim->wake);
+    SDL_DestroyCond(sim->frame_boundary);
+    free(sim);
+    return world;
+}
+
+void setSimInput(Simulation *sim, SimInput input) {
+    SDL_LockMutex(sim->state_lock);
+    sim->input = input;
+    SDL_UnlockMutex(sim->state_lock);
+}
+
+unsigned getSimTicks(Simulation *sim) {
+    SDL_LockMutex(sim->state_lock);
+    unsigned ticks = sim->ticks;
+    SDL_UnlockMutex(sim->state_lock);
+    return ticks;
+}
+
+PortalWorld lockSimWorld(Simulation *sim, Camera *o_cam) {
+    assert(o_cam != NULL);
+
+    SDL_LockMutex(sim->state_lock);
+    while (sim->writing || sim->writes_waiting) {
+        SDL_CondSignal(sim->wake);
+        SDL_CondWait(sim->frame_boundary, sim->state_lock);
+    }
+    sim->drawing = true;
+
+    Camera last     = sim->last_cam;
+    Camera cam      = sim->cam;
+    float alpha     = (float)(SDL_GetPerformanceCounter() - sim->cam_time) / sim->tick_length;
+    PortalWorld pod = sim->pod;
+    SDL_UnlockMutex(sim->state_lock);
+
+    alpha = clamp(alpha, 0.0f, 1.0f);
+    for (unsigned i = 0; i < 3; ++i) {
+        cam.pos[i] = last.pos[i] + (cam.pos[i] - last.pos[i]) * alpha;
+    }
+    cam.rot   = last.rot + (cam.rot - last.rot) * alpha;
+    cam.pitch = last.pitch + (cam.pitch - last.pitch) * alpha;
+    cam.fov   = last.fov + (cam.fov - last.fov) * alpha;
+    updateCameraAngles(&cam);
+
+    // the point between ticks may be across a portal from where the last tick ended
+    unsigned sector = getCurrentSector(pod, cam.pos, cam.sector);
+    if (sector < pod.num_sectors) {
+        unsigned tier = getSectorTier(pod, cam.pos[2], sector);
+        if (tier < pod.sectors[sector].num_tiers) {
+            cam.sector = sector;
+            cam.tier   = tier;
+        }
+    }
+
+    *o_cam = cam;
+    return pod;
+}
+
+void unlockSimWorld(Simulation *sim) {
+    SDL_LockMutex(sim->state_lock);
+    sim->drawing = false;
+    if (sim->writes_waiting) SDL_CondSignal(sim->wake);
+    SDL_UnlockMutex(sim->state_lock);
+}
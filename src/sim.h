@@ -0,0 +1,33 @@
+#pragma once
+
+#include "portals.h"
+#include "reload.h"
+#include "stream.h"
+
+#define SIM_TICK_RATE 60
+
+// what the player is doing, each from -1 to 1, as of the last input the main thread saw
+typedef struct SimInput {
+    float move_h, move_v, move_z;
+    float turn, pitch, zoom;
+    float raise_ceiling, raise_floor;
+} SimInput;
+
+// Steps the player and edits the world at SIM_TICK_RATE on a thread of its own, whatever the frame
+// rate. The thread is the only one writing to the world, and only between frames, holding its edits
+// back while one is drawn. It also applies reloads and streams regions, so the reloader and stream
+// belong to it until stopped.
+typedef struct Simulation Simulation;
+
+Simulation *startSimulation(PortalWorld world, Camera cam, WorldReloader *reloader, WorldStream *stream);
+// the world as the simulation left it, for the caller to free
+PortalWorld stopSimulation(Simulation *sim);
+
+void setSimInput(Simulation *sim, SimInput input);
+unsigned getSimTicks(Simulation *sim);
+
+// Holds the world still for reading until unlockSimWorld and fills o_cam with the camera between the
+// last two ticks, as of now. Writes the simulation held back go in first, so the wait is for a write,
+// never a tick. Drawing lags a tick behind the simulation in exchange for smooth motion at any frame rate.
+PortalWorld lockSimWorld(Simulation *sim, Camera *o_cam);
+void unlockSimWorld(Simulation *sim);
@@ -0,0 +1,293 @@
+#include "stream.h"
+
+#include <SDL2/SDL.h>
+
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <assert.h>
+
+// regions this many portal hops from the camera's are requested ahead of time
+#define STREAM_HOPS 2
+
+typedef enum RegionState {
+    REGION_UNLOADED,
+    REGION_QUEUED,
+    REGION_LOADING,
+    REGION_READY,
+    REGION_RESIDENT,
+    REGION_BROKEN, // failed to activate, never retried
+} RegionState;
+
+// The lock guards states and both queues. Only the thread updating the stream activates or releases
+// regions and writes the sector table, the worker only reads the mapped file.
+struct WorldStream {
+    PortalWorld world;
+    PagedWorld paged;
+    size_t memory_cap;
+    size_t resident_bytes;
+    unsigned resident_regions;
+
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    SDL_cond *wake;
+    bool quit;
+
+    RegionState *states;
+    unsigned *requests; // ring of regions to prefetch
+    unsigned request_head, num_requests;
+    unsigned *done; // prefetched regions waiting to be activated
+    unsigned num_done;
+
+    // updating thread only
+    unsigned *last_used; // frame each region was last within reach
+    unsigned *visit;     // breadth first queue of regions
+    unsigned *hops;
+    unsigned frame;
+    unsigned needed[2]; // regions the camera is in that the next apply cannot leave to the worker
+    unsigned num_needed;
+};
+
+static int streamThread(void *data) {
+    WorldStream *stream = data;
+
+    SDL_LockMutex(stream->lock);
+    while (!stream->quit) {
+        if (stream->num_requests == 0) {
+            SDL_CondWait(stream->wake, stream->lock);
+            continue;
+        }
+
+        unsigned region      = stream->requests[stream->request_head];
+        stream->request_head = (stream->request_head + 1) % stream->paged.num_regions;
+        stream->num_requests -= 1;
+
+        // the updating thread may have needed it sooner and activated it already
+        if (stream->states[region] != REGION_QUEUED) continue;
+        stream->states[region] = REGION_LOADING;
+
+        SDL_UnlockMutex(stream->lock);
+        prefetchRegion(stream->world, stream->paged, region);
+        SDL_LockMutex(stream->lock);
+
+        if (stream->states[region] == REGION_LOADING) {
+            stream->states[region]           = REGION_READY;
+            stream->done[stream->num_done++] = region;
+        }
+    }
+    SDL_UnlockMutex(stream->lock);
+
+    return 0;
+}
+
+WorldStream *openWorldStream(const char *path, float scale, size_t memory_cap, PortalWorld *o_world) {
+    assert(path != NULL);
+    assert(o_world != NULL);
+
+    WorldStream *stream = calloc(1, sizeof(*stream));
+    if (stream == NULL) return NULL;
+
+    if (!loadWorldPaged(path, &stream->world, &stream->paged, scale)) {
+        free(stream);
+        return NULL;
+    }
+
+    unsigned num_regions = max(stream->paged.num_regions, 1);
+    stream->memory_cap   = memory_cap;
+    stream->states       = calloc(num_regions, sizeof(*stream->states));
+    stream->requests     = malloc(num_regions * sizeof(*stream->requests));
+    stream->done         = malloc(num_regions * sizeof(*stream->done));
+    stream->last_used    = calloc(num_regions, sizeof(*stream->last_used));
+    stream->visit        = malloc(num_regions * sizeof(*stream->visit));
+    stream->hops         = malloc(num_regions * sizeof(*stream->hops));
+    stream->lock         = SDL_CreateMutex();
+    stream->wake         = SDL_CreateCond();
+
+    if (stream->states == NULL || stream->requests == NULL || stream->done == NULL || stream->last_used == NULL ||
+        stream->visit == NULL || stream->hops == NULL || stream->lock == NULL || stream->wake == NULL) {
+        printf("ERROR: Out of memory streaming %s\n", path);
+        goto _fail;
+    }
+
+    stream->thread = SDL_CreateThread(streamThread, "world stream", stream);
+    if (stream->thread == NULL) {
+        printf("ERROR: Failed to create stream thread: %s\n", SDL_GetError());
+        goto _fail;
+    }
+
+    printf("Streaming %u regions of %s\n", stream->paged.num_regions, path);
+    *o_world = stream->world;
+    return stream;
+
+_fail:
+    freeWorld(stream->world);
+    free(stream->states);
+    free(stream->requests);
+    free(stream->done);
+    free(stream->last_used);
+    free(stream->visit);
+    free(stream->hops);
+    if (stream->lock != NULL) SDL_DestroyMutex(stream->lock);
+    if (stream->wake != NULL) SDL_DestroyCond(stream->wake);
+    free(stream);
+    return NULL;
+}
+
+void closeWorldStream(WorldStream *stream) {
+    if (stream == NULL) return;
+
+    SDL_LockMutex(stream->lock);
+    stream->quit = true;
+    SDL_CondSignal(stream->wake);
+    SDL_UnlockMutex(stream->lock);
+    SDL_WaitThread(stream->thread, NULL);
+
+    free(stream->states);
+    free(stream->requests);
+    free(stream->done);
+    free(stream->last_used);
+    free(stream->visit);
+    free(stream->hops);
+    SDL_DestroyMutex(stream->lock);
+    SDL_DestroyCond(stream->wake);
+    free(stream);
+}
+
+// expects the lock to be held
+static void makeResident(WorldStream *stream, PortalWorld *world, unsigned region) {
+    if (!activateRegion(world, stream->paged, region)) {
+        stream->states[region] = REGION_BROKEN;
+        return;
+    }
+
+    stream->states[region] = REGION_RESIDENT;
+    stream->resident_bytes += getRegionSize(*world, stream->paged, region);
+    stream->resident_regions += 1;
+}
+
+// expects the lock to be held
+static void requestRegion(WorldStream *stream, unsigned region) {
+    // stale entries of regions activated early can fill the ring, the region is retried next frame
+    if (stream->states[region] != REGION_UNLOADED || stream->num_requests == stream->paged.num_regions) return;
+
+    unsigned tail          = (stream->request_head + stream->num_requests) % stream->paged.num_regions;
+    stream->requests[tail] = region;
+    stream->states[region] = REGION_QUEUED;
+    stream->num_requests += 1;
+    SDL_CondSignal(stream->wake);
+}
+
+// expects the lock to be held, whether a resident region was not within reach this frame
+static bool canRelease(WorldStream *stream) {
+    if (stream->resident_bytes <= stream->memory_cap) return false;
+    for (unsigned i = 0; i < stream->paged.num_regions; ++i) {
+        if (stream->states[i] == REGION_RESIDENT && stream->last_used[i] != stream->frame) return true;
+    }
+    return false;
+}
+
+bool updateWorldStream(WorldStream *stream, PortalWorld world, vec2 cam_pos, unsigned cam_sector) {
+    if (stream->paged.num_regions == 0) return false;
+
+    SDL_LockMutex(stream->lock);
+
+    // The regions of the camera's sector and of its position cannot wait for the worker. They
+    // differ after a jump further than the streamed reach, where the sector is only a fallback.
+    unsigned starts[2] = {
+        cam_sector < world.num_sectors ? getSectorRegion(stream->paged, cam_sector) : INVALID_REGION_INDEX,
+        findRegion(stream->paged, cam_pos),
+    };
+
+    // everything within reach is marked used this frame and requested if missing
+    if (++stream->frame == 0) {
+        memset(stream->last_used, 0, stream->paged.num_regions * sizeof(*stream->last_used));
+        stream->frame = 1;
+    }
+
+    unsigned num_visit = 0;
+    stream->num_needed = 0;
+    for (unsigned i = 0; i < 2; ++i) {
+        unsigned start = starts[i];
+        if (start == INVALID_REGION_INDEX || stream->last_used[start] == stream->frame) continue;
+
+        if (stream->states[start] != REGION_RESIDENT && stream->states[start] != REGION_BROKEN) {
+            stream->needed[stream->num_needed++] = start;
+        }
+
+        stream->visit[num_visit++] = start;
+        stream->hops[start]        = 0;
+        stream->last_used[start]   = stream->frame;
+    }
+
+    for (unsigned v = 0; v < num_visit; ++v) {
+        unsigned region = stream->visit[v];
+        requestRegion(stream, region);
+        if (stream->hops[region] == STREAM_HOPS) continue;
+
+        WorldRegion r = stream->paged.regions[region];
+        for (unsigned n = r.first_neighbor; n < r.first_neighbor + r.num_neighbors; ++n) {
+            unsigned neighbor = stream->paged.region_neighbors[n];
+            if (stream->last_used[neighbor] == stream->frame) continue;
+
+            stream->last_used[neighbor] = stream->frame;
+            stream->hops[neighbor]      = stream->hops[region] + 1;
+            stream->visit[num_visit++]  = neighbor;
+        }
+    }
+
+    bool pending = stream->num_needed > 0 || stream->num_done > 0 || canRelease(stream);
+    SDL_UnlockMutex(stream->lock);
+    return pending;
+}
+
+void applyWorldStream(WorldStream *stream, PortalWorld *world) {
+    assert(world != NULL);
+    if (stream->paged.num_regions == 0) return;
+
+    SDL_LockMutex(stream->lock);
+
+    for (unsigned i = 0; i < stream->num_done; ++i) {
+        if (stream->states[stream->done[i]] == REGION_READY) makeResident(stream, world, stream->done[i]);
+    }
+    stream->num_done = 0;
+
+    // the worker may have prefetched a needed region since, or be fetching it now
+    for (unsigned i = 0; i < stream->num_needed; ++i) {
+        unsigned region = stream->needed[i];
+        if (stream->states[region] != REGION_RESIDENT && stream->states[region] != REGION_BROKEN) {
+            makeResident(stream, world, region);
+        }
+    }
+    stream->num_needed = 0;
+
+    // least recently used first, never anything within reach this frame
+    while (stream->resident_bytes > stream->memory_cap) {
+        unsigned oldest = INVALID_REGION_INDEX;
+        for (unsigned i = 0; i < stream->paged.num_regions; ++i) {
+            if (stream->states[i] != REGION_RESIDENT || stream->last_used[i] == stream->frame) continue;
+            if (oldest == INVALID_REGION_INDEX || stream->last_used[i] < stream->last_used[oldest]) oldest = i;
+        }
+        if (oldest == INVALID_REGION_INDEX) break;
+
+        // the pages it alone holds, the same count its activation added for them
+        stream->resident_bytes -= getRegionSize(*world, stream->paged, oldest);
+        releaseRegion(world, stream->paged, oldest);
+        stream->states[oldest] = REGION_UNLOADED;
+        stream->resident_regions -= 1;
+    }
+
+    SDL_UnlockMutex(stream->lock);
+}
+
+WorldStreamStats getWorldStreamStats(WorldStream *stream) {
+    SDL_LockMutex(stream->lock);
+    WorldStreamStats stats = {
+        .num_regions      = stream->paged.num_regions,
+        .resident_regions = stream->resident_regions,
+        .pending_regions  = stream->num_requests + stream->num_done,
+        .resident_bytes   = stream->resident_bytes,
+        .memory_cap       = stream->memory_cap,
+    };
+    SDL_UnlockMutex(stream->lock);
+    return stats;
+}
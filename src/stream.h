@@ -0,0 +1,28 @@
+#pragma once
+
+#include "portals.h"
+
+// Streams the regions of a paged world around the camera. A worker thread faults in the pages of
+// regions the camera may reach soon, the thread updating the stream activates them between ticks and releases
+// the least recently used ones once the resident regions outgrow the memory cap. Only activating and
+// releasing write the world, so readers need only be kept out while applyWorldStream runs.
+typedef struct WorldStream WorldStream;
+
+typedef struct WorldStreamStats {
+    unsigned num_regions;
+    unsigned resident_regions;
+    unsigned pending_regions; // queued or being prefetched
+    size_t resident_bytes;
+    size_t memory_cap;
+} WorldStreamStats;
+
+// o_world starts with no regions active, it is freed with freeWorld after closing the stream
+WorldStream *openWorldStream(const char *path, float scale, size_t memory_cap, PortalWorld *o_world);
+void closeWorldStream(WorldStream *stream);
+
+// Finds the regions within reach of the camera and requests the missing ones, reading the world
+// without writing it. Returns whether applyWorldStream has regions to activate or release.
+bool updateWorldStream(WorldStream *stream, PortalWorld world, vec2 cam_pos, unsigned cam_sector);
+// call between frames, afterwards the regions the last update found within reach are active
+void applyWorldStream(WorldStream *stream, PortalWorld *world);
+WorldStreamStats getWorldStreamStats(WorldStream *stream);
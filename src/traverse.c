@@ -0,0 +1,97 @@
+#include "portals.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// Breadth first over the portals, so sectors come to the callback in order of hops. A sector is
+// stamped with the visitor's epoch when it is queued, which makes every call start with nothing
+// visited without clearing anything. The arrays only grow, when a larger world comes along.
+
+bool createSectorVisitor(SectorVisitor *o_visitor, unsigned num_sectors) {
+    assert(o_visitor != NULL);
+    memset(o_visitor, 0, sizeof(*o_visitor));
+    o_visitor->epoch = 1;
+
+    unsigned n           = max(num_sectors, 1);
+    o_visitor->stamps    = calloc(n, sizeof(*o_visitor->stamps));
+    o_visitor->queue     = malloc(n * sizeof(*o_visitor->queue));
+    o_visitor->hops      = malloc(n * sizeof(*o_visitor->hops));
+    o_visitor->distances = malloc(n * sizeof(*o_visitor->distances));
+    if (o_visitor->stamps == NULL || o_visitor->queue == NULL || o_visitor->hops == NULL || o_visitor->distances == NULL) {
+        printf("ERROR: Failed to allocate a sector visitor for %u sectors\n", n);
+        freeSectorVisitor(*o_visitor);
+        memset(o_visitor, 0, sizeof(*o_visitor));
+        return false;
+    }
+
+    o_visitor->capacity = n;
+    return true;
+}
+
+void freeSectorVisitor(SectorVisitor visitor) {
+    free(visitor.stamps);
+    free(visitor.queue);
+    free(visitor.hops);
+    free(visitor.distances);
+}
+
+unsigned visitSectors(PortalWorld pod, SectorVisitor *visitor, unsigned start_sector, vec2 origin, VisitLimits limits,
+                      SectorVisitFunc func, void *user_data) {
+    assert(visitor != NULL);
+    assert(func != NULL);
+
+    if (start_sector >= pod.num_sectors || pod.sectors[start_sector].num_tiers == 0 || limits.max_sectors == 0) return 0;
+
+    if (visitor->capacity < pod.num_sectors) {
+        freeSectorVisitor(*visitor);
+        if (!createSectorVisitor(visitor, pod.num_sectors)) return 0;
+    }
+
+    // stamps are only cleared for real once the epochs wrap
+    if (++visitor->epoch == 0) {
+        memset(visitor->stamps, 0, visitor->capacity * sizeof(*visitor->stamps));
+        visitor->epoch = 1;
+    }
+
+    unsigned epoch   = visitor->epoch;
+    unsigned *stamps = visitor->stamps;
+    unsigned *queue  = visitor->queue;
+    unsigned head = 0, tail = 0;
+
+    stamps[start_sector]             = epoch;
+    visitor->hops[start_sector]      = 0;
+    visitor->distances[start_sector] = 0.0f;
+    queue[tail++]                    = start_sector;
+
+    while (head < tail && head < limits.max_sectors) {
+        unsigned sector_index = queue[head++];
+        unsigned hops         = visitor->hops[sector_index];
+        float distance        = visitor->distances[sector_index];
+
+        if (!func(sector_index, hops, distance, user_data) || hops >= limits.max_hops) continue;
+
+        SectorDef sector = pod.sectors[sector_index];
+        for (unsigned i = sector.first_portal; i < sector.first_portal + sector.num_portals; ++i) {
+            Portal portal = pod.portals[i];
+            if (portal.sector >= pod.num_sectors || stamps[portal.sector] == epoch) continue;
+            if (pod.sectors[portal.sector].num_tiers == 0) continue; // not resident
+
+            // a sector is as far as the nearest point of the portal it is entered through, which no
+            // walk to it can beat
+            WallGeometry geom   = pod.wall_geometry[portal.wall];
+            float next_distance = segmentPointDistance(pod.wall_lines[portal.wall], geom.dir, geom.length, origin);
+            next_distance       = max(distance, next_distance);
+            if (next_distance > limits.max_distance) continue;
+
+            stamps[portal.sector]             = epoch;
+            visitor->hops[portal.sector]      = hops + 1;
+            visitor->distances[portal.sector] = next_distance;
+            queue[tail++]                     = portal.sector;
+        }
+    }
+
+    return head;
+}
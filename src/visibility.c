@@ -0,0 +1,360 @@
+#include "portals.h"
+#include "geo.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// A sector sees another when a straight line leaves it through one of its portals and reaches the
+// other through a chain of portals. The test is in 2D and ignores heights, so one set serves every
+// tier and stays valid when floors and ceilings are edited.
+//
+// A line crosses every portal of a chain from its inside (left) to its outside when its direction t
+// has cross(t, b_j - a_i) >= 0 for every start a_i and end b_j in the chain. Each pair allows half
+// of the directions, so the directions left are an arc that narrows as the chain grows. Arcs are
+// kept as their end directions, counterclockwise from lo to hi and never more than a half turn.
+
+#define MAX_VISIBILITY_DEPTH 256
+#define MAX_VISIBILITY_STEPS (1u << 16) // chains followed per sector, past it the sector sees everything
+#define VISIBILITY_MARGIN 0.01f         // portals are widened by this much of their length, covering the renderer's rounding
+#define MAX_VISIBILITY_THREADS 64
+
+typedef struct VisibilityBake {
+    PortalWorld world;
+    unsigned row_bytes;
+    uint8_t **rows; // each sector's encoded set
+    unsigned *row_sizes;
+    atomic_uint next_sector;
+    atomic_uint num_saturated;
+    atomic_bool failed;
+} VisibilityBake;
+
+// one per thread
+typedef struct VisibilityFlow {
+    const VisibilityBake *bake;
+    uint8_t *bits;
+    vec2 (*chain)[2]; // widened ends of the portals crossed so far
+    unsigned steps;
+} VisibilityFlow;
+
+static void markVisible(uint8_t *bits, unsigned sector_index) {
+    bits[sector_index >> 3] |= 1u << (sector_index & 7);
+}
+
+typedef struct VisibilityArc {
+    vec2 lo, hi;
+} VisibilityArc;
+
+// Narrows the arc to the directions with cross(t, v) > 0, the half turn clockwise from v. Both are
+// open, so a chain never doubles back along a line it already crossed. An end lying on v or -v
+// counts as inside when the arc leaves it into the half turn.
+static bool narrowArc(VisibilityArc *arc, float vx, float vy) {
+    float lo_cross = arc->lo[0] * vy - arc->lo[1] * vx;
+    float hi_cross = arc->hi[0] * vy - arc->hi[1] * vx;
+    bool lo_in     = lo_cross > 0.0f || (lo_cross == 0.0f && arc->lo[0] * vx + arc->lo[1] * vy < 0.0f);
+    bool hi_in     = hi_cross > 0.0f || (hi_cross == 0.0f && arc->hi[0] * vx + arc->hi[1] * vy > 0.0f);
+
+    // an arc of at most a half turn is inside when both ends are and misses when neither is
+    if (lo_in && hi_in) return true;
+    if (!lo_in && !hi_in) return false;
+
+    // turning counterclockwise, the half turn is left at v and entered at -v
+    if (lo_in) {
+        arc->hi[0] = vx;
+        arc->hi[1] = vy;
+    } else {
+        arc->lo[0] = -vx;
+        arc->lo[1] = -vy;
+    }
+    return true;
+}
+
+static void widenPortal(PortalWorld world, unsigned wall_index, vec2 o_ends[2]) {
+    Line line         = world.wall_lines[wall_index];
+    WallGeometry geom = world.wall_geometry[wall_index];
+    float margin      = geom.length * VISIBILITY_MARGIN;
+
+    o_ends[0][0] = line.points[0][0] - geom.dir[0] * margin;
+    o_ends[0][1] = line.points[0][1] - geom.dir[1] * margin;
+    o_ends[1][0] = line.points[1][0] + geom.dir[0] * margin;
+    o_ends[1][1] = line.points[1][1] + geom.dir[1] * margin;
+}
+
+// depth portals are in the chain and the last one led into sector, through its wall entry_twin
+static bool flowThrough(VisibilityFlow *flow, unsigned sector_index, unsigned entry_twin, unsigned depth, VisibilityArc arc) {
+    PortalWorld world = flow->bake->world;
+    SectorDef sector  = world.sectors[sector_index];
+    if (depth >= MAX_VISIBILITY_DEPTH) return false;
+
+    for (unsigned p = sector.first_portal; p < sector.first_portal + sector.num_portals; ++p) {
+        Portal portal = world.portals[p];
+        if (portal.wall == entry_twin) continue;
+
+        vec2 *ends = flow->chain[depth];
+        widenPortal(world, portal.wall, ends);
+
+        VisibilityArc narrowed = arc;
+        bool open              = narrowArc(&narrowed, ends[1][0] - ends[0][0], ends[1][1] - ends[0][1]);
+        for (unsigned i = 0; open && i < depth; ++i) {
+            vec2 *prev = flow->chain[i];
+            open       = narrowArc(&narrowed, ends[1][0] - prev[0][0], ends[1][1] - prev[0][1]) &&
+                         narrowArc(&narrowed, prev[1][0] - ends[0][0], prev[1][1] - ends[0][1]);
+        }
+        if (!open) continue;
+
+        markVisible(flow->bits, portal.sector);
+        if (++flow->steps > MAX_VISIBILITY_STEPS) return false;
+        if (!flowThrough(flow, portal.sector, portal.twin, depth + 1, narrowed)) return false;
+    }
+
+    return true;
+}
+
+// false when the sector saturated and sees everything
+static bool flowSector(VisibilityFlow *flow, unsigned sector_index) {
+    PortalWorld world = flow->bake->world;
+    SectorDef sector  = world.sectors[sector_index];
+
+    memset(flow->bits, 0, flow->bake->row_bytes);
+    markVisible(flow->bits, sector_index);
+    flow->steps = 0;
+
+    for (unsigned p = sector.first_portal; p < sector.first_portal + sector.num_portals; ++p) {
+        Portal portal = world.portals[p];
+        vec2 *ends    = flow->chain[0];
+        widenPortal(world, portal.wall, ends);
+
+        // the portal's own half turn, pointing out of the sector
+        VisibilityArc arc = {
+            .lo = { ends[0][0] - ends[1][0], ends[0][1] - ends[1][1] },
+            .hi = { ends[1][0] - ends[0][0], ends[1][1] - ends[0][1] },
+        };
+
+        markVisible(flow->bits, portal.sector);
+        if (!flowThrough(flow, portal.sector, portal.twin, 1, arc)) {
+            memset(flow->bits, 0xff, flow->bake->row_bytes);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// zero bytes are written as a 0 followed by how many, up to 255, everything else as is
+static unsigned encodeVisibility(const uint8_t *bits, unsigned num_bytes, uint8_t *o_data) {
+    unsigned size = 0;
+    for (unsigned i = 0; i < num_bytes;) {
+        if (bits[i] != 0) {
+            o_data[size++] = bits[i++];
+            continue;
+        }
+
+        unsigned run = 0;
+        while (i < num_bytes && bits[i] == 0 && run < 255) {
+            ++i;
+            ++run;
+        }
+        o_data[size++] = 0;
+        o_data[size++] = run;
+    }
+    return size;
+}
+
+static void bakeSectors(VisibilityBake *bake) {
+    VisibilityFlow flow = {
+        .bake  = bake,
+        .bits  = malloc(bake->row_bytes),
+        .chain = malloc(MAX_VISIBILITY_DEPTH * sizeof(*flow.chain)),
+    };
+    uint8_t *encoded = malloc(bake->row_bytes * 2);
+
+    if (flow.bits == NULL || flow.chain == NULL || encoded == NULL) {
+        atomic_store(&bake->failed, true);
+    }
+
+    while (!atomic_load(&bake->failed)) {
+        unsigned s = atomic_fetch_add(&bake->next_sector, 1);
+        if (s >= bake->world.num_sectors) break;
+
+        if (!flowSector(&flow, s)) atomic_fetch_add(&bake->num_saturated, 1);
+
+        // bits past the last sector stay clear, so saturated rows still compress their tail
+        if (bake->world.num_sectors % 8 != 0) flow.bits[bake->row_bytes - 1] &= (1u << (bake->world.num_sectors % 8)) - 1;
+
+        unsigned size = encodeVisibility(flow.bits, bake->row_bytes, encoded);
+        bake->rows[s] = malloc(max(size, 1));
+        if (bake->rows[s] == NULL) {
+            atomic_store(&bake->failed, true);
+            break;
+        }
+        memcpy(bake->rows[s], encoded, size);
+        bake->row_sizes[s] = size;
+    }
+
+    free(flow.bits);
+    free(flow.chain);
+    free(encoded);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI bakeThread(LPVOID data) {
+    bakeSectors(data);
+    return 0;
+}
+#else
+static void *bakeThread(void *data) {
+    bakeSectors(data);
+    return NULL;
+}
+#endif
+
+static unsigned countCpus(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return max(info.dwNumberOfProcessors, 1);
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (unsigned)count : 1;
+#endif
+}
+
+// the calling thread bakes too, so a failed thread only slows the bake down
+static void runBakeThreads(VisibilityBake *bake, unsigned num_threads) {
+    if (num_threads == 0) num_threads = countCpus();
+    num_threads = clamp(num_threads, 1, MAX_VISIBILITY_THREADS);
+
+#ifdef _WIN32
+    HANDLE threads[MAX_VISIBILITY_THREADS];
+    unsigned num_started = 0;
+    for (unsigned i = 1; i < num_threads; ++i) {
+        threads[num_started] = CreateThread(NULL, 0, bakeThread, bake, 0, NULL);
+        if (threads[num_started] != NULL) ++num_started;
+    }
+
+    bakeSectors(bake);
+
+    for (unsigned i = 0; i < num_started; ++i) {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+#else
+    pthread_t threads[MAX_VISIBILITY_THREADS];
+    unsigned num_started = 0;
+    for (unsigned i = 1; i < num_threads; ++i) {
+        if (pthread_create(&threads[num_started], NULL, bakeThread, bake) == 0) ++num_started;
+    }
+
+    bakeSectors(bake);
+
+    for (unsigned i = 0; i < num_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+}
+
+bool bakeVisibility(PortalWorld world, PortalWorld *o_world, unsigned num_threads, unsigned *o_num_saturated) {
+    assert(o_world != NULL);
+
+    VisibilityBake bake = {
+        .world     = world,
+        .row_bytes = (world.num_sectors + 7) / 8,
+        .rows      = calloc(max(world.num_sectors, 1), sizeof(*bake.rows)),
+        .row_sizes = calloc(max(world.num_sectors, 1), sizeof(*bake.row_sizes)),
+    };
+    atomic_init(&bake.next_sector, 0);
+    atomic_init(&bake.num_saturated, 0);
+    atomic_init(&bake.failed, bake.rows == NULL || bake.row_sizes == NULL);
+
+    if (!atomic_load(&bake.failed)) runBakeThreads(&bake, num_threads);
+
+    // the copy takes the sets along into its arena
+    PortalWorld source         = world;
+    SectorVisibility *baked    = &source.visibility;
+    baked->offsets             = malloc((world.num_sectors + 1) * sizeof(*baked->offsets));
+    baked->size                = 0;
+    baked->stale               = false;
+    bool ok                    = !atomic_load(&bake.failed) && baked->offsets != NULL;
+
+    for (unsigned i = 0; ok && i < world.num_sectors; ++i) {
+        baked->offsets[i] = baked->size;
+        baked->size += bake.row_sizes[i];
+    }
+    if (ok) baked->offsets[world.num_sectors] = baked->size;
+
+    baked->data = ok ? malloc(max(baked->size, 1)) : NULL;
+    ok          = ok && baked->data != NULL;
+    for (unsigned i = 0; ok && i < world.num_sectors; ++i) {
+        memcpy(baked->data + baked->offsets[i], bake.rows[i], bake.row_sizes[i]);
+    }
+
+    ok = ok && copyWorld(source, o_world);
+
+    for (unsigned i = 0; bake.rows != NULL && i < world.num_sectors; ++i) {
+        free(bake.rows[i]);
+    }
+    free(bake.rows);
+    free(bake.row_sizes);
+    free(baked->offsets);
+    free(baked->data);
+
+    if (!ok) {
+        printf("ERROR: Out of memory baking visibility\n");
+        return false;
+    }
+
+    if (o_num_saturated != NULL) *o_num_saturated = atomic_load(&bake.num_saturated);
+    return true;
+}
+
+bool getVisibleSectors(PortalWorld world, unsigned sector_index, uint8_t *o_bits) {
+    SectorVisibility visibility = world.visibility;
+    if (visibility.offsets == NULL || visibility.stale || sector_index >= world.num_sectors) return false;
+
+    unsigned num_bytes = (world.num_sectors + 7) / 8;
+    unsigned out       = 0;
+    for (unsigned i = visibility.offsets[sector_index]; i < visibility.offsets[sector_index + 1] && out < num_bytes; ++i) {
+        if (visibility.data[i] != 0) {
+            o_bits[out++] = visibility.data[i];
+        } else if (i + 1 < visibility.offsets[sector_index + 1]) {
+            unsigned run = visibility.data[++i];
+            run          = min(run, num_bytes - out);
+            memset(o_bits + out, 0, run);
+            out += run;
+        }
+    }
+
+    // a short row from a damaged file sees everything rather than hiding sectors
+    if (out < num_bytes) memset(o_bits + out, 0xff, num_bytes - out);
+    return true;
+}
+
+bool isSectorVisible(PortalWorld world, unsigned from_sector, unsigned to_sector) {
+    SectorVisibility visibility = world.visibility;
+    if (visibility.offsets == NULL || visibility.stale || from_sector >= world.num_sectors) return true;
+
+    unsigned byte = to_sector >> 3;
+    unsigned at   = 0;
+    for (unsigned i = visibility.offsets[from_sector]; i < visibility.offsets[from_sector + 1]; ++i) {
+        if (visibility.data[i] != 0) {
+            if (at == byte) return (visibility.data[i] >> (to_sector & 7)) & 1;
+            ++at;
+        } else if (i + 1 < visibility.offsets[from_sector + 1]) {
+            at += visibility.data[++i];
+            if (at > byte) return false;
+        }
+    }
+    return true;
+}
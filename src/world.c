@@ -0,0 +1,3155 @@
+#include "portals.h"
+#include "geo.h"
+
+#include <math.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static void unmapFile(void *data, size_t size);
+
+// a sector whose tiers are a range of flattened tier arrays, as loaded from a file
+typedef struct SectorRecord {
+    uint32_t start, length;
+    uint32_t num_tiers, first_tier;
+} SectorRecord;
+
+typedef struct TierArrays {
+    float *floor_heights, *ceiling_heights;
+    bool *is_skys;
+    unsigned *floor_texture_ids, *ceiling_texture_ids;
+} TierArrays;
+
+#define MIN_WORLD_VERSION 1
+#define MAX_WORLD_VERSION 1
+bool loadWorld(const char *path, PortalWorld *o_world, float scale) {
+    assert(path != NULL);
+    assert(o_world != NULL);
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("ERROR: Failed to open %s\n", path);
+        return false;
+    }
+
+    char magic[sizeof(WORLD_BINARY_MAGIC)] = { 0 };
+    bool is_binary = fread(magic, 1, 4, file) == 4 && memcmp(magic, WORLD_BINARY_MAGIC, 4) == 0;
+    fclose(file);
+
+    if (is_binary) return loadWorldBinary(path, o_world, scale);
+    if (memcmp(magic, WORLD_PAGED_MAGIC, 4) == 0) {
+        printf("ERROR: %s is a paged world and must be streamed\n", path);
+        return false;
+    }
+    return loadWorldText(path, o_world, scale);
+}
+
+bool isWorldPaged(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    char magic[sizeof(WORLD_PAGED_MAGIC)] = { 0 };
+    bool is_paged = fread(magic, 1, 4, file) == 4 && memcmp(magic, WORLD_PAGED_MAGIC, 4) == 0;
+    fclose(file);
+    return is_paged;
+}
+
+//
+//      ARENA
+//
+
+// Everything a world allocates lives in one block, so loading makes a handful of allocator calls
+// and freeing is a single free. The layout runs twice: once without a base to measure the block,
+// then again to hand out pointers into it.
+
+#define WORLD_ARENA_ALIGN 64
+
+typedef struct WorldArena {
+    char *base;
+    size_t used;
+} WorldArena;
+
+static void *arenaTake(WorldArena *arena, size_t size, size_t *o_category) {
+    size_t offset = (arena->used + WORLD_ARENA_ALIGN - 1) & ~(size_t)(WORLD_ARENA_ALIGN - 1);
+    arena->used   = offset + size;
+    *o_category += size;
+    return arena->base != NULL ? arena->base + offset : NULL;
+}
+
+// mapped worlds keep walls and tiers in the file, so only their sizes are accounted for
+static void layoutWorldArena(PortalWorld *world, WorldArena *arena, unsigned num_tiers, TierArrays *o_tiers) {
+    WorldMemory *memory = &world->memory;
+    memset(memory, 0, sizeof(*memory));
+
+    world->sectors = arenaTake(arena, world->num_sectors * sizeof(*world->sectors), &memory->sectors);
+
+    if (world->mapping == NULL) {
+        o_tiers->floor_heights       = arenaTake(arena, num_tiers * sizeof(*o_tiers->floor_heights), &memory->tiers);
+        o_tiers->ceiling_heights     = arenaTake(arena, num_tiers * sizeof(*o_tiers->ceiling_heights), &memory->tiers);
+        o_tiers->is_skys             = arenaTake(arena, num_tiers * sizeof(*o_tiers->is_skys), &memory->tiers);
+        o_tiers->floor_texture_ids   = arenaTake(arena, num_tiers * sizeof(*o_tiers->floor_texture_ids), &memory->tiers);
+        o_tiers->ceiling_texture_ids = arenaTake(arena, num_tiers * sizeof(*o_tiers->ceiling_texture_ids), &memory->tiers);
+
+        world->wall_lines       = arenaTake(arena, world->num_walls * sizeof(*world->wall_lines), &memory->walls);
+        world->wall_nexts       = arenaTake(arena, world->num_walls * sizeof(*world->wall_nexts), &memory->walls);
+        world->wall_is_skys     = arenaTake(arena, world->num_walls * sizeof(*world->wall_is_skys), &memory->walls);
+        world->wall_texture_ids = arenaTake(arena, world->num_walls * sizeof(*world->wall_texture_ids), &memory->walls);
+    } else {
+        memory->tiers = num_tiers * (sizeof(*o_tiers->floor_heights) + sizeof(*o_tiers->ceiling_heights) + sizeof(*o_tiers->is_skys) +
+                                     sizeof(*o_tiers->floor_texture_ids) + sizeof(*o_tiers->ceiling_texture_ids));
+        memory->walls = world->num_walls * (sizeof(*world->wall_lines) + sizeof(*world->wall_nexts) + sizeof(*world->wall_is_skys) +
+                                            sizeof(*world->wall_texture_ids));
+        memory->mapped = world->mapping_size;
+    }
+
+    world->wall_geometry = arenaTake(arena, world->num_walls * sizeof(*world->wall_geometry), &memory->derived);
+    world->vertices      = arenaTake(arena, world->num_vertices * sizeof(*world->vertices), &memory->derived);
+    world->wall_vertices = arenaTake(arena, world->num_walls * 2 * sizeof(*world->wall_vertices), &memory->derived);
+    world->portals       = arenaTake(arena, world->num_portals * sizeof(*world->portals), &memory->derived);
+
+    world->vertex_wall_starts = arenaTake(arena, (world->num_vertices + 1) * sizeof(*world->vertex_wall_starts), &memory->derived);
+    world->vertex_walls       = arenaTake(arena, world->num_walls * 2 * sizeof(*world->vertex_walls), &memory->derived);
+
+    SectorGrid *grid   = &world->sector_grid;
+    grid->cell_starts  = arenaTake(arena, ((size_t)grid->width * grid->height + 1) * sizeof(*grid->cell_starts), &memory->derived);
+    grid->cell_sectors = arenaTake(arena, grid->capacity * sizeof(*grid->cell_sectors), &memory->derived);
+
+    // baked sets are only in worlds with a nonzero size
+    SectorVisibility *visibility = &world->visibility;
+    if (visibility->size == 0) {
+        visibility->offsets = NULL;
+        visibility->data    = NULL;
+    } else if (world->mapping == NULL) {
+        visibility->offsets = arenaTake(arena, (world->num_sectors + 1) * sizeof(*visibility->offsets), &memory->visibility);
+        visibility->data    = arenaTake(arena, visibility->size, &memory->visibility);
+    } else {
+        memory->visibility = (world->num_sectors + 1) * sizeof(*visibility->offsets) + visibility->size;
+    }
+}
+
+// worlds are loaded on the reload thread as well, and a freed world's arena can come back at the same address
+static unsigned nextWorldGeneration(void) {
+    static atomic_uint next_generation = 1;
+    return atomic_fetch_add(&next_generation, 1);
+}
+
+// num_sectors, num_walls, num_vertices, num_portals, the sector grid's size, the visibility size and mapping must be set,
+// the arrays are assigned from the arena
+static bool allocateWorldArena(PortalWorld *world, unsigned num_tiers, TierArrays *o_tiers) {
+    WorldArena arena = { .base = NULL, .used = 0 };
+    layoutWorldArena(world, &arena, num_tiers, o_tiers);
+
+    arena.base = malloc(max(arena.used, 1));
+    if (arena.base == NULL) return false;
+
+    world->arena      = arena.base;
+    world->generation = nextWorldGeneration();
+    arena.used        = 0;
+    layoutWorldArena(world, &arena, num_tiers, o_tiers);
+    world->memory.allocated = arena.used;
+
+    return true;
+}
+
+// murmur3's 64 bit finalizer, every input bit reaches the low bits the table is indexed by. Map
+// coordinates are mostly small integers, whose float bits differ only near the top.
+static uint64_t mixPointBits(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Wall endpoints are welded into one vertex when they are bitwise equal, which is how map files
+// write a shared corner. Vertices are numbered in order of first use.
+static bool weldVertices(const Line *lines, unsigned num_walls, unsigned **o_wall_vertices, unsigned *o_num_vertices) {
+    const unsigned EMPTY = ~0u;
+
+    size_t num_points = (size_t)num_walls * 2;
+    size_t table_size = 16;
+    while (table_size < num_points * 2) table_size <<= 1;
+
+    unsigned *table         = malloc(table_size * sizeof(*table));
+    unsigned *wall_vertices = malloc(max(num_points, 1) * sizeof(*wall_vertices));
+    if (table == NULL || wall_vertices == NULL) {
+        free(table);
+        free(wall_vertices);
+        return false;
+    }
+    memset(table, 0xFF, table_size * sizeof(*table));
+
+    unsigned num_vertices = 0;
+    for (size_t p = 0; p < num_points; ++p) {
+        const float *point = lines[p / 2].points[p % 2];
+
+        // adding zero folds -0 into 0 so both hash alike
+        float x = point[0] + 0.0f, y = point[1] + 0.0f;
+        uint32_t xb, yb;
+        memcpy(&xb, &x, sizeof(xb));
+        memcpy(&yb, &y, sizeof(yb));
+
+        size_t slot = mixPointBits(((uint64_t)xb << 32) | yb) & (table_size - 1);
+        while (table[slot] != EMPTY) {
+            const float *other = lines[table[slot] / 2].points[table[slot] % 2];
+            if (other[0] == point[0] && other[1] == point[1]) break;
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot] == EMPTY) {
+            table[slot]      = p;
+            wall_vertices[p] = num_vertices++;
+        } else {
+            wall_vertices[p] = wall_vertices[table[slot]];
+        }
+    }
+
+    free(table);
+    *o_wall_vertices = wall_vertices;
+    *o_num_vertices  = num_vertices;
+    return true;
+}
+
+// a portal is a wall leading to another valid sector
+static bool isPortal(unsigned wall_next, unsigned sector_index, unsigned num_sectors) {
+    return wall_next < num_sectors && wall_next != sector_index;
+}
+
+static unsigned countPortals(const SectorRecord *records, unsigned num_sectors, const unsigned *wall_nexts) {
+    unsigned num_portals = 0;
+    for (unsigned i = 0; i < num_sectors; ++i) {
+        for (unsigned k = records[i].start; k < records[i].start + records[i].length; ++k) {
+            num_portals += isPortal(wall_nexts[k], i, num_sectors);
+        }
+    }
+    return num_portals;
+}
+
+// sectors overlapping more cells than this on average get a single cell, which is a linear scan
+#define MAX_SECTOR_GRID_ENTRIES_PER_SECTOR 64
+
+// room for sectors to grow into more cells as their vertices move, one entry in this many extra
+#define SECTOR_GRID_SLACK 16
+
+// the cell a coordinate falls in along one axis, points outside the grid use its border cells
+static unsigned gridCell(float v, float origin, float cell_size, unsigned count) {
+    float c = (v - origin) / cell_size;
+    if (!(c >= 0.0f)) return 0;
+    if (c >= (float)(count - 1)) return count - 1;
+    return (unsigned)c;
+}
+
+// cells covered by the bounds of a sector's walls, false for sectors without any
+static bool sectorCellRange(const SectorGrid *grid, const Line *lines, unsigned start, unsigned length, unsigned o_lo[2],
+                            unsigned o_hi[2]) {
+    if (length == 0) return false;
+
+    o_lo[0] = o_lo[1] = ~0u;
+    o_hi[0] = o_hi[1] = 0;
+    for (unsigned i = start; i < start + length; ++i) {
+        for (unsigned k = 0; k < 2; ++k) {
+            unsigned x = gridCell(lines[i].points[k][0], grid->origin[0], grid->cell_size, grid->width);
+            unsigned y = gridCell(lines[i].points[k][1], grid->origin[1], grid->cell_size, grid->height);
+            o_lo[0]    = min(o_lo[0], x);
+            o_lo[1]    = min(o_lo[1], y);
+            o_hi[0]    = max(o_hi[0], x);
+            o_hi[1]    = max(o_hi[1], y);
+        }
+    }
+    return true;
+}
+
+// sizes the grid from where the walls will be once loaded, buildSectorGrid fills it
+static void planSectorGrid(SectorGrid *o_grid, const SectorRecord *records, unsigned num_sectors, const Line *lines,
+                           unsigned num_walls) {
+    vec2 lo = { 0.0f, 0.0f }, hi = { 0.0f, 0.0f };
+    for (unsigned i = 0; i < num_walls; ++i) {
+        for (unsigned k = 0; k < 2; ++k) {
+            for (unsigned a = 0; a < 2; ++a) {
+                float v = lines[i].points[k][a];
+                lo[a]   = i == 0 && k == 0 ? v : min(lo[a], v);
+                hi[a]   = i == 0 && k == 0 ? v : max(hi[a], v);
+            }
+        }
+    }
+
+    // about one cell per sector, long thin maps are held to at most four per sector on a side
+    float width     = hi[0] - lo[0];
+    float height    = hi[1] - lo[1];
+    float n         = max(num_sectors, 1);
+    float cell_size = max(sqrtf(width * height / n), max(width, height) / (4.0f * n));
+
+    memset(o_grid, 0, sizeof(*o_grid));
+    o_grid->origin[0] = lo[0];
+    o_grid->origin[1] = lo[1];
+    o_grid->cell_size = 1.0f;
+    o_grid->width     = 1;
+    o_grid->height    = 1;
+    if (cell_size > 0.0f && isfinite(cell_size)) {
+        o_grid->cell_size = cell_size;
+        o_grid->width     = (unsigned)(width / cell_size) + 1;
+        o_grid->height    = (unsigned)(height / cell_size) + 1;
+    }
+
+    uint64_t num_entries = 0;
+    for (unsigned i = 0; i < num_sectors; ++i) {
+        unsigned cell_lo[2], cell_hi[2];
+        if (!sectorCellRange(o_grid, lines, records[i].start, records[i].length, cell_lo, cell_hi)) continue;
+        num_entries += (uint64_t)(cell_hi[0] - cell_lo[0] + 1) * (cell_hi[1] - cell_lo[1] + 1);
+    }
+
+    // sectors piled on top of each other, which the grid cannot tell apart anyway
+    if (num_entries > (uint64_t)MAX_SECTOR_GRID_ENTRIES_PER_SECTOR * n) {
+        o_grid->width  = 1;
+        o_grid->height = 1;
+        num_entries    = 0;
+        for (unsigned i = 0; i < num_sectors; ++i) {
+            num_entries += records[i].length > 0;
+        }
+    }
+    o_grid->num_entries = num_entries;
+    o_grid->capacity    = num_entries + num_entries / SECTOR_GRID_SLACK + SECTOR_GRID_SLACK;
+}
+
+// counting sort of the sectors into the cells their bounds overlap, false if they do not fit
+static bool buildSectorGrid(PortalWorld *world) {
+    SectorGrid *grid   = &world->sector_grid;
+    unsigned num_cells = grid->width * grid->height;
+    memset(grid->cell_starts, 0, (num_cells + 1) * sizeof(*grid->cell_starts));
+
+    for (unsigned pass = 0; pass < 2; ++pass) {
+        for (unsigned i = 0; i < world->num_sectors; ++i) {
+            SectorDef sector = world->sectors[i];
+            unsigned lo[2], hi[2];
+            if (!sectorCellRange(grid, world->wall_lines, sector.start, sector.length, lo, hi)) continue;
+
+            for (unsigned y = lo[1]; y <= hi[1]; ++y) {
+                for (unsigned x = lo[0]; x <= hi[0]; ++x) {
+                    unsigned cell = y * grid->width + x;
+                    if (pass == 0) {
+                        ++grid->cell_starts[cell + 1];
+                    } else {
+                        grid->cell_sectors[grid->cell_starts[cell]++] = i;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (unsigned c = 0; c < num_cells; ++c) {
+                grid->cell_starts[c + 1] += grid->cell_starts[c];
+            }
+            if (grid->cell_starts[num_cells] > grid->capacity) return false;
+            grid->num_entries = grid->cell_starts[num_cells];
+        }
+    }
+
+    // filling advanced each start to the next cell's
+    memmove(grid->cell_starts + 1, grid->cell_starts, num_cells * sizeof(*grid->cell_starts));
+    grid->cell_starts[0] = 0;
+    grid->stale          = false;
+    return true;
+}
+
+// A moved sector's old cells may still list it, which lookups weed out, but every cell it overlaps
+// now has to. Most moves stay within the cells the sector had, otherwise the grid is built again,
+// with coarser cells if the sectors have grown out of its room. A single cell always fits.
+static void regridSector(PortalWorld *world, unsigned sector_index) {
+    SectorGrid *grid = &world->sector_grid;
+    if (grid->cell_starts == NULL || grid->stale) return;
+
+    SectorDef sector = world->sectors[sector_index];
+    unsigned lo[2], hi[2];
+    if (!sectorCellRange(grid, world->wall_lines, sector.start, sector.length, lo, hi)) return;
+
+    for (unsigned y = lo[1]; y <= hi[1]; ++y) {
+        for (unsigned x = lo[0]; x <= hi[0]; ++x) {
+            unsigned cell = y * grid->width + x;
+            bool listed   = false;
+            for (unsigned i = grid->cell_starts[cell]; i < grid->cell_starts[cell + 1] && !listed; ++i) {
+                listed = grid->cell_sectors[i] == sector_index;
+            }
+            if (!listed) {
+                while (!buildSectorGrid(world)) {
+                    grid->cell_size *= 2.0f;
+                    grid->width  = (grid->width + 1) / 2;
+                    grid->height = (grid->height + 1) / 2;
+                }
+                return;
+            }
+        }
+    }
+}
+
+// allocates a world whose file data is known but not yet in the arena, sizing the derived data
+static bool allocateLoadedWorld(PortalWorld *world, const SectorRecord *records, unsigned num_tiers, const Line *lines,
+                                const unsigned *wall_nexts, TierArrays *o_tiers) {
+    world->num_portals = countPortals(records, world->num_sectors, wall_nexts);
+
+    unsigned *wall_vertices;
+    if (!weldVertices(lines, world->num_walls, &wall_vertices, &world->num_vertices)) return false;
+    planSectorGrid(&world->sector_grid, records, world->num_sectors, lines, world->num_walls);
+
+    if (!allocateWorldArena(world, num_tiers, o_tiers)) {
+        free(wall_vertices);
+        return false;
+    }
+
+    memcpy(world->wall_vertices, wall_vertices, world->num_walls * 2 * sizeof(*wall_vertices));
+    free(wall_vertices);
+    return true;
+}
+
+static void assignSectors(PortalWorld *world, const SectorRecord *records, TierArrays tiers) {
+    for (unsigned i = 0; i < world->num_sectors; ++i) {
+        SectorRecord record = records[i];
+        SectorDef *sector   = &world->sectors[i];
+
+        sector->start               = record.start;
+        sector->length              = record.length;
+        sector->num_tiers           = record.num_tiers;
+        sector->floor_heights       = tiers.floor_heights + record.first_tier;
+        sector->ceiling_heights     = tiers.ceiling_heights + record.first_tier;
+        sector->is_skys             = tiers.is_skys + record.first_tier;
+        sector->floor_texture_ids   = tiers.floor_texture_ids + record.first_tier;
+        sector->ceiling_texture_ids = tiers.ceiling_texture_ids + record.first_tier;
+    }
+}
+
+static void computeWallGeometry(PortalWorld *world, unsigned wall_index) {
+    Line line          = world->wall_lines[wall_index];
+    WallGeometry *geom = &world->wall_geometry[wall_index];
+    vec2 d             = { line.points[1][0] - line.points[0][0], line.points[1][1] - line.points[0][1] };
+    float length       = sqrtf(dot2d(d, d));
+    float inv_length   = length != 0.0f ? 1.0f / length : 0.0f;
+
+    geom->dir[0]     = d[0] * inv_length;
+    geom->dir[1]     = d[1] * inv_length;
+    geom->normal[0]  = -geom->dir[1];
+    geom->normal[1]  = geom->dir[0];
+    geom->length     = length;
+    geom->inv_length = inv_length;
+    geom->plane      = dot2d(geom->normal, line.points[0]);
+    geom->pad        = 0.0f;
+}
+
+// Portals are listed per sector in wall order. The twin is the neighbor's wall back across the
+// same welded edge, walls that only partly overlap their neighbor's have none.
+static void buildPortals(PortalWorld *world) {
+    unsigned num_portals = 0;
+    for (unsigned i = 0; i < world->num_sectors; ++i) {
+        SectorDef *sector    = &world->sectors[i];
+        sector->first_portal = num_portals;
+
+        for (unsigned k = sector->start; k < sector->start + sector->length; ++k) {
+            if (!isPortal(world->wall_nexts[k], i, world->num_sectors)) continue;
+            world->portals[num_portals++] = (Portal){ .wall = k, .sector = world->wall_nexts[k], .twin = INVALID_WALL_INDEX };
+        }
+
+        sector->num_portals = num_portals - sector->first_portal;
+    }
+    assert(num_portals == world->num_portals);
+
+    for (unsigned i = 0; i < world->num_sectors; ++i) {
+        SectorDef sector = world->sectors[i];
+
+        for (unsigned p = sector.first_portal; p < sector.first_portal + sector.num_portals; ++p) {
+            Portal *portal = &world->portals[p];
+            SectorDef next = world->sectors[portal->sector];
+            unsigned *edge = &world->wall_vertices[portal->wall * 2];
+
+            for (unsigned q = next.first_portal; q < next.first_portal + next.num_portals; ++q) {
+                Portal back    = world->portals[q];
+                unsigned *twin = &world->wall_vertices[back.wall * 2];
+                if (back.sector == i && twin[0] == edge[1] && twin[1] == edge[0]) {
+                    portal->twin = back.wall;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// Convex sectors wind once around their inside, turning left or going straight at every corner.
+// Walls that do not close into a loop make a sector concave, validateWorld reports those.
+static bool isConvexLoop(const Line *lines, unsigned num_lines) {
+    if (num_lines < 3) return false;
+
+    float turning = 0.0f;
+    for (unsigned i = 0; i < num_lines; ++i) {
+        Line a = lines[i];
+        Line b = lines[(i + 1) % num_lines];
+        if (a.points[1][0] != b.points[0][0] || a.points[1][1] != b.points[0][1]) return false;
+
+        vec2 da     = { a.points[1][0] - a.points[0][0], a.points[1][1] - a.points[0][1] };
+        vec2 db     = { b.points[1][0] - b.points[0][0], b.points[1][1] - b.points[0][1] };
+        float cross = da[0] * db[1] - da[1] * db[0];
+        if (cross < 0.0f) return false;
+
+        turning += atan2f(cross, dot2d(da, db));
+    }
+
+    // a star of left turns winds more than once
+    return fabsf(turning - 2.0f * (float)M_PI) < 1e-3f;
+}
+
+static void classifySector(PortalWorld *world, unsigned sector_index) {
+    SectorDef *sector = &world->sectors[sector_index];
+    sector->is_convex = isConvexLoop(&world->wall_lines[sector->start], sector->length);
+}
+
+// The wall ends at each vertex in wall order, which mostly puts a sector's two walls at a corner
+// next to each other. Sectors are filled in afterwards, a wall can be in none.
+static void buildVertexWalls(PortalWorld *world) {
+    unsigned *starts = world->vertex_wall_starts;
+    memset(starts, 0, (world->num_vertices + 1) * sizeof(*starts));
+    for (unsigned k = 0; k < world->num_walls * 2; ++k) {
+        ++starts[world->wall_vertices[k] + 1];
+    }
+    for (unsigned v = 0; v < world->num_vertices; ++v) {
+        starts[v + 1] += starts[v];
+    }
+
+    for (unsigned k = 0; k < world->num_walls * 2; ++k) {
+        world->vertex_walls[starts[world->wall_vertices[k]]++] = (VertexWall){ .wall_end = k, .sector = INVALID_SECTOR_INDEX };
+    }
+
+    // filling advanced each start to the next vertex's
+    memmove(starts + 1, starts, world->num_vertices * sizeof(*starts));
+    starts[0] = 0;
+
+    for (unsigned i = 0; i < world->num_sectors; ++i) {
+        SectorDef sector = world->sectors[i];
+        for (unsigned k = sector.start * 2; k < (sector.start + sector.length) * 2; ++k) {
+            unsigned v = world->wall_vertices[k];
+            for (unsigned e = starts[v]; e < starts[v + 1]; ++e) {
+                if (world->vertex_walls[e].wall_end == k) world->vertex_walls[e].sector = i;
+            }
+        }
+    }
+}
+
+// fills everything derived from the file data, once the walls are in place and welded
+static void computeDerivedData(PortalWorld *world) {
+    for (unsigned i = 0; i < world->num_walls; ++i) {
+        computeWallGeometry(world, i);
+
+        for (unsigned k = 0; k < 2; ++k) {
+            float *vertex = world->vertices[world->wall_vertices[i * 2 + k]];
+            vertex[0]     = world->wall_lines[i].points[k][0];
+            vertex[1]     = world->wall_lines[i].points[k][1];
+        }
+    }
+
+    buildPortals(world);
+    buildVertexWalls(world);
+
+    for (unsigned i = 0; i < world->num_sectors; ++i) {
+        classifySector(world, i);
+    }
+
+    buildSectorGrid(world);
+}
+
+static void moveWallEnd(PortalWorld *world, unsigned wall_end, vec2 pos) {
+    world->wall_lines[wall_end / 2].points[wall_end % 2][0] = pos[0];
+    world->wall_lines[wall_end / 2].points[wall_end % 2][1] = pos[1];
+    computeWallGeometry(world, wall_end / 2);
+}
+
+// every wall using the vertex follows it, which keeps shared corners closed
+void moveVertex(PortalWorld *world, unsigned vertex_index, vec2 pos) {
+    assert(vertex_index < world->num_vertices);
+
+    // a sector's cells are those of its vertices, so they only change when a vertex changes cell
+    SectorGrid *grid = &world->sector_grid;
+    float *vertex    = world->vertices[vertex_index];
+    bool moved_cell  = grid->cell_starts != NULL &&
+                      (gridCell(vertex[0], grid->origin[0], grid->cell_size, grid->width) != gridCell(pos[0], grid->origin[0], grid->cell_size, grid->width) ||
+                       gridCell(vertex[1], grid->origin[1], grid->cell_size, grid->height) != gridCell(pos[1], grid->origin[1], grid->cell_size, grid->height));
+    world->visibility.stale = true;
+    world->edits++;
+    world->wall_edits++;
+
+    world->vertices[vertex_index][0] = pos[0];
+    world->vertices[vertex_index][1] = pos[1];
+
+    if (world->vertex_walls != NULL) {
+        const VertexWall *first = &world->vertex_walls[world->vertex_wall_starts[vertex_index]];
+        const VertexWall *end   = &world->vertex_walls[world->vertex_wall_starts[vertex_index + 1]];
+        for (const VertexWall *it = first; it != end; ++it) {
+            moveWallEnd(world, it->wall_end, pos);
+        }
+
+        // moving a corner can change whether its sectors are convex, and which cells they overlap
+        unsigned last_sector = INVALID_SECTOR_INDEX;
+        for (const VertexWall *it = first; it != end; ++it) {
+            if (it->sector != INVALID_SECTOR_INDEX && it->sector != last_sector) {
+                classifySector(world, it->sector);
+                if (moved_cell) regridSector(world, it->sector);
+            }
+            last_sector = it->sector;
+        }
+        return;
+    }
+
+    // The grid of a paged world comes from its file and cannot be built again, the sectors that
+    // are not resident having no walls to bucket.
+    if (moved_cell) grid->stale = true;
+
+    // paged worlds leave out the walls at each vertex, most of their sectors not being resident
+    for (unsigned k = 0; k < world->num_walls * 2; ++k) {
+        if (world->wall_vertices[k] == vertex_index) moveWallEnd(world, k, pos);
+    }
+
+    // moving a corner can change whether its sectors are convex
+    for (unsigned i = 0; i < world->num_sectors; ++i) {
+        SectorDef sector = world->sectors[i];
+        for (unsigned k = sector.start * 2; k < (sector.start + sector.length) * 2; ++k) {
+            if (world->wall_vertices[k] != vertex_index) continue;
+            classifySector(world, i);
+            break;
+        }
+    }
+}
+
+// moves the wall's vertices, dragging the walls that share them along
+void setWallLine(PortalWorld *world, unsigned wall_index, Line line) {
+    assert(wall_index < world->num_walls);
+    moveVertex(world, world->wall_vertices[wall_index * 2 + 0], line.points[0]);
+    moveVertex(world, world->wall_vertices[wall_index * 2 + 1], line.points[1]);
+}
+
+void setSectorHeights(PortalWorld *world, unsigned sector_index, unsigned tier, float floor, float ceiling) {
+    assert(sector_index < world->num_sectors);
+    assert(tier < world->sectors[sector_index].num_tiers);
+
+    world->sectors[sector_index].floor_heights[tier]   = floor;
+    world->sectors[sector_index].ceiling_heights[tier] = ceiling;
+    world->edits++;
+}
+
+void freeWorld(PortalWorld world) {
+    if (world.mapping != NULL) unmapFile(world.mapping, world.mapping_size);
+    free(world.arena);
+}
+
+WorldMemory getWorldMemory(PortalWorld world) {
+    return world.memory;
+}
+
+// the copy is always a plain allocated world, even when the source is mapped
+bool copyWorld(PortalWorld world, PortalWorld *o_world) {
+    assert(o_world != NULL);
+
+    unsigned num_tiers = 0;
+    for (unsigned i = 0; i < world.num_sectors; ++i) {
+        num_tiers += world.sectors[i].num_tiers;
+    }
+
+    memset(o_world, 0, sizeof(*o_world));
+    o_world->num_sectors  = world.num_sectors;
+    o_world->num_walls    = world.num_walls;
+    o_world->num_vertices = world.num_vertices;
+    o_world->num_portals  = world.num_portals;
+    o_world->sector_grid  = world.sector_grid;
+    o_world->visibility   = world.visibility;
+
+    TierArrays tiers;
+    if (!allocateWorldArena(o_world, num_tiers, &tiers)) {
+        printf("ERROR: Out of memory copying world\n");
+        memset(o_world, 0, sizeof(*o_world));
+        return false;
+    }
+
+    memcpy(o_world->wall_lines, world.wall_lines, world.num_walls * sizeof(*world.wall_lines));
+    memcpy(o_world->wall_nexts, world.wall_nexts, world.num_walls * sizeof(*world.wall_nexts));
+    memcpy(o_world->wall_is_skys, world.wall_is_skys, world.num_walls * sizeof(*world.wall_is_skys));
+    memcpy(o_world->wall_texture_ids, world.wall_texture_ids, world.num_walls * sizeof(*world.wall_texture_ids));
+    memcpy(o_world->wall_geometry, world.wall_geometry, world.num_walls * sizeof(*world.wall_geometry));
+    memcpy(o_world->vertices, world.vertices, world.num_vertices * sizeof(*world.vertices));
+    memcpy(o_world->wall_vertices, world.wall_vertices, world.num_walls * 2 * sizeof(*world.wall_vertices));
+    memcpy(o_world->portals, world.portals, world.num_portals * sizeof(*world.portals));
+
+    SectorGrid grid = world.sector_grid;
+    memcpy(o_world->sector_grid.cell_starts, grid.cell_starts, ((size_t)grid.width * grid.height + 1) * sizeof(*grid.cell_starts));
+    memcpy(o_world->sector_grid.cell_sectors, grid.cell_sectors, grid.num_entries * sizeof(*grid.cell_sectors));
+
+    if (world.visibility.size > 0) {
+        memcpy(o_world->visibility.offsets, world.visibility.offsets, (world.num_sectors + 1) * sizeof(*world.visibility.offsets));
+        memcpy(o_world->visibility.data, world.visibility.data, world.visibility.size);
+    }
+
+    unsigned first_tier = 0;
+    for (unsigned i = 0; i < world.num_sectors; ++i) {
+        SectorDef sector = world.sectors[i];
+        SectorDef *copy  = &o_world->sectors[i];
+
+        copy->start               = sector.start;
+        copy->length              = sector.length;
+        copy->num_tiers           = sector.num_tiers;
+        copy->first_portal        = sector.first_portal;
+        copy->num_portals         = sector.num_portals;
+        copy->is_convex           = sector.is_convex;
+        copy->floor_heights       = tiers.floor_heights + first_tier;
+        copy->ceiling_heights     = tiers.ceiling_heights + first_tier;
+        copy->is_skys             = tiers.is_skys + first_tier;
+        copy->floor_texture_ids   = tiers.floor_texture_ids + first_tier;
+        copy->ceiling_texture_ids = tiers.ceiling_texture_ids + first_tier;
+
+        memcpy(copy->floor_heights, sector.floor_heights, sector.num_tiers * sizeof(*sector.floor_heights));
+        memcpy(copy->ceiling_heights, sector.ceiling_heights, sector.num_tiers * sizeof(*sector.ceiling_heights));
+        memcpy(copy->is_skys, sector.is_skys, sector.num_tiers * sizeof(*sector.is_skys));
+        memcpy(copy->floor_texture_ids, sector.floor_texture_ids, sector.num_tiers * sizeof(*sector.floor_texture_ids));
+        memcpy(copy->ceiling_texture_ids, sector.ceiling_texture_ids, sector.num_tiers * sizeof(*sector.ceiling_texture_ids));
+
+        first_tier += sector.num_tiers;
+    }
+
+    // rebuilt rather than copied, as a paged source does not have them
+    buildVertexWalls(o_world);
+    return true;
+}
+
+//
+//      DIFFING
+//
+
+// Worlds with the same layout only differ in the contents of their sectors, so a reload can
+// copy the changed sectors into the live world instead of replacing it.
+
+static bool sameSectorGrid(SectorGrid a, SectorGrid b) {
+    return a.origin[0] == b.origin[0] && a.origin[1] == b.origin[1] && a.cell_size == b.cell_size && a.width == b.width &&
+           a.height == b.height && a.num_entries == b.num_entries &&
+           memcmp(a.cell_starts, b.cell_starts, ((size_t)a.width * a.height + 1) * sizeof(*a.cell_starts)) == 0 &&
+           memcmp(a.cell_sectors, b.cell_sectors, a.num_entries * sizeof(*a.cell_sectors)) == 0;
+}
+
+static bool sameVisibility(SectorVisibility a, SectorVisibility b, unsigned num_sectors) {
+    if (a.size != b.size) return false;
+    if (a.size == 0) return true;
+    return memcmp(a.offsets, b.offsets, (num_sectors + 1) * sizeof(*a.offsets)) == 0 && memcmp(a.data, b.data, a.size) == 0;
+}
+
+// welding, portals, the sector grid and the visible sets are part of the layout, so copying a changed sector
+// never moves a vertex another sector uses, changes the portal graph or leaves a sector in the wrong cells
+bool sameWorldLayout(PortalWorld a, PortalWorld b) {
+    if (a.num_sectors != b.num_sectors || a.num_walls != b.num_walls || a.num_vertices != b.num_vertices) return false;
+    if (memcmp(a.wall_vertices, b.wall_vertices, a.num_walls * 2 * sizeof(*a.wall_vertices)) != 0) return false;
+    if (memcmp(a.wall_nexts, b.wall_nexts, a.num_walls * sizeof(*a.wall_nexts)) != 0) return false;
+    if (!sameSectorGrid(a.sector_grid, b.sector_grid)) return false;
+    if (!sameVisibility(a.visibility, b.visibility, a.num_sectors)) return false;
+
+    for (unsigned i = 0; i < a.num_sectors; ++i) {
+        if (a.sectors[i].start != b.sectors[i].start ||
+            a.sectors[i].length != b.sectors[i].length ||
+            a.sectors[i].num_tiers != b.sectors[i].num_tiers) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// the worlds must share a layout
+bool sectorChanged(PortalWorld a, PortalWorld b, unsigned sector_index) {
+    SectorDef sa   = a.sectors[sector_index];
+    SectorDef sb   = b.sectors[sector_index];
+    unsigned start = sa.start;
+    unsigned n     = sa.length;
+    unsigned t     = sa.num_tiers;
+
+    return memcmp(sa.floor_heights, sb.floor_heights, t * sizeof(*sa.floor_heights)) != 0 ||
+           memcmp(sa.ceiling_heights, sb.ceiling_heights, t * sizeof(*sa.ceiling_heights)) != 0 ||
+           memcmp(sa.is_skys, sb.is_skys, t * sizeof(*sa.is_skys)) != 0 ||
+           memcmp(sa.floor_texture_ids, sb.floor_texture_ids, t * sizeof(*sa.floor_texture_ids)) != 0 ||
+           memcmp(sa.ceiling_texture_ids, sb.ceiling_texture_ids, t * sizeof(*sa.ceiling_texture_ids)) != 0 ||
+           memcmp(&a.wall_lines[start], &b.wall_lines[start], n * sizeof(*a.wall_lines)) != 0 ||
+           memcmp(&a.wall_nexts[start], &b.wall_nexts[start], n * sizeof(*a.wall_nexts)) != 0 ||
+           memcmp(&a.wall_is_skys[start], &b.wall_is_skys[start], n * sizeof(*a.wall_is_skys)) != 0 ||
+           memcmp(&a.wall_texture_ids[start], &b.wall_texture_ids[start], n * sizeof(*a.wall_texture_ids)) != 0;
+}
+
+// copies a sector's tiers and walls, the worlds must share a layout
+void copySector(PortalWorld *o_world, PortalWorld world, unsigned sector_index) {
+    SectorDef src  = world.sectors[sector_index];
+    SectorDef dst  = o_world->sectors[sector_index];
+    unsigned start = src.start;
+    unsigned n     = src.length;
+    unsigned t     = src.num_tiers;
+
+    memcpy(dst.floor_heights, src.floor_heights, t * sizeof(*src.floor_heights));
+    memcpy(dst.ceiling_heights, src.ceiling_heights, t * sizeof(*src.ceiling_heights));
+    memcpy(dst.is_skys, src.is_skys, t * sizeof(*src.is_skys));
+    memcpy(dst.floor_texture_ids, src.floor_texture_ids, t * sizeof(*src.floor_texture_ids));
+    memcpy(dst.ceiling_texture_ids, src.ceiling_texture_ids, t * sizeof(*src.ceiling_texture_ids));
+
+    memcpy(&o_world->wall_lines[start], &world.wall_lines[start], n * sizeof(*world.wall_lines));
+    memcpy(&o_world->wall_nexts[start], &world.wall_nexts[start], n * sizeof(*world.wall_nexts));
+    memcpy(&o_world->wall_is_skys[start], &world.wall_is_skys[start], n * sizeof(*world.wall_is_skys));
+    memcpy(&o_world->wall_texture_ids[start], &world.wall_texture_ids[start], n * sizeof(*world.wall_texture_ids));
+    memcpy(&o_world->wall_geometry[start], &world.wall_geometry[start], n * sizeof(*world.wall_geometry));
+    o_world->sectors[sector_index].is_convex = src.is_convex;
+    o_world->edits++;
+    o_world->wall_edits++;
+
+    for (unsigned i = start * 2; i < (start + n) * 2; ++i) {
+        unsigned v              = world.wall_vertices[i];
+        o_world->vertices[v][0] = world.vertices[v][0];
+        o_world->vertices[v][1] = world.vertices[v][1];
+    }
+
+    // the live grid may have been built again around moved vertices since
+    regridSector(o_world, sector_index);
+}
+
+//
+//      TEXT WORLDS
+//
+
+// The whole file is read once and tokenized in a single pass. Arrays are sized from the
+// SECTORS / WALLS headers and only grow (doubling) when a header undercounts.
+
+typedef struct MapReader {
+    const char *path;
+    const char *cur, *end;
+    const char *line_start;
+    unsigned line;
+} MapReader;
+
+static void readerError(MapReader *reader, const char *message) {
+    printf("ERROR:%s:%u:%u: %s\n", reader->path, reader->line, (unsigned)(reader->cur - reader->line_start) + 1, message);
+}
+
+static void skipBlanks(MapReader *reader) {
+    while (reader->cur < reader->end && (*reader->cur == ' ' || *reader->cur == '\t' || *reader->cur == '\r')) {
+        ++reader->cur;
+    }
+}
+
+// true at a newline, end of file or a trailing // comment
+static bool atLineEnd(MapReader *reader) {
+    skipBlanks(reader);
+    if (reader->cur >= reader->end || *reader->cur == '\n') return true;
+    return reader->cur[0] == '/' && reader->cur + 1 < reader->end && reader->cur[1] == '/';
+}
+
+static void nextLine(MapReader *reader) {
+    const char *newline = memchr(reader->cur, '\n', reader->end - reader->cur);
+    reader->cur         = newline != NULL ? newline + 1 : reader->end;
+    reader->line_start  = reader->cur;
+    ++reader->line;
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static unsigned readWord(MapReader *reader, const char **o_word) {
+    skipBlanks(reader);
+    *o_word = reader->cur;
+    while (reader->cur < reader->end && *reader->cur > ' ') {
+        ++reader->cur;
+    }
+    return reader->cur - *o_word;
+}
+
+static bool wordIs(const char *word, unsigned length, const char *directive) {
+    return strlen(directive) == length && memcmp(word, directive, length) == 0;
+}
+
+static bool readUnsigned(MapReader *reader, unsigned *o_value) {
+    skipBlanks(reader);
+
+    const char *c = reader->cur;
+    uint64_t value = 0;
+    if (c >= reader->end || !isDigit(*c)) return false;
+
+    while (c < reader->end && isDigit(*c)) {
+        value = value * 10 + (*c - '0');
+        if (value > UINT32_MAX) return false;
+        ++c;
+    }
+
+    reader->cur = c;
+    *o_value    = (unsigned)value;
+    return true;
+}
+
+static bool readFloat(MapReader *reader, float *o_value) {
+    // exactly representable powers of ten, so mantissa * 10^e rounds once
+    static const float POW10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+    skipBlanks(reader);
+
+    const char *c        = reader->cur;
+    bool negative        = false;
+    uint64_t mantissa    = 0;
+    int exponent         = 0;
+    unsigned digits      = 0;
+    unsigned significant = 0; // digits in mantissa, leading zeros do not count
+
+    if (c < reader->end && (*c == '-' || *c == '+')) {
+        negative = *c == '-';
+        ++c;
+    }
+
+    for (; c < reader->end && isDigit(*c); ++c, ++digits) {
+        if (significant < 19) {
+            mantissa = mantissa * 10 + (*c - '0');
+            if (mantissa != 0) ++significant;
+        } else {
+            ++exponent;
+        }
+    }
+
+    if (c < reader->end && *c == '.') {
+        ++c;
+        for (; c < reader->end && isDigit(*c); ++c, ++digits) {
+            if (significant < 19) {
+                mantissa = mantissa * 10 + (*c - '0');
+                if (mantissa != 0) ++significant;
+                --exponent;
+            }
+        }
+    }
+
+    if (digits == 0) return false;
+
+    if (c < reader->end && (*c == 'e' || *c == 'E')) {
+        const char *e      = c + 1;
+        bool exp_negative  = false;
+        int exp_value      = 0;
+        if (e < reader->end && (*e == '-' || *e == '+')) {
+            exp_negative = *e == '-';
+            ++e;
+        }
+        if (e < reader->end && isDigit(*e)) {
+            for (; e < reader->end && isDigit(*e); ++e) {
+                if (exp_value < 10000) exp_value = exp_value * 10 + (*e - '0');
+            }
+            exponent += exp_negative ? -exp_value : exp_value;
+            c = e;
+        }
+    }
+
+    // both operands are exact floats, so this rounds once, as strtof does
+    if (mantissa < ((uint64_t)1 << 24) && exponent >= -10 && exponent <= 10) {
+        float value = exponent < 0 ? (float)mantissa / POW10[-exponent] : (float)mantissa * POW10[exponent];
+        reader->cur = c;
+        *o_value    = negative ? -value : value;
+        return true;
+    }
+
+    // Rare long or extreme literal, let the C library get it exactly right. The text ends in a nul
+    // at reader->end, so strtof stops there at the latest.
+    char *end   = NULL;
+    float value = strtof(reader->cur, &end);
+    if (end != c) return false;
+
+    reader->cur = c;
+    *o_value    = value;
+    return true;
+}
+
+// parsed into growable arrays first, then copied into the world's arena once the sizes are known
+typedef struct TextWorld {
+    SectorRecord *sectors;
+    unsigned num_sectors, sector_capacity;
+
+    TierArrays tiers;
+    unsigned num_tiers, tier_capacity;
+
+    Line *wall_lines;
+    unsigned *wall_nexts;
+    bool *wall_is_skys;
+    unsigned *wall_texture_ids;
+    unsigned num_walls, wall_capacity;
+} TextWorld;
+
+static bool growArray(void *array, size_t elem_size, unsigned capacity) {
+    void *grown = realloc(*(void **)array, capacity * elem_size);
+    if (grown == NULL) return false;
+    *(void **)array = grown;
+    return true;
+}
+
+static bool reserveSectors(TextWorld *text, unsigned count) {
+    if (count <= text->sector_capacity) return true;
+
+    unsigned capacity = max(count, text->sector_capacity * 2);
+    if (!growArray(&text->sectors, sizeof(*text->sectors), capacity)) return false;
+
+    text->sector_capacity = capacity;
+    return true;
+}
+
+static bool reserveTiers(TextWorld *text, unsigned count) {
+    if (count <= text->tier_capacity) return true;
+
+    unsigned capacity = max(count, text->tier_capacity * 2);
+    if (!growArray(&text->tiers.floor_heights, sizeof(*text->tiers.floor_heights), capacity) ||
+        !growArray(&text->tiers.ceiling_heights, sizeof(*text->tiers.ceiling_heights), capacity) ||
+        !growArray(&text->tiers.is_skys, sizeof(*text->tiers.is_skys), capacity) ||
+        !growArray(&text->tiers.floor_texture_ids, sizeof(*text->tiers.floor_texture_ids), capacity) ||
+        !growArray(&text->tiers.ceiling_texture_ids, sizeof(*text->tiers.ceiling_texture_ids), capacity)) return false;
+
+    text->tier_capacity = capacity;
+    return true;
+}
+
+static bool reserveWalls(TextWorld *text, unsigned count) {
+    if (count <= text->wall_capacity) return true;
+
+    unsigned capacity = max(count, text->wall_capacity * 2);
+    if (!growArray(&text->wall_lines, sizeof(*text->wall_lines), capacity) ||
+        !growArray(&text->wall_nexts, sizeof(*text->wall_nexts), capacity) ||
+        !growArray(&text->wall_is_skys, sizeof(*text->wall_is_skys), capacity) ||
+        !growArray(&text->wall_texture_ids, sizeof(*text->wall_texture_ids), capacity)) return false;
+
+    text->wall_capacity = capacity;
+    return true;
+}
+
+static void freeTextWorld(TextWorld *text) {
+    free(text->sectors);
+    free(text->tiers.floor_heights);
+    free(text->tiers.ceiling_heights);
+    free(text->tiers.is_skys);
+    free(text->tiers.floor_texture_ids);
+    free(text->tiers.ceiling_texture_ids);
+    free(text->wall_lines);
+    free(text->wall_nexts);
+    free(text->wall_is_skys);
+    free(text->wall_texture_ids);
+}
+
+// copies complete file data into a new world's arena and derives the rest
+static bool buildWorld(PortalWorld *o_world, const TextWorld *text) {
+    memset(o_world, 0, sizeof(*o_world));
+    o_world->num_sectors = text->num_sectors;
+    o_world->num_walls   = text->num_walls;
+
+    TierArrays tiers;
+    if (!allocateLoadedWorld(o_world, text->sectors, text->num_tiers, text->wall_lines, text->wall_nexts, &tiers)) {
+        memset(o_world, 0, sizeof(*o_world));
+        return false;
+    }
+
+    memcpy(tiers.floor_heights, text->tiers.floor_heights, text->num_tiers * sizeof(*tiers.floor_heights));
+    memcpy(tiers.ceiling_heights, text->tiers.ceiling_heights, text->num_tiers * sizeof(*tiers.ceiling_heights));
+    memcpy(tiers.is_skys, text->tiers.is_skys, text->num_tiers * sizeof(*tiers.is_skys));
+    memcpy(tiers.floor_texture_ids, text->tiers.floor_texture_ids, text->num_tiers * sizeof(*tiers.floor_texture_ids));
+    memcpy(tiers.ceiling_texture_ids, text->tiers.ceiling_texture_ids, text->num_tiers * sizeof(*tiers.ceiling_texture_ids));
+
+    memcpy(o_world->wall_lines, text->wall_lines, text->num_walls * sizeof(*o_world->wall_lines));
+    memcpy(o_world->wall_nexts, text->wall_nexts, text->num_walls * sizeof(*o_world->wall_nexts));
+    memcpy(o_world->wall_is_skys, text->wall_is_skys, text->num_walls * sizeof(*o_world->wall_is_skys));
+    memcpy(o_world->wall_texture_ids, text->wall_texture_ids, text->num_walls * sizeof(*o_world->wall_texture_ids));
+
+    assignSectors(o_world, text->sectors, tiers);
+    computeDerivedData(o_world);
+
+    return true;
+}
+
+static char *readWholeFile(const char *path, size_t *o_size) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+
+    char *data = NULL;
+    long size  = -1;
+    if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+
+    if (size >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc(size + 1);
+        if (data != NULL && fread(data, 1, size, file) != (size_t)size) {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(file);
+    if (data == NULL) return NULL;
+
+    data[size] = '\0';
+    *o_size    = size;
+    return data;
+}
+
+bool loadWorldText(const char *path, PortalWorld *o_world, float scale) {
+    assert(path != NULL);
+    assert(o_world != NULL);
+
+    memset(o_world, 0, sizeof(*o_world));
+
+    size_t size;
+    char *data = readWholeFile(path, &size);
+    if (data == NULL) {
+        printf("ERROR: Failed to open %s\n", path);
+        return false;
+    }
+    printf("Opened %s\n", path);
+
+    MapReader reader = {
+        .path       = path,
+        .cur        = data,
+        .end        = data + size,
+        .line_start = data,
+        .line       = 1,
+    };
+
+    TextWorld text;
+    memset(&text, 0, sizeof(text));
+
+    unsigned version;
+
+    const char *word;
+    unsigned word_length;
+    unsigned unsigned_buff0;
+
+    enum state_e {
+        state_version,
+        state_open,
+        state_sectors,
+        state_walls,
+    } state = state_version;
+
+    while (reader.cur < reader.end) {
+        if (atLineEnd(&reader)) {
+            nextLine(&reader);
+            continue;
+        }
+
+        const char *line_data = reader.cur;
+
+        switch (state) {
+            case state_version:
+                word_length = readWord(&reader, &word);
+                if (!wordIs(word, word_length, "VERSION")) {
+                    reader.cur = line_data;
+                    readerError(&reader, "Expected first directive to be 'VERSION'");
+                    goto _fail;
+                }
+
+                if (!readUnsigned(&reader, &version)) {
+                    readerError(&reader, "'VERSION' expects one unsigned parameter");
+                    goto _fail;
+                }
+
+                if (version < MIN_WORLD_VERSION || version > MAX_WORLD_VERSION) {
+                    printf("ERROR:%s:%u: Version number of %u is not supported: min %u to max %u.\n", path, reader.line, version, MIN_WORLD_VERSION, MAX_WORLD_VERSION);
+                    goto _fail;
+                }
+
+                state = state_open;
+                break;
+                ///////////////////////////////////////////////////////////////////////////////////////////////////
+            case state_open:
+                word_length = readWord(&reader, &word);
+                if (wordIs(word, word_length, "SECTORS")) {
+                    if (!readUnsigned(&reader, &unsigned_buff0)) {
+                        readerError(&reader, "'SECTORS' expects one unsigned parameter");
+                        goto _fail;
+                    }
+
+                    // assume one tier per sector until told otherwise
+                    if (!reserveSectors(&text, text.num_sectors + unsigned_buff0) ||
+                        !reserveTiers(&text, text.num_tiers + unsigned_buff0)) {
+                        readerError(&reader, "Out of memory");
+                        goto _fail;
+                    }
+                    state = state_sectors;
+
+                } else if (wordIs(word, word_length, "WALLS")) {
+                    if (!readUnsigned(&reader, &unsigned_buff0)) {
+                        readerError(&reader, "'WALLS' expects one unsigned parameter");
+                        goto _fail;
+                    }
+
+                    if (!reserveWalls(&text, text.num_walls + unsigned_buff0)) {
+                        readerError(&reader, "Out of memory");
+                        goto _fail;
+                    }
+                    state = state_walls;
+
+                } else {
+                    reader.cur = line_data;
+                    readerError(&reader, "Unknown or unexpected directive");
+                    goto _fail;
+                }
+                break;
+                ///////////////////////////////////////////////////////////////////////////////////////////////////
+            case state_sectors: {
+                if (*reader.cur == 'E') {
+                    word_length = readWord(&reader, &word);
+                    if (wordIs(word, word_length, "END")) {
+                        state = state_open;
+                        break;
+                    }
+                    reader.cur = line_data;
+                }
+
+                if (!reserveSectors(&text, text.num_sectors + 1)) {
+                    readerError(&reader, "Out of memory");
+                    goto _fail;
+                }
+
+                SectorRecord *record = &text.sectors[text.num_sectors];
+                if (!readUnsigned(&reader, &record->start) ||
+                    !readUnsigned(&reader, &record->length) ||
+                    !readUnsigned(&reader, &record->num_tiers)) {
+                    readerError(&reader, "Ill-formed sector definition");
+                    goto _fail;
+                }
+
+                if (record->num_tiers < 1) {
+                    readerError(&reader, "Sectors require at least one tier");
+                    goto _fail;
+                }
+
+                record->first_tier = text.num_tiers;
+                if (!reserveTiers(&text, text.num_tiers + record->num_tiers)) {
+                    readerError(&reader, "Out of memory");
+                    goto _fail;
+                }
+
+                for (unsigned i = record->first_tier; i < record->first_tier + record->num_tiers; ++i) {
+                    skipBlanks(&reader);
+                    if (reader.cur >= reader.end || *reader.cur != '|') {
+                        readerError(&reader, "Expected '|' before sector tier definition");
+                        goto _fail;
+                    }
+                    ++reader.cur;
+
+                    if (!readFloat(&reader, &text.tiers.floor_heights[i]) ||
+                        !readFloat(&reader, &text.tiers.ceiling_heights[i]) ||
+                        !readUnsigned(&reader, &unsigned_buff0) ||
+                        !readUnsigned(&reader, &text.tiers.floor_texture_ids[i]) ||
+                        !readUnsigned(&reader, &text.tiers.ceiling_texture_ids[i])) {
+                        readerError(&reader, "Ill-formed sector tier definition");
+                        goto _fail;
+                    }
+
+                    text.tiers.is_skys[i] = unsigned_buff0 != 0;
+                }
+
+                text.num_tiers += record->num_tiers;
+                ++text.num_sectors;
+                break;
+            }
+                ///////////////////////////////////////////////////////////////////////////////////////////////////
+            case state_walls: {
+                if (*reader.cur == 'E') {
+                    word_length = readWord(&reader, &word);
+                    if (wordIs(word, word_length, "END")) {
+                        state = state_open;
+                        break;
+                    }
+                    reader.cur = line_data;
+                }
+
+                if (!reserveWalls(&text, text.num_walls + 1)) {
+                    readerError(&reader, "Out of memory");
+                    goto _fail;
+                }
+
+                unsigned wall_index = text.num_walls;
+                Line *wall_line     = &text.wall_lines[wall_index];
+                unsigned wall_next;
+
+                if (!readFloat(&reader, &wall_line->points[0][0]) ||
+                    !readFloat(&reader, &wall_line->points[0][1]) ||
+                    !readFloat(&reader, &wall_line->points[1][0]) ||
+                    !readFloat(&reader, &wall_line->points[1][1]) ||
+                    !readUnsigned(&reader, &wall_next) ||
+                    !readUnsigned(&reader, &unsigned_buff0) ||
+                    !readUnsigned(&reader, &text.wall_texture_ids[wall_index])) {
+                    readerError(&reader, "Ill-formed wall definition");
+                    goto _fail;
+                }
+
+                text.wall_is_skys[wall_index] = unsigned_buff0 != 0;
+                text.wall_nexts[wall_index]   = wall_next == 0 ? INVALID_SECTOR_INDEX : wall_next - 1;
+
+                wall_line->points[0][0] *= scale;
+                wall_line->points[0][1] *= scale;
+                wall_line->points[1][0] *= scale;
+                wall_line->points[1][1] *= scale;
+
+                ++text.num_walls;
+                break;
+            }
+                ///////////////////////////////////////////////////////////////////////////////////////////////////
+            default:
+                assert(false && "Unhandled state!");
+        }
+
+        if (!atLineEnd(&reader)) {
+            readerError(&reader, "Unexpected characters at end of line");
+            goto _fail;
+        }
+        nextLine(&reader);
+    }
+
+    free(data);
+    data = NULL;
+
+    for (unsigned i = 0; i < text.num_sectors; ++i) {
+        if ((uint64_t)text.sectors[i].start + text.sectors[i].length > text.num_walls) {
+            printf("ERROR:%s: Walls of sector %u are out of range\n", path, i);
+            goto _fail;
+        }
+    }
+
+    if (!buildWorld(o_world, &text)) {
+        printf("ERROR:%s: Out of memory\n", path);
+        goto _fail;
+    }
+
+    freeTextWorld(&text);
+    return true;
+
+_fail:
+    free(data);
+    freeTextWorld(&text);
+    memset(o_world, 0, sizeof(*o_world));
+    return false;
+}
+
+//
+//      BINARY WORLDS
+//
+
+// Binary worlds hold every array in its in-memory layout, so loading only maps the file and
+// fixes up the sector table. The file is copy-on-write mapped, so live edits never reach disk.
+// Layout is native endian: header, then each section aligned to WORLD_BINARY_ALIGN.
+
+#define WORLD_BINARY_VERSION 2
+#define WORLD_BINARY_ALIGN 16
+
+typedef struct WorldBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_sectors, num_walls, num_tiers;
+    float scale; // already applied to wall_lines
+
+    uint64_t sectors_offset;
+
+    uint64_t floor_heights_offset, ceiling_heights_offset;
+    uint64_t is_skys_offset;
+    uint64_t floor_texture_ids_offset, ceiling_texture_ids_offset;
+
+    uint64_t wall_lines_offset;
+    uint64_t wall_nexts_offset;
+    uint64_t wall_is_skys_offset;
+    uint64_t wall_texture_ids_offset;
+
+    uint64_t visibility_size; // 0 when the world has no visible sets
+    uint64_t visibility_offsets_offset, visibility_data_offset;
+} WorldBinaryHeader;
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + WORLD_BINARY_ALIGN - 1) & ~(uint64_t)(WORLD_BINARY_ALIGN - 1);
+}
+
+static uint64_t layoutSection(uint64_t *o_offset, uint64_t offset, uint64_t size) {
+    *o_offset = alignOffset(offset);
+    return *o_offset + size;
+}
+
+static bool writeSection(FILE *file, uint64_t offset, const void *data, size_t size) {
+    if (size == 0) return true;
+    if (fseek(file, offset, SEEK_SET) != 0) return false;
+    return fwrite(data, 1, size, file) == size;
+}
+
+bool saveWorldBinary(const char *path, PortalWorld world, float scale) {
+    assert(path != NULL);
+
+    unsigned num_tiers = 0;
+    for (unsigned i = 0; i < world.num_sectors; ++i) {
+        num_tiers += world.sectors[i].num_tiers;
+    }
+
+    // flatten sectors and their tiers
+    SectorRecord *records    = malloc(world.num_sectors * sizeof(*records) + 1);
+    float *floor_heights          = malloc(num_tiers * sizeof(*floor_heights) + 1);
+    float *ceiling_heights        = malloc(num_tiers * sizeof(*ceiling_heights) + 1);
+    bool *is_skys                 = malloc(num_tiers * sizeof(*is_skys) + 1);
+    unsigned *floor_texture_ids   = malloc(num_tiers * sizeof(*floor_texture_ids) + 1);
+    unsigned *ceiling_texture_ids = malloc(num_tiers * sizeof(*ceiling_texture_ids) + 1);
+
+    bool ok = records != NULL && floor_heights != NULL && ceiling_heights != NULL &&
+              is_skys != NULL && floor_texture_ids != NULL && ceiling_texture_ids != NULL;
+
+    unsigned first_tier = 0;
+    for (unsigned i = 0; ok && i < world.num_sectors; ++i) {
+        SectorDef sector = world.sectors[i];
+
+        records[i] = (SectorRecord){
+            .start      = sector.start,
+            .length     = sector.length,
+            .num_tiers  = sector.num_tiers,
+            .first_tier = first_tier,
+        };
+
+        memcpy(&floor_heights[first_tier], sector.floor_heights, sector.num_tiers * sizeof(*floor_heights));
+        memcpy(&ceiling_heights[first_tier], sector.ceiling_heights, sector.num_tiers * sizeof(*ceiling_heights));
+        memcpy(&is_skys[first_tier], sector.is_skys, sector.num_tiers * sizeof(*is_skys));
+        memcpy(&floor_texture_ids[first_tier], sector.floor_texture_ids, sector.num_tiers * sizeof(*floor_texture_ids));
+        memcpy(&ceiling_texture_ids[first_tier], sector.ceiling_texture_ids, sector.num_tiers * sizeof(*ceiling_texture_ids));
+
+        first_tier += sector.num_tiers;
+    }
+
+    WorldBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WORLD_BINARY_MAGIC, 4);
+    header.version     = WORLD_BINARY_VERSION;
+    header.num_sectors = world.num_sectors;
+    header.num_walls   = world.num_walls;
+    header.num_tiers   = num_tiers;
+    header.scale       = scale;
+
+    SectorVisibility visibility = world.visibility;
+    header.visibility_size      = visibility.stale ? 0 : visibility.size;
+    size_t visibility_offsets_size = header.visibility_size > 0 ? (world.num_sectors + 1) * sizeof(*visibility.offsets) : 0;
+
+    uint64_t end = sizeof(header);
+    end          = layoutSection(&header.sectors_offset, end, world.num_sectors * sizeof(*records));
+    end          = layoutSection(&header.floor_heights_offset, end, num_tiers * sizeof(*floor_heights));
+    end          = layoutSection(&header.ceiling_heights_offset, end, num_tiers * sizeof(*ceiling_heights));
+    end          = layoutSection(&header.is_skys_offset, end, num_tiers * sizeof(*is_skys));
+    end          = layoutSection(&header.floor_texture_ids_offset, end, num_tiers * sizeof(*floor_texture_ids));
+    end          = layoutSection(&header.ceiling_texture_ids_offset, end, num_tiers * sizeof(*ceiling_texture_ids));
+    end          = layoutSection(&header.wall_lines_offset, end, world.num_walls * sizeof(*world.wall_lines));
+    end          = layoutSection(&header.wall_nexts_offset, end, world.num_walls * sizeof(*world.wall_nexts));
+    end          = layoutSection(&header.wall_is_skys_offset, end, world.num_walls * sizeof(*world.wall_is_skys));
+    end          = layoutSection(&header.wall_texture_ids_offset, end, world.num_walls * sizeof(*world.wall_texture_ids));
+    end          = layoutSection(&header.visibility_offsets_offset, end, visibility_offsets_size);
+    end          = layoutSection(&header.visibility_data_offset, end, header.visibility_size);
+
+    FILE *file = ok ? fopen(path, "wb") : NULL;
+    if (file != NULL) {
+        ok = ok && writeSection(file, 0, &header, sizeof(header));
+        ok = ok && writeSection(file, header.sectors_offset, records, world.num_sectors * sizeof(*records));
+        ok = ok && writeSection(file, header.floor_heights_offset, floor_heights, num_tiers * sizeof(*floor_heights));
+        ok = ok && writeSection(file, header.ceiling_heights_offset, ceiling_heights, num_tiers * sizeof(*ceiling_heights));
+        ok = ok && writeSection(file, header.is_skys_offset, is_skys, num_tiers * sizeof(*is_skys));
+        ok = ok && writeSection(file, header.floor_texture_ids_offset, floor_texture_ids, num_tiers * sizeof(*floor_texture_ids));
+        ok = ok && writeSection(file, header.ceiling_texture_ids_offset, ceiling_texture_ids, num_tiers * sizeof(*ceiling_texture_ids));
+        ok = ok && writeSection(file, header.wall_lines_offset, world.wall_lines, world.num_walls * sizeof(*world.wall_lines));
+        ok = ok && writeSection(file, header.wall_nexts_offset, world.wall_nexts, world.num_walls * sizeof(*world.wall_nexts));
+        ok = ok && writeSection(file, header.wall_is_skys_offset, world.wall_is_skys, world.num_walls * sizeof(*world.wall_is_skys));
+        ok = ok && writeSection(file, header.wall_texture_ids_offset, world.wall_texture_ids, world.num_walls * sizeof(*world.wall_texture_ids));
+        ok = ok && writeSection(file, header.visibility_offsets_offset, visibility.offsets, visibility_offsets_size);
+        ok = ok && writeSection(file, header.visibility_data_offset, visibility.data, header.visibility_size);
+
+        // pad to the end of the last section, in case trailing sections are empty
+        ok = ok && fseek(file, 0, SEEK_END) == 0;
+        for (long size = ftell(file); ok && size >= 0 && (uint64_t)size < end; ++size) {
+            ok = fputc(0, file) != EOF;
+        }
+
+        if (fclose(file) != 0) ok = false;
+    } else {
+        ok = false;
+    }
+
+    free(records);
+    free(floor_heights);
+    free(ceiling_heights);
+    free(is_skys);
+    free(floor_texture_ids);
+    free(ceiling_texture_ids);
+
+    if (!ok) {
+        printf("ERROR: Failed to write %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+static void *mapFile(const char *path, size_t *o_size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == NULL) return NULL;
+
+    *o_size = (size_t)size.QuadPart;
+    return data;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+
+    *o_size = st.st_size;
+    return data;
+#endif
+}
+
+static void unmapFile(void *data, size_t size) {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(data, size);
+#endif
+}
+
+static bool sectionInFile(uint64_t offset, uint64_t count, size_t elem_size, size_t file_size) {
+    if (offset % WORLD_BINARY_ALIGN != 0) return false;
+    if (offset > file_size) return false;
+    return count <= (file_size - offset) / elem_size;
+}
+
+bool loadWorldBinary(const char *path, PortalWorld *o_world, float scale) {
+    assert(path != NULL);
+    assert(o_world != NULL);
+
+    memset(o_world, 0, sizeof(*o_world));
+
+    size_t size;
+    char *data = mapFile(path, &size);
+    if (data == NULL) {
+        printf("ERROR: Failed to map %s\n", path);
+        return false;
+    }
+    printf("Mapped %s\n", path);
+
+    WorldBinaryHeader header;
+    if (size < sizeof(header)) {
+        printf("ERROR: %s is too small to be a binary world\n", path);
+        unmapFile(data, size);
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, WORLD_BINARY_MAGIC, 4) != 0) {
+        printf("ERROR: %s is not a binary world\n", path);
+        unmapFile(data, size);
+        return false;
+    }
+
+    if (header.version != WORLD_BINARY_VERSION) {
+        printf("ERROR: %s: Binary world version %u is not supported: expected %u\n", path, header.version, WORLD_BINARY_VERSION);
+        unmapFile(data, size);
+        return false;
+    }
+
+    if (!sectionInFile(header.sectors_offset, header.num_sectors, sizeof(SectorRecord), size) ||
+        !sectionInFile(header.floor_heights_offset, header.num_tiers, sizeof(float), size) ||
+        !sectionInFile(header.ceiling_heights_offset, header.num_tiers, sizeof(float), size) ||
+        !sectionInFile(header.is_skys_offset, header.num_tiers, sizeof(bool), size) ||
+        !sectionInFile(header.floor_texture_ids_offset, header.num_tiers, sizeof(unsigned), size) ||
+        !sectionInFile(header.ceiling_texture_ids_offset, header.num_tiers, sizeof(unsigned), size) ||
+        !sectionInFile(header.wall_lines_offset, header.num_walls, sizeof(Line), size) ||
+        !sectionInFile(header.wall_nexts_offset, header.num_walls, sizeof(unsigned), size) ||
+        !sectionInFile(header.wall_is_skys_offset, header.num_walls, sizeof(bool), size) ||
+        !sectionInFile(header.wall_texture_ids_offset, header.num_walls, sizeof(unsigned), size) ||
+        (header.visibility_size > 0 && (!sectionInFile(header.visibility_offsets_offset, (uint64_t)header.num_sectors + 1, sizeof(unsigned), size) ||
+                                        !sectionInFile(header.visibility_data_offset, header.visibility_size, 1, size) ||
+                                        header.visibility_size > UINT32_MAX))) {
+        printf("ERROR: %s: Binary world sections are out of bounds\n", path);
+        unmapFile(data, size);
+        return false;
+    }
+
+    o_world->wall_lines       = (Line *)(data + header.wall_lines_offset);
+    o_world->wall_nexts       = (unsigned *)(data + header.wall_nexts_offset);
+    o_world->wall_is_skys     = (bool *)(data + header.wall_is_skys_offset);
+    o_world->wall_texture_ids = (unsigned *)(data + header.wall_texture_ids_offset);
+    o_world->num_walls        = header.num_walls;
+    o_world->num_sectors      = header.num_sectors;
+    o_world->mapping          = data;
+    o_world->mapping_size     = size;
+
+    const SectorRecord *records = (const SectorRecord *)(data + header.sectors_offset);
+    for (unsigned i = 0; i < header.num_sectors; ++i) {
+        SectorRecord record = records[i];
+
+        if ((uint64_t)record.start + record.length > header.num_walls ||
+            (uint64_t)record.first_tier + record.num_tiers > header.num_tiers ||
+            record.num_tiers < 1) {
+            printf("ERROR: %s: Ill-formed sector %u\n", path, i);
+            unmapFile(data, size);
+            memset(o_world, 0, sizeof(*o_world));
+            return false;
+        }
+    }
+
+    // every set must be a range of the data, so decoding never reads past it
+    const unsigned *visibility_offsets = (const unsigned *)(data + header.visibility_offsets_offset);
+    bool visibility_ok = header.visibility_size == 0 ||
+                         (visibility_offsets[0] == 0 && visibility_offsets[header.num_sectors] == header.visibility_size);
+    for (unsigned i = 0; visibility_ok && header.visibility_size > 0 && i < header.num_sectors; ++i) {
+        visibility_ok = visibility_offsets[i] <= visibility_offsets[i + 1];
+    }
+    if (!visibility_ok) {
+        printf("ERROR: %s: Ill-formed visible sets\n", path);
+        unmapFile(data, size);
+        memset(o_world, 0, sizeof(*o_world));
+        return false;
+    }
+    o_world->visibility.size = header.visibility_size;
+
+    // only touches the pages when the caller asks for a different scale than was baked, and before
+    // the sector grid is sized from the walls
+    if (scale != header.scale && header.scale != 0.0f) {
+        float rescale = scale / header.scale;
+        for (unsigned i = 0; i < header.num_walls; ++i) {
+            o_world->wall_lines[i].points[0][0] *= rescale;
+            o_world->wall_lines[i].points[0][1] *= rescale;
+            o_world->wall_lines[i].points[1][0] *= rescale;
+            o_world->wall_lines[i].points[1][1] *= rescale;
+        }
+    }
+
+    // sector table is the only thing that needs fixing up, pointing tiers into the mapping
+    TierArrays tiers;
+    if (!allocateLoadedWorld(o_world, records, header.num_tiers, o_world->wall_lines, o_world->wall_nexts, &tiers)) {
+        printf("ERROR: Out of memory loading %s\n", path);
+        unmapFile(data, size);
+        memset(o_world, 0, sizeof(*o_world));
+        return false;
+    }
+
+    tiers.floor_heights       = (float *)(data + header.floor_heights_offset);
+    tiers.ceiling_heights     = (float *)(data + header.ceiling_heights_offset);
+    tiers.is_skys             = (bool *)(data + header.is_skys_offset);
+    tiers.floor_texture_ids   = (unsigned *)(data + header.floor_texture_ids_offset);
+    tiers.ceiling_texture_ids = (unsigned *)(data + header.ceiling_texture_ids_offset);
+    assignSectors(o_world, records, tiers);
+
+    if (header.visibility_size > 0) {
+        o_world->visibility.offsets = (unsigned *)(data + header.visibility_offsets_offset);
+        o_world->visibility.data    = (uint8_t *)(data + header.visibility_data_offset);
+    }
+
+    computeDerivedData(o_world);
+    return true;
+}
+
+//
+//      VALIDATION
+//
+
+// Checks a compiled map would otherwise only show as render or collision bugs. Sectors must be
+// simple loops winding with their inside on the left, which is what point location, back face
+// culling and the wall normals all assume.
+
+// true if the segments cross or one touches the other, collinear overlaps included
+static bool segmentsTouch(const float *a, const float *b, const float *c, const float *d) {
+    float o1 = cross32d((float *)a, (float *)b, (float *)c);
+    float o2 = cross32d((float *)a, (float *)b, (float *)d);
+    float o3 = cross32d((float *)c, (float *)d, (float *)a);
+    float o4 = cross32d((float *)c, (float *)d, (float *)b);
+
+    if (((o1 > 0.0f && o2 < 0.0f) || (o1 < 0.0f && o2 > 0.0f)) && ((o3 > 0.0f && o4 < 0.0f) || (o3 < 0.0f && o4 > 0.0f))) {
+        return true;
+    }
+
+#define ON_SEGMENT(p, q, r) \
+    (min(p[0], q[0]) <= r[0] && r[0] <= max(p[0], q[0]) && min(p[1], q[1]) <= r[1] && r[1] <= max(p[1], q[1]))
+    bool touches = (o1 == 0.0f && ON_SEGMENT(a, b, c)) || (o2 == 0.0f && ON_SEGMENT(a, b, d)) ||
+                   (o3 == 0.0f && ON_SEGMENT(c, d, a)) || (o4 == 0.0f && ON_SEGMENT(c, d, b));
+#undef ON_SEGMENT
+
+    return touches;
+}
+
+static bool isClosedLoop(const Line *lines, unsigned num_lines) {
+    for (unsigned i = 0; i < num_lines; ++i) {
+        const float *end   = lines[i].points[1];
+        const float *start = lines[(i + 1) % num_lines].points[0];
+        if (end[0] != start[0] || end[1] != start[1]) return false;
+    }
+    return true;
+}
+
+// twice the signed area, positive for loops winding with the inside on the left
+static float loopArea(const Line *lines, unsigned num_lines) {
+    float area = 0.0f;
+    for (unsigned i = 0; i < num_lines; ++i) {
+        area += lines[i].points[0][0] * lines[i].points[1][1] - lines[i].points[1][0] * lines[i].points[0][1];
+    }
+    return area;
+}
+
+// returns the first pair of walls that are not neighbors in the loop yet touch
+static bool findSelfIntersection(const Line *lines, unsigned num_lines, unsigned *o_a, unsigned *o_b) {
+    for (unsigned i = 0; i < num_lines; ++i) {
+        for (unsigned k = i + 2; k < num_lines; ++k) {
+            if (i == 0 && k == num_lines - 1) continue;
+            if (segmentsTouch(lines[i].points[0], lines[i].points[1], lines[k].points[0], lines[k].points[1])) {
+                *o_a = i;
+                *o_b = k;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+unsigned validateWorld(PortalWorld world) {
+    unsigned num_errors = 0, num_warnings = 0;
+
+    for (unsigned s = 0; s < world.num_sectors; ++s) {
+        SectorDef sector = world.sectors[s];
+        Line *lines      = &world.wall_lines[sector.start];
+
+        if (sector.length < 3) {
+            printf("ERROR: Sector %u has %u walls, at least 3 are needed\n", s, sector.length);
+            ++num_errors;
+            continue;
+        }
+
+        bool bad_walls = false;
+        for (unsigned k = 0; k < sector.length; ++k) {
+            unsigned wall = sector.start + k;
+            unsigned next = world.wall_nexts[wall];
+
+            if (world.wall_geometry[wall].length == 0.0f) {
+                printf("ERROR: Sector %u: Wall %u has no length\n", s, wall);
+                ++num_errors;
+                bad_walls = true;
+            }
+
+            if (next != INVALID_SECTOR_INDEX && next >= world.num_sectors) {
+                printf("ERROR: Sector %u: Wall %u leads to sector %u, which does not exist\n", s, wall, next);
+                ++num_errors;
+            } else if (next == s) {
+                printf("WARNING: Sector %u: Wall %u leads back into its own sector\n", s, wall);
+                ++num_warnings;
+            }
+        }
+
+        for (unsigned p = sector.first_portal; p < sector.first_portal + sector.num_portals; ++p) {
+            if (world.portals[p].twin != INVALID_WALL_INDEX) continue;
+            printf("WARNING: Sector %u: Wall %u has no matching wall in sector %u\n", s, world.portals[p].wall, world.portals[p].sector);
+            ++num_warnings;
+        }
+
+        unsigned a, b;
+        if (!isClosedLoop(lines, sector.length)) {
+            printf("ERROR: Sector %u: Walls do not form a closed loop\n", s);
+            ++num_errors;
+        } else if (bad_walls) {
+            // the loop checks below would only repeat the zero length walls
+        } else if (findSelfIntersection(lines, sector.length, &a, &b)) {
+            printf("ERROR: Sector %u: Walls %u and %u intersect\n", s, sector.start + a, sector.start + b);
+            ++num_errors;
+        } else if (loopArea(lines, sector.length) <= 0.0f) {
+            printf("ERROR: Sector %u: Walls wind the wrong way, their normals face out\n", s);
+            ++num_errors;
+        }
+
+        for (unsigned t = 0; t < sector.num_tiers; ++t) {
+            if (sector.floor_heights[t] > sector.ceiling_heights[t]) {
+                printf("ERROR: Sector %u: Tier %u has its floor above its ceiling\n", s, t);
+                ++num_errors;
+            }
+            if (t > 0 && sector.floor_heights[t] < sector.ceiling_heights[t - 1]) {
+                printf("WARNING: Sector %u: Tier %u overlaps the tier below\n", s, t);
+                ++num_warnings;
+            }
+        }
+    }
+
+    if (num_errors > 0 || num_warnings > 0) printf("%u errors, %u warnings\n", num_errors, num_warnings);
+    return num_errors;
+}
+
+// A piece of a sector being split, as a loop of edges. Each edge is either one of the sector's
+// walls or one side of a diagonal, the other side of which is diagonal ^ 1.
+typedef struct SplitEdge {
+    vec2 start;
+    unsigned wall;
+    unsigned diagonal;
+} SplitEdge;
+
+typedef struct SplitPieces {
+    SplitEdge *edges;
+    unsigned num_edges, edge_capacity;
+    unsigned *starts; // num_pieces + 1 offsets into edges
+    unsigned *sectors;
+    unsigned num_pieces, piece_capacity;
+    unsigned num_diagonals;
+} SplitPieces;
+
+static bool isReflex(const SplitEdge *edges, unsigned n, unsigned i) {
+    return cross32d((float *)edges[(i + n - 1) % n].start, (float *)edges[i].start, (float *)edges[(i + 1) % n].start) < 0.0f;
+}
+
+// whether the diagonal from a to b stays inside the loop, see O'Rourke's Computational Geometry in C
+static bool isDiagonal(const SplitEdge *edges, unsigned n, unsigned a, unsigned b) {
+    float *pa   = (float *)edges[a].start;
+    float *pb   = (float *)edges[b].start;
+    float *prev = (float *)edges[(a + n - 1) % n].start;
+    float *next = (float *)edges[(a + 1) % n].start;
+
+    bool in_cone;
+    if (cross32d(prev, pa, next) >= 0.0f) {
+        in_cone = cross32d(pa, pb, prev) > 0.0f && cross32d(pb, pa, next) > 0.0f;
+    } else {
+        in_cone = !(cross32d(pa, pb, next) >= 0.0f && cross32d(pb, pa, prev) >= 0.0f);
+    }
+    if (!in_cone) return false;
+
+    for (unsigned i = 0; i < n; ++i) {
+        unsigned k = (i + 1) % n;
+        if (i == a || k == a || i == b || k == b) continue;
+        if (segmentsTouch(pa, pb, edges[i].start, edges[k].start)) return false;
+    }
+    return true;
+}
+
+static bool addPiece(SplitPieces *pieces, const SplitEdge *edges, unsigned n, unsigned sector_index) {
+    if (pieces->num_edges + n > pieces->edge_capacity) {
+        unsigned capacity = max(pieces->num_edges + n, pieces->edge_capacity * 2);
+        if (!growArray(&pieces->edges, sizeof(*pieces->edges), capacity)) return false;
+        pieces->edge_capacity = capacity;
+    }
+    if (pieces->num_pieces + 2 > pieces->piece_capacity) {
+        unsigned capacity = max(pieces->num_pieces + 2, pieces->piece_capacity * 2);
+        if (!growArray(&pieces->starts, sizeof(*pieces->starts), capacity) ||
+            !growArray(&pieces->sectors, sizeof(*pieces->sectors), capacity)) return false;
+        pieces->piece_capacity = capacity;
+    }
+
+    memcpy(&pieces->edges[pieces->num_edges], edges, n * sizeof(*edges));
+    pieces->starts[pieces->num_pieces]      = pieces->num_edges;
+    pieces->sectors[pieces->num_pieces]     = sector_index;
+    pieces->num_edges                      += n;
+    pieces->num_pieces                     += 1;
+    pieces->starts[pieces->num_pieces]      = pieces->num_edges;
+    return true;
+}
+
+// splits the loop along diagonals out of its reflex corners until every piece is convex
+static bool splitLoop(SplitPieces *pieces, const SplitEdge *edges, unsigned n, unsigned sector_index) {
+    unsigned best_a = ~0u, best_b = ~0u;
+    float best_length = 0.0f;
+    bool best_resolves = false;
+
+    for (unsigned a = 0; a < n; ++a) {
+        if (!isReflex(edges, n, a)) continue;
+
+        float *prev = (float *)edges[(a + n - 1) % n].start;
+        float *next = (float *)edges[(a + 1) % n].start;
+        for (unsigned b = 0; b < n; ++b) {
+            if (b == a || b == (a + 1) % n || b == (a + n - 1) % n || !isDiagonal(edges, n, a, b)) continue;
+
+            // diagonals that leave the corner convex on both sides remove it for good
+            float *pa     = (float *)edges[a].start;
+            float *pb     = (float *)edges[b].start;
+            bool resolves = cross32d(pb, pa, next) >= 0.0f && cross32d(prev, pa, pb) >= 0.0f;
+            float length  = dist2d(pa, pb);
+
+            if (best_a == ~0u || (resolves && !best_resolves) || (resolves == best_resolves && length < best_length)) {
+                best_a        = a;
+                best_b        = b;
+                best_length   = length;
+                best_resolves = resolves;
+            }
+        }
+    }
+
+    // convex, or too broken to split, either way it is kept as it is
+    if (best_a == ~0u) return addPiece(pieces, edges, n, sector_index);
+
+    unsigned a = best_a, b = best_b;
+    unsigned d = pieces->num_diagonals++ * 2;
+
+    SplitEdge *half = malloc(n * sizeof(*half));
+    if (half == NULL) return false;
+
+    // a to b, closed by the diagonal back from b
+    unsigned m = 0;
+    for (unsigned i = a; i != b; i = (i + 1) % n) {
+        half[m++] = edges[i];
+    }
+    half[m++] = (SplitEdge){ .start = { edges[b].start[0], edges[b].start[1] }, .wall = INVALID_WALL_INDEX, .diagonal = d };
+    bool ok = splitLoop(pieces, half, m, sector_index);
+
+    // b to a, closed by the diagonal from a
+    m = 0;
+    for (unsigned i = b; i != a; i = (i + 1) % n) {
+        half[m++] = edges[i];
+    }
+    half[m++] = (SplitEdge){ .start = { edges[a].start[0], edges[a].start[1] }, .wall = INVALID_WALL_INDEX, .diagonal = d + 1 };
+    ok = ok && splitLoop(pieces, half, m, sector_index);
+
+    free(half);
+    return ok;
+}
+
+// the piece of a split sector that a neighbor's wall leads into
+static unsigned findPiece(PortalWorld world, const SplitPieces *pieces, const unsigned *first_piece, const unsigned *piece_sectors,
+                          const unsigned *wall_pieces, unsigned wall, unsigned next) {
+    SectorDef sector = world.sectors[next];
+    for (unsigned p = sector.first_portal; p < sector.first_portal + sector.num_portals; ++p) {
+        Portal portal = world.portals[p];
+        if (portal.twin == wall) return wall_pieces[portal.wall];
+    }
+
+    // without a matching wall, the piece just across the wall's middle
+    Line line            = world.wall_lines[wall];
+    WallGeometry geom    = world.wall_geometry[wall];
+    vec2 across          = {
+        (line.points[0][0] + line.points[1][0]) * 0.5f - geom.normal[0] * 1e-3f,
+        (line.points[0][1] + line.points[1][1]) * 0.5f - geom.normal[1] * 1e-3f,
+    };
+    for (unsigned p = first_piece[next]; p < pieces->num_pieces && pieces->sectors[p] == next; ++p) {
+        const SplitEdge *edges = &pieces->edges[pieces->starts[p]];
+        unsigned n             = pieces->starts[p + 1] - pieces->starts[p];
+        unsigned num_crossings = 0;
+        for (unsigned i = 0; i < n; ++i) {
+            const float *e0 = edges[i].start;
+            const float *e1 = edges[(i + 1) % n].start;
+            if ((e0[1] > across[1]) != (e1[1] > across[1]) &&
+                across[0] < e0[0] + (across[1] - e0[1]) * (e1[0] - e0[0]) / (e1[1] - e0[1])) {
+                ++num_crossings;
+            }
+        }
+        if (num_crossings % 2 == 1) return piece_sectors[p];
+    }
+    return next;
+}
+
+bool splitConcaveSectors(PortalWorld world, PortalWorld *o_world, unsigned *o_num_split) {
+    assert(o_world != NULL);
+
+    SplitPieces pieces;
+    TextWorld text;
+    memset(&pieces, 0, sizeof(pieces));
+    memset(&text, 0, sizeof(text));
+
+    unsigned *first_piece   = malloc(max(world.num_sectors, 1) * sizeof(*first_piece));
+    unsigned *wall_pieces   = malloc(max(world.num_walls, 1) * sizeof(*wall_pieces));
+    unsigned *piece_sectors = NULL;
+    unsigned *diagonals     = NULL;
+    SplitEdge *loop         = malloc(max(world.num_walls, 1) * sizeof(*loop));
+    unsigned num_split      = 0;
+    bool ok                 = first_piece != NULL && wall_pieces != NULL && loop != NULL;
+
+    // only simple loops wound the right way can be split, validateWorld reports the rest
+    for (unsigned s = 0; ok && s < world.num_sectors; ++s) {
+        SectorDef sector = world.sectors[s];
+        Line *lines      = &world.wall_lines[sector.start];
+        unsigned a, b;
+
+        first_piece[s] = pieces.num_pieces;
+        if (sector.is_convex || sector.length < 4 || !isClosedLoop(lines, sector.length) || loopArea(lines, sector.length) <= 0.0f ||
+            findSelfIntersection(lines, sector.length, &a, &b)) continue;
+
+        for (unsigned k = 0; k < sector.length; ++k) {
+            loop[k] = (SplitEdge){
+                .start    = { lines[k].points[0][0], lines[k].points[0][1] },
+                .wall     = sector.start + k,
+                .diagonal = INVALID_WALL_INDEX,
+            };
+        }
+
+        unsigned first = pieces.num_pieces;
+        ok             = splitLoop(&pieces, loop, sector.length, s);
+        num_split += ok && pieces.num_pieces - first > 1;
+    }
+
+    // a sector's first piece keeps its index, the others go after the existing sectors
+    unsigned num_sectors = world.num_sectors;
+    if (ok) {
+        piece_sectors = malloc(max(pieces.num_pieces, 1) * sizeof(*piece_sectors));
+        diagonals     = malloc(max(pieces.num_diagonals * 2, 1) * sizeof(*diagonals));
+        ok            = piece_sectors != NULL && diagonals != NULL;
+    }
+
+    for (unsigned p = 0; ok && p < pieces.num_pieces; ++p) {
+        unsigned s       = pieces.sectors[p];
+        piece_sectors[p] = p == first_piece[s] ? s : num_sectors++;
+
+        for (unsigned e = pieces.starts[p]; e < pieces.starts[p + 1]; ++e) {
+            SplitEdge edge = pieces.edges[e];
+            if (edge.wall != INVALID_WALL_INDEX) wall_pieces[edge.wall] = piece_sectors[p];
+            if (edge.diagonal != INVALID_WALL_INDEX) diagonals[edge.diagonal] = piece_sectors[p];
+        }
+    }
+
+    unsigned num_walls = world.num_walls + pieces.num_diagonals * 2;
+    unsigned num_tiers = 0;
+    for (unsigned s = 0; ok && s < world.num_sectors; ++s) {
+        num_tiers += world.sectors[s].num_tiers;
+    }
+    for (unsigned p = 0; ok && p < pieces.num_pieces; ++p) {
+        if (piece_sectors[p] >= world.num_sectors) num_tiers += world.sectors[pieces.sectors[p]].num_tiers;
+    }
+
+    ok = ok && reserveSectors(&text, num_sectors) && reserveTiers(&text, num_tiers) && reserveWalls(&text, num_walls);
+
+    unsigned next_extra = 0;
+    for (unsigned out = 0; ok && out < num_sectors; ++out) {
+        // the piece, if any, that becomes this sector
+        unsigned piece = INVALID_SECTOR_INDEX, s = out;
+        if (out < world.num_sectors) {
+            if (first_piece[out] < pieces.num_pieces && pieces.sectors[first_piece[out]] == out) piece = first_piece[out];
+        } else {
+            while (piece_sectors[next_extra] != out) ++next_extra;
+            piece = next_extra;
+            s     = pieces.sectors[piece];
+        }
+
+        SectorDef sector     = world.sectors[s];
+        SectorRecord *record = &text.sectors[text.num_sectors++];
+        *record              = (SectorRecord){
+            .start      = text.num_walls,
+            .num_tiers  = sector.num_tiers,
+            .first_tier = text.num_tiers,
+        };
+
+        memcpy(&text.tiers.floor_heights[text.num_tiers], sector.floor_heights, sector.num_tiers * sizeof(*sector.floor_heights));
+        memcpy(&text.tiers.ceiling_heights[text.num_tiers], sector.ceiling_heights, sector.num_tiers * sizeof(*sector.ceiling_heights));
+        memcpy(&text.tiers.is_skys[text.num_tiers], sector.is_skys, sector.num_tiers * sizeof(*sector.is_skys));
+        memcpy(&text.tiers.floor_texture_ids[text.num_tiers], sector.floor_texture_ids, sector.num_tiers * sizeof(*sector.floor_texture_ids));
+        memcpy(&text.tiers.ceiling_texture_ids[text.num_tiers], sector.ceiling_texture_ids, sector.num_tiers * sizeof(*sector.ceiling_texture_ids));
+        text.num_tiers += sector.num_tiers;
+
+        unsigned first_edge = piece == INVALID_SECTOR_INDEX ? 0 : pieces.starts[piece];
+        unsigned num_edges  = piece == INVALID_SECTOR_INDEX ? sector.length : pieces.starts[piece + 1] - first_edge;
+        for (unsigned e = 0; e < num_edges; ++e) {
+            unsigned w = text.num_walls++;
+            unsigned wall, next;
+
+            if (piece == INVALID_SECTOR_INDEX) {
+                wall = sector.start + e;
+            } else {
+                wall = pieces.edges[first_edge + e].wall;
+            }
+
+            if (wall != INVALID_WALL_INDEX) {
+                next = world.wall_nexts[wall];
+                if (next < world.num_sectors && first_piece[next] < pieces.num_pieces && pieces.sectors[first_piece[next]] == next) {
+                    next = findPiece(world, &pieces, first_piece, piece_sectors, wall_pieces, wall, next);
+                }
+
+                text.wall_lines[w]       = world.wall_lines[wall];
+                text.wall_nexts[w]       = next;
+                text.wall_is_skys[w]     = world.wall_is_skys[wall];
+                text.wall_texture_ids[w] = world.wall_texture_ids[wall];
+            } else {
+                // an invisible wall, the texture of the wall before it only shows if tiers are edited apart
+                SplitEdge edge = pieces.edges[first_edge + e];
+                SplitEdge end  = pieces.edges[first_edge + (e + 1) % num_edges];
+                SplitEdge prev = pieces.edges[first_edge + (e + num_edges - 1) % num_edges];
+
+                text.wall_lines[w]       = (Line){ .points = { { edge.start[0], edge.start[1] }, { end.start[0], end.start[1] } } };
+                text.wall_nexts[w]       = diagonals[edge.diagonal ^ 1];
+                text.wall_is_skys[w]     = false;
+                text.wall_texture_ids[w] = prev.wall != INVALID_WALL_INDEX ? world.wall_texture_ids[prev.wall] : 0;
+            }
+        }
+        record->length = text.num_walls - record->start;
+    }
+
+    ok = ok && buildWorld(o_world, &text);
+
+    free(first_piece);
+    free(wall_pieces);
+    free(piece_sectors);
+    free(diagonals);
+    free(loop);
+    free(pieces.edges);
+    free(pieces.starts);
+    free(pieces.sectors);
+    freeTextWorld(&text);
+
+    if (!ok) {
+        printf("ERROR: Out of memory splitting sectors\n");
+        return false;
+    }
+
+    if (o_num_split != NULL) *o_num_split = num_split;
+    return true;
+}
+
+//
+//      PAGED WORLDS
+//
+
+// Paged worlds are for maps too big to keep resident. Sectors are grouped into regions on a grid
+// and renumbered so each region's sectors, tiers, walls, vertices and portals are contiguous ranges
+// of their sections, which start on page boundaries. Derived data is baked in, so opening one only
+// maps the file and allocates an empty sector table. Regions fill in their sectors when activated
+// and give their pages back when released, which also drops any edits made to them.
+
+#define WORLD_PAGED_VERSION 2
+#define WORLD_PAGE_SIZE 4096
+
+// region grids past this many cells mean the region size is far too small for the map
+#define MAX_REGION_GRID_CELLS (1u << 24)
+
+typedef struct PagedSectorRecord {
+    uint32_t start, length;
+    uint32_t num_tiers, first_tier;
+    uint32_t first_portal, num_portals;
+} PagedSectorRecord;
+
+typedef struct WorldPagedHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_sectors, num_walls, num_tiers, num_vertices, num_portals;
+    uint32_t num_regions, num_region_neighbors;
+    uint32_t grid_width, grid_height;
+    float grid_origin[2];
+    float region_size;
+    float scale; // already applied, paged worlds are never rescaled
+    float sector_grid_origin[2];
+    float sector_grid_cell_size;
+    uint32_t sector_grid_width, sector_grid_height, sector_grid_num_entries;
+
+    uint64_t regions_offset, region_neighbors_offset, grid_offset;
+    uint64_t sectors_offset;
+    uint64_t sector_grid_starts_offset, sector_grid_sectors_offset;
+
+    uint64_t floor_heights_offset, ceiling_heights_offset;
+    uint64_t is_skys_offset;
+    uint64_t floor_texture_ids_offset, ceiling_texture_ids_offset;
+
+    uint64_t wall_lines_offset;
+    uint64_t wall_nexts_offset;
+    uint64_t wall_is_skys_offset;
+    uint64_t wall_texture_ids_offset;
+
+    uint64_t wall_geometry_offset, wall_vertices_offset, vertices_offset, portals_offset;
+} WorldPagedHeader;
+
+static uint64_t layoutPage(uint64_t *o_offset, uint64_t offset, uint64_t size) {
+    *o_offset = (offset + WORLD_PAGE_SIZE - 1) & ~(uint64_t)(WORLD_PAGE_SIZE - 1);
+    return *o_offset + size;
+}
+
+// renumbers the world's sectors region by region, into flat data that buildWorld accepts
+static bool flattenByRegion(PortalWorld world, const unsigned *order, TextWorld *o_flat) {
+    memset(o_flat, 0, sizeof(*o_flat));
+
+    unsigned num_tiers = 0;
+    for (unsigned i = 0; i < world.num_sectors; ++i) {
+        num_tiers += world.sectors[i].num_tiers;
+    }
+
+    unsigned *new_index = malloc(max(world.num_sectors, 1) * sizeof(*new_index));
+    if (new_index == NULL || !reserveSectors(o_flat, world.num_sectors) || !reserveTiers(o_flat, num_tiers) ||
+        !reserveWalls(o_flat, world.num_walls)) {
+        free(new_index);
+        freeTextWorld(o_flat);
+        return false;
+    }
+
+    for (unsigned i = 0; i < world.num_sectors; ++i) {
+        new_index[order[i]] = i;
+    }
+
+    for (unsigned i = 0; i < world.num_sectors; ++i) {
+        SectorDef sector      = world.sectors[order[i]];
+        SectorRecord *record  = &o_flat->sectors[o_flat->num_sectors++];
+        unsigned first_tier   = o_flat->num_tiers;
+
+        *record = (SectorRecord){
+            .start      = o_flat->num_walls,
+            .length     = sector.length,
+            .num_tiers  = sector.num_tiers,
+            .first_tier = first_tier,
+        };
+
+        memcpy(&o_flat->tiers.floor_heights[first_tier], sector.floor_heights, sector.num_tiers * sizeof(*sector.floor_heights));
+        memcpy(&o_flat->tiers.ceiling_heights[first_tier], sector.ceiling_heights, sector.num_tiers * sizeof(*sector.ceiling_heights));
+        memcpy(&o_flat->tiers.is_skys[first_tier], sector.is_skys, sector.num_tiers * sizeof(*sector.is_skys));
+        memcpy(&o_flat->tiers.floor_texture_ids[first_tier], sector.floor_texture_ids, sector.num_tiers * sizeof(*sector.floor_texture_ids));
+        memcpy(&o_flat->tiers.ceiling_texture_ids[first_tier], sector.ceiling_texture_ids, sector.num_tiers * sizeof(*sector.ceiling_texture_ids));
+        o_flat->num_tiers += sector.num_tiers;
+
+        for (unsigned k = sector.start; k < sector.start + sector.length; ++k) {
+            unsigned w      = o_flat->num_walls++;
+            unsigned next   = world.wall_nexts[k];
+
+            o_flat->wall_lines[w]       = world.wall_lines[k];
+            o_flat->wall_nexts[w]       = next < world.num_sectors ? new_index[next] : INVALID_SECTOR_INDEX;
+            o_flat->wall_is_skys[w]     = world.wall_is_skys[k];
+            o_flat->wall_texture_ids[w] = world.wall_texture_ids[k];
+        }
+    }
+
+    free(new_index);
+    return true;
+}
+
+bool saveWorldPaged(const char *path, PortalWorld world, float scale, float region_size) {
+    assert(path != NULL);
+
+    if (!(region_size > 0.0f)) {
+        printf("ERROR: Region size must be positive\n");
+        return false;
+    }
+
+    // the grid covers every wall start, sectors go to the cell of their average wall start
+    vec2 lo = { 0.0f, 0.0f }, hi = { 0.0f, 0.0f };
+    for (unsigned i = 0; i < world.num_walls; ++i) {
+        for (unsigned k = 0; k < 2; ++k) {
+            lo[k] = i == 0 ? world.wall_lines[i].points[0][k] : min(lo[k], world.wall_lines[i].points[0][k]);
+            hi[k] = i == 0 ? world.wall_lines[i].points[0][k] : max(hi[k], world.wall_lines[i].points[0][k]);
+        }
+    }
+
+    uint64_t grid_width  = (uint64_t)((hi[0] - lo[0]) / region_size) + 1;
+    uint64_t grid_height = (uint64_t)((hi[1] - lo[1]) / region_size) + 1;
+    if (grid_width * grid_height > MAX_REGION_GRID_CELLS) {
+        printf("ERROR: Region size %f is too small for this map\n", region_size);
+        return false;
+    }
+    unsigned num_cells = grid_width * grid_height;
+
+    unsigned *sector_cells = malloc(max(world.num_sectors, 1) * sizeof(*sector_cells));
+    unsigned *cell_starts  = calloc(num_cells + 1, sizeof(*cell_starts));
+    unsigned *order        = malloc(max(world.num_sectors, 1) * sizeof(*order));
+    unsigned *grid         = malloc(num_cells * sizeof(*grid));
+    WorldRegion *regions   = malloc(num_cells * sizeof(*regions));
+    unsigned *neighbors    = NULL;
+    unsigned *stamps       = NULL;
+    PagedSectorRecord *records = malloc(max(world.num_sectors, 1) * sizeof(*records));
+    TextWorld flat;
+    PortalWorld paged;
+    memset(&flat, 0, sizeof(flat));
+    memset(&paged, 0, sizeof(paged));
+
+    bool ok = sector_cells != NULL && cell_starts != NULL && order != NULL && grid != NULL && regions != NULL && records != NULL;
+
+    // counting sort of the sectors by cell
+    for (unsigned i = 0; ok && i < world.num_sectors; ++i) {
+        SectorDef sector = world.sectors[i];
+        vec2 center      = { 0.0f, 0.0f };
+        for (unsigned k = sector.start; k < sector.start + sector.length; ++k) {
+            center[0] += world.wall_lines[k].points[0][0] / sector.length;
+            center[1] += world.wall_lines[k].points[0][1] / sector.length;
+        }
+
+        unsigned cx     = (unsigned)clamp((center[0] - lo[0]) / region_size, 0.0f, (float)(grid_width - 1));
+        unsigned cy     = (unsigned)clamp((center[1] - lo[1]) / region_size, 0.0f, (float)(grid_height - 1));
+        sector_cells[i] = cy * grid_width + cx;
+        ++cell_starts[sector_cells[i] + 1];
+    }
+
+    unsigned num_regions = 0;
+    for (unsigned c = 0; ok && c < num_cells; ++c) {
+        grid[c] = cell_starts[c + 1] > 0 ? num_regions++ : INVALID_REGION_INDEX;
+        cell_starts[c + 1] += cell_starts[c];
+    }
+
+    for (unsigned i = 0; ok && i < world.num_sectors; ++i) {
+        order[cell_starts[sector_cells[i]]++] = i;
+    }
+
+    ok = ok && flattenByRegion(world, order, &flat);
+    ok = ok && buildWorld(&paged, &flat);
+
+    // regions in cell order, each a run of the renumbered sectors
+    unsigned first_sector = 0, end_vertex = 0, num_neighbors = 0;
+    if (ok) {
+        neighbors = malloc(max(paged.num_portals, 1) * sizeof(*neighbors));
+        stamps    = malloc(max(num_regions, 1) * sizeof(*stamps));
+        ok        = neighbors != NULL && stamps != NULL;
+        if (stamps != NULL) memset(stamps, 0xFF, max(num_regions, 1) * sizeof(*stamps));
+    }
+
+    for (unsigned c = 0, r = 0; ok && c < num_cells; ++c) {
+        if (grid[c] == INVALID_REGION_INDEX) continue;
+
+        unsigned num_sectors = cell_starts[c] - first_sector;
+        SectorDef first      = paged.sectors[first_sector];
+        WorldRegion *region  = &regions[r];
+
+        memset(region, 0, sizeof(*region));
+        region->first_sector = first_sector;
+        region->num_sectors  = num_sectors;
+        region->first_wall   = first.start;
+        region->first_tier   = flat.sectors[first_sector].first_tier;
+        region->first_portal = first.first_portal;
+
+        for (unsigned i = first_sector; i < first_sector + num_sectors; ++i) {
+            region->num_walls += paged.sectors[i].length;
+            region->num_tiers += paged.sectors[i].num_tiers;
+            region->num_portals += paged.sectors[i].num_portals;
+        }
+
+        // vertices are numbered by first use, so the ones a region introduces are contiguous
+        region->first_vertex = end_vertex;
+        for (unsigned k = region->first_wall * 2; k < (region->first_wall + region->num_walls) * 2; ++k) {
+            end_vertex = max(end_vertex, paged.wall_vertices[k] + 1);
+        }
+        region->num_vertices = end_vertex - region->first_vertex;
+
+        region->first_neighbor = num_neighbors;
+        for (unsigned p = region->first_portal; p < region->first_portal + region->num_portals; ++p) {
+            unsigned neighbor = grid[sector_cells[order[paged.portals[p].sector]]];
+            if (neighbor == r || stamps[neighbor] == r) continue;
+            stamps[neighbor]           = r;
+            neighbors[num_neighbors++] = neighbor;
+        }
+        region->num_neighbors = num_neighbors - region->first_neighbor;
+
+        first_sector = cell_starts[c];
+        ++r;
+    }
+
+    for (unsigned i = 0; ok && i < paged.num_sectors; ++i) {
+        SectorDef sector = paged.sectors[i];
+        records[i]       = (PagedSectorRecord){
+            .start        = sector.start,
+            .length       = sector.length,
+            .num_tiers    = sector.num_tiers,
+            .first_tier   = flat.sectors[i].first_tier,
+            .first_portal = sector.first_portal,
+            .num_portals  = sector.num_portals,
+        };
+    }
+
+    WorldPagedHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WORLD_PAGED_MAGIC, 4);
+    header.version              = WORLD_PAGED_VERSION;
+    header.num_sectors          = paged.num_sectors;
+    header.num_walls            = paged.num_walls;
+    header.num_tiers            = flat.num_tiers;
+    header.num_vertices         = paged.num_vertices;
+    header.num_portals          = paged.num_portals;
+    header.num_regions          = num_regions;
+    header.num_region_neighbors = num_neighbors;
+    header.grid_width           = grid_width;
+    header.grid_height          = grid_height;
+    header.grid_origin[0]       = lo[0];
+    header.grid_origin[1]       = lo[1];
+    header.region_size          = region_size;
+    header.scale                = scale;
+
+    SectorGrid sector_grid         = paged.sector_grid;
+    uint64_t num_sector_cells      = (uint64_t)sector_grid.width * sector_grid.height;
+    header.sector_grid_origin[0]   = sector_grid.origin[0];
+    header.sector_grid_origin[1]   = sector_grid.origin[1];
+    header.sector_grid_cell_size   = sector_grid.cell_size;
+    header.sector_grid_width       = sector_grid.width;
+    header.sector_grid_height      = sector_grid.height;
+    header.sector_grid_num_entries = sector_grid.num_entries;
+
+    uint64_t end = sizeof(header);
+    end          = layoutPage(&header.regions_offset, end, num_regions * sizeof(*regions));
+    end          = layoutPage(&header.region_neighbors_offset, end, num_neighbors * sizeof(*neighbors));
+    end          = layoutPage(&header.grid_offset, end, num_cells * sizeof(*grid));
+    end          = layoutPage(&header.sectors_offset, end, paged.num_sectors * sizeof(*records));
+    end          = layoutPage(&header.sector_grid_starts_offset, end, (num_sector_cells + 1) * sizeof(*sector_grid.cell_starts));
+    end          = layoutPage(&header.sector_grid_sectors_offset, end, sector_grid.num_entries * sizeof(*sector_grid.cell_sectors));
+    end          = layoutPage(&header.floor_heights_offset, end, flat.num_tiers * sizeof(*flat.tiers.floor_heights));
+    end          = layoutPage(&header.ceiling_heights_offset, end, flat.num_tiers * sizeof(*flat.tiers.ceiling_heights));
+    end          = layoutPage(&header.is_skys_offset, end, flat.num_tiers * sizeof(*flat.tiers.is_skys));
+    end          = layoutPage(&header.floor_texture_ids_offset, end, flat.num_tiers * sizeof(*flat.tiers.floor_texture_ids));
+    end          = layoutPage(&header.ceiling_texture_ids_offset, end, flat.num_tiers * sizeof(*flat.tiers.ceiling_texture_ids));
+    end          = layoutPage(&header.wall_lines_offset, end, paged.num_walls * sizeof(*paged.wall_lines));
+    end          = layoutPage(&header.wall_nexts_offset, end, paged.num_walls * sizeof(*paged.wall_nexts));
+    end          = layoutPage(&header.wall_is_skys_offset, end, paged.num_walls * sizeof(*paged.wall_is_skys));
+    end          = layoutPage(&header.wall_texture_ids_offset, end, paged.num_walls * sizeof(*paged.wall_texture_ids));
+    end          = layoutPage(&header.wall_geometry_offset, end, paged.num_walls * sizeof(*paged.wall_geometry));
+    end          = layoutPage(&header.wall_vertices_offset, end, paged.num_walls * 2 * sizeof(*paged.wall_vertices));
+    end          = layoutPage(&header.vertices_offset, end, paged.num_vertices * sizeof(*paged.vertices));
+    end          = layoutPage(&header.portals_offset, end, paged.num_portals * sizeof(*paged.portals));
+
+    FILE *file = ok ? fopen(path, "wb") : NULL;
+    if (file != NULL) {
+        ok = ok && writeSection(file, 0, &header, sizeof(header));
+        ok = ok && writeSection(file, header.regions_offset, regions, num_regions * sizeof(*regions));
+        ok = ok && writeSection(file, header.region_neighbors_offset, neighbors, num_neighbors * sizeof(*neighbors));
+        ok = ok && writeSection(file, header.grid_offset, grid, num_cells * sizeof(*grid));
+        ok = ok && writeSection(file, header.sectors_offset, records, paged.num_sectors * sizeof(*records));
+        ok = ok && writeSection(file, header.sector_grid_starts_offset, sector_grid.cell_starts, (num_sector_cells + 1) * sizeof(*sector_grid.cell_starts));
+        ok = ok && writeSection(file, header.sector_grid_sectors_offset, sector_grid.cell_sectors, sector_grid.num_entries * sizeof(*sector_grid.cell_sectors));
+        ok = ok && writeSection(file, header.floor_heights_offset, flat.tiers.floor_heights, flat.num_tiers * sizeof(*flat.tiers.floor_heights));
+        ok = ok && writeSection(file, header.ceiling_heights_offset, flat.tiers.ceiling_heights, flat.num_tiers * sizeof(*flat.tiers.ceiling_heights));
+        ok = ok && writeSection(file, header.is_skys_offset, flat.tiers.is_skys, flat.num_tiers * sizeof(*flat.tiers.is_skys));
+        ok = ok && writeSection(file, header.floor_texture_ids_offset, flat.tiers.floor_texture_ids, flat.num_tiers * sizeof(*flat.tiers.floor_texture_ids));
+        ok = ok && writeSection(file, header.ceiling_texture_ids_offset, flat.tiers.ceiling_texture_ids, flat.num_tiers * sizeof(*flat.tiers.ceiling_texture_ids));
+        ok = ok && writeSection(file, header.wall_lines_offset, paged.wall_lines, paged.num_walls * sizeof(*paged.wall_lines));
+        ok = ok && writeSection(file, header.wall_nexts_offset, paged.wall_nexts, paged.num_walls * sizeof(*paged.wall_nexts));
+        ok = ok && writeSection(file, header.wall_is_skys_offset, paged.wall_is_skys, paged.num_walls * sizeof(*paged.wall_is_skys));
+        ok = ok && writeSection(file, header.wall_texture_ids_offset, paged.wall_texture_ids, paged.num_walls * sizeof(*paged.wall_texture_ids));
+        ok = ok && writeSection(file, header.wall_geometry_offset, paged.wall_geometry, paged.num_walls * sizeof(*paged.wall_geometry));
+        ok = ok && writeSection(file, header.wall_vertices_offset, paged.wall_vertices, paged.num_walls * 2 * sizeof(*paged.wall_vertices));
+        ok = ok && writeSection(file, header.vertices_offset, paged.vertices, paged.num_vertices * sizeof(*paged.vertices));
+        ok = ok && writeSection(file, header.portals_offset, paged.portals, paged.num_portals * sizeof(*paged.portals));
+
+        // pad to the end of the last section, in case trailing sections are empty
+        ok = ok && fseek(file, 0, SEEK_END) == 0;
+        for (long size = ftell(file); ok && size >= 0 && (uint64_t)size < end; ++size) {
+            ok = fputc(0, file) != EOF;
+        }
+
+        if (fclose(file) != 0) ok = false;
+    } else {
+        ok = false;
+    }
+
+    free(sector_cells);
+    free(cell_starts);
+    free(order);
+    free(grid);
+    free(regions);
+    free(neighbors);
+    free(stamps);
+    free(records);
+    freeTextWorld(&flat);
+    freeWorld(paged);
+
+    if (!ok) {
+        printf("ERROR: Failed to write %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool loadWorldPaged(const char *path, PortalWorld *o_world, PagedWorld *o_paged, float scale) {
+    assert(path != NULL);
+    assert(o_world != NULL);
+    assert(o_paged != NULL);
+
+    memset(o_world, 0, sizeof(*o_world));
+    memset(o_paged, 0, sizeof(*o_paged));
+
+    size_t size;
+    char *data = mapFile(path, &size);
+    if (data == NULL) {
+        printf("ERROR: Failed to map %s\n", path);
+        return false;
+    }
+    printf("Mapped %s\n", path);
+
+    WorldPagedHeader header;
+    if (size < sizeof(header)) {
+        printf("ERROR: %s is too small to be a paged world\n", path);
+        unmapFile(data, size);
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, WORLD_PAGED_MAGIC, 4) != 0 || header.version != WORLD_PAGED_VERSION) {
+        printf("ERROR: %s is not a paged world of version %u\n", path, WORLD_PAGED_VERSION);
+        unmapFile(data, size);
+        return false;
+    }
+
+    if (scale != header.scale) {
+        printf("ERROR: %s is baked at scale %f, not %f\n", path, header.scale, scale);
+        unmapFile(data, size);
+        return false;
+    }
+
+    uint64_t num_cells        = (uint64_t)header.grid_width * header.grid_height;
+    uint64_t num_sector_cells = (uint64_t)header.sector_grid_width * header.sector_grid_height;
+    if (num_cells > MAX_REGION_GRID_CELLS || num_sector_cells == 0 || num_sector_cells >= UINT32_MAX ||
+        !(header.sector_grid_cell_size > 0.0f) || !isfinite(header.sector_grid_cell_size) ||
+        !sectionInFile(header.regions_offset, header.num_regions, sizeof(WorldRegion), size) ||
+        !sectionInFile(header.region_neighbors_offset, header.num_region_neighbors, sizeof(uint32_t), size) ||
+        !sectionInFile(header.grid_offset, num_cells, sizeof(uint32_t), size) ||
+        !sectionInFile(header.sectors_offset, header.num_sectors, sizeof(PagedSectorRecord), size) ||
+        !sectionInFile(header.sector_grid_starts_offset, num_sector_cells + 1, sizeof(uint32_t), size) ||
+        !sectionInFile(header.sector_grid_sectors_offset, header.sector_grid_num_entries, sizeof(uint32_t), size) ||
+        !sectionInFile(header.floor_heights_offset, header.num_tiers, sizeof(float), size) ||
+        !sectionInFile(header.ceiling_heights_offset, header.num_tiers, sizeof(float), size) ||
+        !sectionInFile(header.is_skys_offset, header.num_tiers, sizeof(bool), size) ||
+        !sectionInFile(header.floor_texture_ids_offset, header.num_tiers, sizeof(unsigned), size) ||
+        !sectionInFile(header.ceiling_texture_ids_offset, header.num_tiers, sizeof(unsigned), size) ||
+        !sectionInFile(header.wall_lines_offset, header.num_walls, sizeof(Line), size) ||
+        !sectionInFile(header.wall_nexts_offset, header.num_walls, sizeof(unsigned), size) ||
+        !sectionInFile(header.wall_is_skys_offset, header.num_walls, sizeof(bool), size) ||
+        !sectionInFile(header.wall_texture_ids_offset, header.num_walls, sizeof(unsigned), size) ||
+        !sectionInFile(header.wall_geometry_offset, header.num_walls, sizeof(WallGeometry), size) ||
+        !sectionInFile(header.wall_vertices_offset, (uint64_t)header.num_walls * 2, sizeof(unsigned), size) ||
+        !sectionInFile(header.vertices_offset, header.num_vertices, sizeof(vec2), size) ||
+        !sectionInFile(header.portals_offset, header.num_portals, sizeof(Portal), size)) {
+        printf("ERROR: %s is truncated or corrupt\n", path);
+        unmapFile(data, size);
+        return false;
+    }
+
+    // regions must tile every range in order, sectors themselves are checked as they activate
+    const WorldRegion *regions = (const WorldRegion *)(data + header.regions_offset);
+    WorldRegion end            = { 0 };
+    for (unsigned i = 0; i < header.num_regions; ++i) {
+        WorldRegion region = regions[i];
+        if (region.first_sector != end.first_sector || region.first_wall != end.first_wall ||
+            region.first_tier != end.first_tier || region.first_vertex != end.first_vertex ||
+            region.first_portal != end.first_portal ||
+            (uint64_t)region.first_neighbor + region.num_neighbors > header.num_region_neighbors) {
+            printf("ERROR: %s: Ill-formed region %u\n", path, i);
+            unmapFile(data, size);
+            return false;
+        }
+
+        end.first_sector += region.num_sectors;
+        end.first_wall += region.num_walls;
+        end.first_tier += region.num_tiers;
+        end.first_vertex += region.num_vertices;
+        end.first_portal += region.num_portals;
+    }
+
+    if (end.first_sector != header.num_sectors || end.first_wall != header.num_walls || end.first_tier != header.num_tiers ||
+        end.first_vertex != header.num_vertices || end.first_portal != header.num_portals) {
+        printf("ERROR: %s: Regions do not cover the world\n", path);
+        unmapFile(data, size);
+        return false;
+    }
+
+    const uint32_t *region_neighbors = (const uint32_t *)(data + header.region_neighbors_offset);
+    const uint32_t *grid             = (const uint32_t *)(data + header.grid_offset);
+    for (unsigned i = 0; i < header.num_region_neighbors; ++i) {
+        if (region_neighbors[i] >= header.num_regions) {
+            printf("ERROR: %s: Ill-formed region neighbors\n", path);
+            unmapFile(data, size);
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < num_cells; ++i) {
+        if (grid[i] >= header.num_regions && grid[i] != INVALID_REGION_INDEX) {
+            printf("ERROR: %s: Ill-formed region grid\n", path);
+            unmapFile(data, size);
+            return false;
+        }
+    }
+
+    // an empty sector table, untouched pages of which never become resident
+    SectorDef *sectors = calloc(max(header.num_sectors, 1), sizeof(*sectors));
+    if (sectors == NULL) {
+        printf("ERROR: Out of memory loading %s\n", path);
+        unmapFile(data, size);
+        return false;
+    }
+
+    o_world->wall_lines       = (Line *)(data + header.wall_lines_offset);
+    o_world->wall_nexts       = (unsigned *)(data + header.wall_nexts_offset);
+    o_world->wall_is_skys     = (bool *)(data + header.wall_is_skys_offset);
+    o_world->wall_texture_ids = (unsigned *)(data + header.wall_texture_ids_offset);
+    o_world->wall_geometry    = (WallGeometry *)(data + header.wall_geometry_offset);
+    o_world->wall_vertices    = (unsigned *)(data + header.wall_vertices_offset);
+    o_world->vertices         = (vec2 *)(data + header.vertices_offset);
+    o_world->portals          = (Portal *)(data + header.portals_offset);
+    o_world->sectors          = sectors;
+
+    SectorGrid *sector_grid   = &o_world->sector_grid;
+    sector_grid->origin[0]    = header.sector_grid_origin[0];
+    sector_grid->origin[1]    = header.sector_grid_origin[1];
+    sector_grid->cell_size    = header.sector_grid_cell_size;
+    sector_grid->width        = header.sector_grid_width;
+    sector_grid->height       = header.sector_grid_height;
+    sector_grid->num_entries  = header.sector_grid_num_entries;
+    sector_grid->capacity     = header.sector_grid_num_entries;
+    sector_grid->cell_starts  = (unsigned *)(data + header.sector_grid_starts_offset);
+    sector_grid->cell_sectors = (unsigned *)(data + header.sector_grid_sectors_offset);
+
+    o_world->num_walls        = header.num_walls;
+    o_world->num_sectors      = header.num_sectors;
+    o_world->num_vertices     = header.num_vertices;
+    o_world->num_portals      = header.num_portals;
+    o_world->mapping          = data;
+    o_world->mapping_size     = size;
+    o_world->arena            = sectors;
+    o_world->generation       = nextWorldGeneration();
+
+    WorldMemory *memory = &o_world->memory;
+    memory->sectors     = header.num_sectors * sizeof(*sectors);
+    memory->tiers       = header.num_tiers * (2 * sizeof(float) + sizeof(bool) + 2 * sizeof(unsigned));
+    memory->walls       = header.num_walls * (sizeof(Line) + 2 * sizeof(unsigned) + sizeof(bool));
+    memory->derived     = header.num_walls * (sizeof(WallGeometry) + 2 * sizeof(unsigned)) +
+                      header.num_vertices * sizeof(vec2) + header.num_portals * sizeof(Portal) +
+                      (num_sector_cells + 1 + header.sector_grid_num_entries) * sizeof(uint32_t);
+    memory->allocated = memory->sectors;
+    memory->mapped    = size;
+
+    o_paged->regions             = (WorldRegion *)regions;
+    o_paged->region_neighbors    = (unsigned *)region_neighbors;
+    o_paged->grid                = (unsigned *)grid;
+    o_paged->num_regions         = header.num_regions;
+    o_paged->grid_width          = header.grid_width;
+    o_paged->grid_height         = header.grid_height;
+    o_paged->grid_origin[0]      = header.grid_origin[0];
+    o_paged->grid_origin[1]      = header.grid_origin[1];
+    o_paged->region_size         = header.region_size;
+    o_paged->records             = data + header.sectors_offset;
+    o_paged->floor_heights       = (float *)(data + header.floor_heights_offset);
+    o_paged->ceiling_heights     = (float *)(data + header.ceiling_heights_offset);
+    o_paged->is_skys             = (bool *)(data + header.is_skys_offset);
+    o_paged->floor_texture_ids   = (unsigned *)(data + header.floor_texture_ids_offset);
+    o_paged->ceiling_texture_ids = (unsigned *)(data + header.ceiling_texture_ids_offset);
+
+    return true;
+}
+
+typedef struct MemoryRange {
+    char *data;
+    size_t size;
+    char *lo, *hi; // the pages release may hand back lie within these
+} MemoryRange;
+
+#define NUM_REGION_RANGES 15
+#define VERTEX_RANGE      13
+
+static uintptr_t pageDown(uintptr_t address) {
+    return address & ~(uintptr_t)(WORLD_PAGE_SIZE - 1);
+}
+
+static uintptr_t pageUp(uintptr_t address) {
+    return pageDown(address + WORLD_PAGE_SIZE - 1);
+}
+
+// every part of the file and sector table a region owns, packed against its neighbors' parts
+static void getRegionRanges(PortalWorld world, PagedWorld paged, unsigned region_index, MemoryRange o_ranges[NUM_REGION_RANGES]) {
+    WorldRegion r    = paged.regions[region_index];
+    WorldRegion last = paged.regions[paged.num_regions - 1];
+    unsigned i       = 0;
+
+#define RANGE(array, first, count, total)                                                                               \
+    o_ranges[i++] = (MemoryRange){ (char *)((array) + (first)), (size_t)(count) * sizeof(*(array)), (char *)(array), \
+                                   (char *)((array) + (total)) }
+    RANGE(world.sectors, r.first_sector, r.num_sectors, world.num_sectors);
+    RANGE((PagedSectorRecord *)paged.records, r.first_sector, r.num_sectors, world.num_sectors);
+    RANGE(paged.floor_heights, r.first_tier, r.num_tiers, last.first_tier + last.num_tiers);
+    RANGE(paged.ceiling_heights, r.first_tier, r.num_tiers, last.first_tier + last.num_tiers);
+    RANGE(paged.is_skys, r.first_tier, r.num_tiers, last.first_tier + last.num_tiers);
+    RANGE(paged.floor_texture_ids, r.first_tier, r.num_tiers, last.first_tier + last.num_tiers);
+    RANGE(paged.ceiling_texture_ids, r.first_tier, r.num_tiers, last.first_tier + last.num_tiers);
+    RANGE(world.wall_lines, r.first_wall, r.num_walls, world.num_walls);
+    RANGE(world.wall_nexts, r.first_wall, r.num_walls, world.num_walls);
+    RANGE(world.wall_is_skys, r.first_wall, r.num_walls, world.num_walls);
+    RANGE(world.wall_texture_ids, r.first_wall, r.num_walls, world.num_walls);
+    RANGE(world.wall_geometry, r.first_wall, r.num_walls, world.num_walls);
+    RANGE(world.wall_vertices, r.first_wall * 2, r.num_walls * 2, world.num_walls * 2);
+    RANGE(world.vertices, r.first_vertex, r.num_vertices, world.num_vertices);
+    RANGE(world.portals, r.first_portal, r.num_portals, world.num_portals);
+#undef RANGE
+
+    assert(i == NUM_REGION_RANGES);
+
+    // file sections start on a page and own the padding after them, the sector table is heap memory
+    for (unsigned k = 1; k < NUM_REGION_RANGES; ++k) {
+        o_ranges[k].hi = (char *)pageUp((uintptr_t)o_ranges[k].hi);
+    }
+}
+
+static bool isRegionResident(PortalWorld world, PagedWorld paged, unsigned region_index) {
+    WorldRegion r = paged.regions[region_index];
+    return r.num_sectors > 0 && world.sectors[r.first_sector].num_tiers > 0;
+}
+
+// The pages of a region's range no other resident region has data on. Regions are packed, so the first and last
+// page are usually shared, and are only the region's own once every region on them is inactive.
+static MemoryRange getOwnedPages(PortalWorld world, PagedWorld paged, unsigned region_index, unsigned range_index) {
+    MemoryRange ranges[NUM_REGION_RANGES];
+    getRegionRanges(world, paged, region_index, ranges);
+    MemoryRange range = ranges[range_index];
+    if (range.size == 0) return (MemoryRange){ range.data, 0, range.lo, range.hi };
+
+    uintptr_t start = max(pageDown((uintptr_t)range.data), pageUp((uintptr_t)range.lo));
+    uintptr_t end   = min(pageUp((uintptr_t)range.data + range.size), pageDown((uintptr_t)range.hi));
+
+    for (unsigned j = region_index; j-- > 0 && start < end;) {
+        getRegionRanges(world, paged, j, ranges);
+        if ((uintptr_t)ranges[range_index].data + ranges[range_index].size <= start) break;
+        if (ranges[range_index].size > 0 && isRegionResident(world, paged, j)) {
+            start += WORLD_PAGE_SIZE;
+            break;
+        }
+    }
+    for (unsigned j = region_index + 1; j < paged.num_regions && start < end; ++j) {
+        getRegionRanges(world, paged, j, ranges);
+        if ((uintptr_t)ranges[range_index].data >= end) break;
+        if (ranges[range_index].size > 0 && isRegionResident(world, paged, j)) {
+            end -= WORLD_PAGE_SIZE;
+            break;
+        }
+    }
+
+    return (MemoryRange){ (char *)start, end > start ? end - start : 0, range.lo, range.hi };
+}
+
+// The memory only this region keeps resident, the pages releasing it would hand back. Counting it when a region
+// activates and again when it is released adds and removes each page once, whatever its neighbors do in between.
+// Vertices are left out, as release keeps them.
+size_t getRegionSize(PortalWorld world, PagedWorld paged, unsigned region_index) {
+    size_t size = 0;
+    for (unsigned i = 0; i < NUM_REGION_RANGES; ++i) {
+        if (i == VERTEX_RANGE) continue;
+        size += getOwnedPages(world, paged, region_index, i).size;
+    }
+    return size;
+}
+
+// only reads, so it may run on another thread while the region is inactive
+void prefetchRegion(PortalWorld world, PagedWorld paged, unsigned region_index) {
+    MemoryRange ranges[NUM_REGION_RANGES];
+    getRegionRanges(world, paged, region_index, ranges);
+
+    volatile char sink = 0;
+    for (unsigned i = 1; i < NUM_REGION_RANGES; ++i) { // the sector table is written on activation
+        for (size_t offset = 0; offset < ranges[i].size; offset += WORLD_PAGE_SIZE) {
+            sink += ranges[i].data[offset];
+        }
+        if (ranges[i].size > 0) sink += ranges[i].data[ranges[i].size - 1];
+    }
+    (void)sink;
+}
+
+bool activateRegion(PortalWorld *world, PagedWorld paged, unsigned region_index) {
+    assert(region_index < paged.num_regions);
+    WorldRegion r                    = paged.regions[region_index];
+    const PagedSectorRecord *records = paged.records;
+
+    // a corrupt region stays inactive, so the renderer never follows a bad index
+    for (unsigned i = r.first_sector; i < r.first_sector + r.num_sectors; ++i) {
+        PagedSectorRecord record = records[i];
+        if (record.start < r.first_wall || (uint64_t)record.start + record.length > (uint64_t)r.first_wall + r.num_walls ||
+            record.first_tier < r.first_tier || (uint64_t)record.first_tier + record.num_tiers > (uint64_t)r.first_tier + r.num_tiers ||
+            record.first_portal < r.first_portal ||
+            (uint64_t)record.first_portal + record.num_portals > (uint64_t)r.first_portal + r.num_portals ||
+            record.num_tiers < 1) {
+            printf("ERROR: Ill-formed sector %u in region %u\n", i, region_index);
+            return false;
+        }
+    }
+    for (unsigned k = r.first_wall * 2; k < (r.first_wall + r.num_walls) * 2; ++k) {
+        if (world->wall_vertices[k] >= world->num_vertices) {
+            printf("ERROR: Ill-formed wall %u in region %u\n", k / 2, region_index);
+            return false;
+        }
+    }
+    for (unsigned p = r.first_portal; p < r.first_portal + r.num_portals; ++p) {
+        Portal portal = world->portals[p];
+        if (portal.wall < r.first_wall || portal.wall >= r.first_wall + r.num_walls || portal.sector >= world->num_sectors ||
+            (portal.twin >= world->num_walls && portal.twin != INVALID_WALL_INDEX)) {
+            printf("ERROR: Ill-formed portal %u in region %u\n", p, region_index);
+            return false;
+        }
+    }
+
+    for (unsigned i = r.first_sector; i < r.first_sector + r.num_sectors; ++i) {
+        PagedSectorRecord record = records[i];
+        world->sectors[i]        = (SectorDef){
+            .start               = record.start,
+            .length              = record.length,
+            .num_tiers           = record.num_tiers,
+            .floor_heights       = paged.floor_heights + record.first_tier,
+            .ceiling_heights     = paged.ceiling_heights + record.first_tier,
+            .is_skys             = paged.is_skys + record.first_tier,
+            .floor_texture_ids   = paged.floor_texture_ids + record.first_tier,
+            .ceiling_texture_ids = paged.ceiling_texture_ids + record.first_tier,
+            .first_portal        = record.first_portal,
+            .num_portals         = record.num_portals,
+        };
+        classifySector(world, i);
+    }
+
+    world->edits++;
+    world->wall_edits++;
+    return true;
+}
+
+static void releasePages(MemoryRange pages) {
+    if (pages.size == 0) return;
+
+#ifdef _WIN32
+    // unlocking pages that were never locked drops them from the working set
+    VirtualUnlock(pages.data, pages.size);
+#else
+    madvise(pages.data, pages.size, MADV_DONTNEED);
+#endif
+}
+
+void releaseRegion(PortalWorld *world, PagedWorld paged, unsigned region_index) {
+    assert(region_index < paged.num_regions);
+    WorldRegion r = paged.regions[region_index];
+
+    // zero tiers marks a sector as not resident
+    memset(&world->sectors[r.first_sector], 0, r.num_sectors * sizeof(*world->sectors));
+    world->edits++;
+    world->wall_edits++;
+
+    for (unsigned i = 0; i < NUM_REGION_RANGES; ++i) {
+        // vertices on a region's border are used by its neighbors too, they are small enough to keep
+        if (i == VERTEX_RANGE) continue;
+        releasePages(getOwnedPages(*world, paged, region_index, i));
+    }
+}
+
+unsigned getSectorRegion(PagedWorld paged, unsigned sector_index) {
+    unsigned lo = 0, hi = paged.num_regions;
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        if (paged.regions[mid].first_sector + paged.regions[mid].num_sectors <= sector_index) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < paged.num_regions ? lo : INVALID_REGION_INDEX;
+}
+
+// the region whose grid cell holds the point, sectors near the cell's edge may be in a neighbor
+unsigned findRegion(PagedWorld paged, vec2 point) {
+    float x = (point[0] - paged.grid_origin[0]) / paged.region_size;
+    float y = (point[1] - paged.grid_origin[1]) / paged.region_size;
+    if (!(x >= 0.0f && y >= 0.0f && x < paged.grid_width && y < paged.grid_height)) return INVALID_REGION_INDEX;
+    return paged.grid[(unsigned)y * paged.grid_width + (unsigned)x];
+}
+
+// The lookups take the world by pointer so locating in bulk does not copy it for every position.
+
+static bool pointInSector(const PortalWorld *pod, unsigned sector_index, vec2 point) {
+    SectorDef sector = pod->sectors[sector_index];
+    Line *test_walls = &pod->wall_lines[sector.start];
+    if (sector.is_convex) return pointInConvexPoly(test_walls, sector.length, point);
+    return pointInPoly(test_walls, sector.length, point);
+}
+
+static unsigned searchSectorGrid(const PortalWorld *pod, vec2 point) {
+    SectorGrid grid = pod->sector_grid;
+    if (grid.cell_starts == NULL || grid.stale) {
+        for (unsigned s = 0; s < pod->num_sectors; ++s) {
+            if (pointInSector(pod, s, point)) return s;
+        }
+        return INVALID_SECTOR_INDEX;
+    }
+
+    unsigned x    = gridCell(point[0], grid.origin[0], grid.cell_size, grid.width);
+    unsigned y    = gridCell(point[1], grid.origin[1], grid.cell_size, grid.height);
+    unsigned cell = y * grid.width + x;
+
+    // paged worlds use the grid straight from the file, so its entries are checked as they are read
+    unsigned end = min(grid.cell_starts[cell + 1], grid.num_entries);
+    for (unsigned i = grid.cell_starts[cell]; i < end; ++i) {
+        unsigned s = grid.cell_sectors[i];
+        if (s < pod->num_sectors && pointInSector(pod, s, point)) return s;
+    }
+
+    return INVALID_SECTOR_INDEX;
+}
+
+static unsigned locateSector(const PortalWorld *pod, vec2 point, unsigned last_sector) {
+    if (last_sector < pod->num_sectors) {
+        // look at current sector
+        if (pointInSector(pod, last_sector, point)) {
+            return last_sector;
+        }
+
+        // look at neighbors
+        SectorDef current_sector = pod->sectors[last_sector];
+        for (unsigned i = 0; i < current_sector.num_portals; ++i) {
+            unsigned wall_next = pod->portals[current_sector.first_portal + i].sector;
+            if (pointInSector(pod, wall_next, point)) {
+                return wall_next;
+            }
+        }
+    }
+
+    return searchSectorGrid(pod, point);
+}
+
+static unsigned sectorTier(const SectorDef *sector, float z) {
+    for (unsigned i = 0; i < sector->num_tiers; ++i) {
+        float sector_world_floor   = sector->floor_heights[i];
+        float sector_world_ceiling = sector->ceiling_heights[i];
+
+        if (z >= sector_world_floor && z <= sector_world_ceiling) return i;
+    }
+    return INVALID_SECTOR_INDEX;
+}
+
+unsigned getCurrentSector(PortalWorld pod, vec2 point, unsigned last_sector) {
+    return locateSector(&pod, point, last_sector);
+}
+
+unsigned findSector(PortalWorld pod, vec2 point) {
+    return searchSectorGrid(&pod, point);
+}
+
+unsigned getSectorTier(PortalWorld pod, float z, unsigned sector_id) {
+    return sectorTier(&pod.sectors[sector_id], z);
+}
+
+void locateSectors(PortalWorld pod, const vec3 *positions, unsigned count, unsigned *io_sectors, unsigned *o_tiers) {
+    assert(positions != NULL || count == 0);
+    assert(io_sectors != NULL || count == 0);
+
+    for (unsigned i = 0; i < count; ++i) {
+        float *pos     = (float *)positions[i];
+        unsigned found = locateSector(&pod, pos, io_sectors[i]);
+        io_sectors[i]  = found;
+
+        if (o_tiers != NULL) {
+            o_tiers[i] = found < pod.num_sectors ? sectorTier(&pod.sectors[found], pos[2]) : INVALID_SECTOR_INDEX;
+        }
+    }
+}
+
+//
+//      RAYCASTS
+//
+
+// a ray crossing more sectors than this is looping through a broken map
+#define MAX_RAY_SECTORS 4096
+
+// exits found slightly before the entry point are rounding, the entry wall itself faces the other way
+#define RAY_EXIT_EPSILON 1e-5f
+
+// a sector's walls are intersected with the ray this many at a time
+#define RAY_WALL_BATCH 64
+
+static void setRayHit(RayHit *o_hit, RayHitType type, unsigned sector, unsigned tier, unsigned wall, float distance,
+                      const float *origin, const float *dir) {
+    o_hit->type     = type;
+    o_hit->sector   = sector;
+    o_hit->tier     = tier;
+    o_hit->wall     = wall;
+    o_hit->distance = distance;
+    o_hit->point[0] = origin[0] + dir[0] * distance;
+    o_hit->point[1] = origin[1] + dir[1] * distance;
+    o_hit->point[2] = origin[2] + dir[2] * distance;
+}
+
+bool castRay(PortalWorld pod, vec3 origin, vec3 dir, float max_distance, unsigned sector_hint, RayHit *o_hit) {
+    assert(o_hit != NULL);
+
+    vec3 d = { dir[0], dir[1], dir[2] };
+    if (normalize3d(d) == 0.0f) d[2] = 1.0f; // a zero direction looks straight up
+
+    unsigned sector = locateSector(&pod, origin, sector_hint);
+    unsigned tier   = sector < pod.num_sectors ? sectorTier(&pod.sectors[sector], origin[2]) : INVALID_SECTOR_INDEX;
+    if (tier == INVALID_SECTOR_INDEX) {
+        setRayHit(o_hit, RAY_HIT_OUTSIDE, sector, tier, INVALID_WALL_INDEX, 0.0f, origin, d);
+        return true;
+    }
+
+    // distances along the ray are measured from the origin every step, so errors do not build up
+    vec2 ray[2]      = { { origin[0], origin[1] }, { origin[0] + d[0], origin[1] + d[1] } };
+    float flat_sqr   = d[0] * d[0] + d[1] * d[1];
+    float entered_at = 0.0f;
+
+    for (unsigned step = 0; step < MAX_RAY_SECTORS; ++step) {
+        SectorDef current = pod.sectors[sector];
+
+        // the nearest wall the ray leaves through, walls it would enter through face it
+        unsigned exit_wall = INVALID_WALL_INDEX;
+        float exit_at      = INFINITY;
+        float ts[RAY_WALL_BATCH];
+        for (unsigned k = current.start; flat_sqr > 0.0f && k < current.start + current.length; ++k) {
+            unsigned batch = (k - current.start) % RAY_WALL_BATCH;
+            if (batch == 0) {
+                unsigned count = min(current.start + current.length - k, RAY_WALL_BATCH);
+                intersectSegmentsRay(&pod.wall_lines[k], count, ray, ts);
+            }
+
+            float t = ts[batch];
+            if (t < 0.0f || dot2d(pod.wall_geometry[k].normal, d) >= 0.0f) continue;
+
+            Line wall = pod.wall_lines[k];
+            vec2 hit  = {
+                wall.points[0][0] + (wall.points[1][0] - wall.points[0][0]) * t - origin[0],
+                wall.points[0][1] + (wall.points[1][1] - wall.points[0][1]) * t - origin[1],
+            };
+            float at = (hit[0] * d[0] + hit[1] * d[1]) / flat_sqr;
+            if (at < entered_at - RAY_EXIT_EPSILON * max(entered_at, 1.0f) || at >= exit_at) continue;
+
+            exit_wall = k;
+            exit_at   = max(at, entered_at);
+        }
+
+        // the floor or ceiling when the ray reaches it before the wall
+        float floor          = current.floor_heights[tier];
+        float ceiling        = current.ceiling_heights[tier];
+        float flat_at        = INFINITY;
+        RayHitType flat_type = RAY_HIT_NONE;
+        if (d[2] < 0.0f) {
+            flat_at   = (floor - origin[2]) / d[2];
+            flat_type = RAY_HIT_FLOOR;
+        } else if (d[2] > 0.0f) {
+            flat_at   = (ceiling - origin[2]) / d[2];
+            flat_type = RAY_HIT_CEILING;
+        }
+
+        if (flat_type != RAY_HIT_NONE && flat_at <= exit_at) {
+            if (flat_at > max_distance) break;
+            setRayHit(o_hit, flat_type, sector, tier, INVALID_WALL_INDEX, max(flat_at, entered_at), origin, d);
+            return true;
+        }
+
+        if (exit_wall == INVALID_WALL_INDEX || exit_at > max_distance) break;
+
+        // through the portal when the neighbor has a tier at the crossing height
+        unsigned next      = pod.wall_nexts[exit_wall];
+        unsigned next_tier = INVALID_SECTOR_INDEX;
+        if (isPortal(next, sector, pod.num_sectors) && pod.sectors[next].num_tiers > 0) {
+            next_tier = sectorTier(&pod.sectors[next], origin[2] + d[2] * exit_at);
+        }
+
+        if (next_tier == INVALID_SECTOR_INDEX) {
+            setRayHit(o_hit, RAY_HIT_WALL, sector, tier, exit_wall, exit_at, origin, d);
+            return true;
+        }
+
+        sector     = next;
+        tier       = next_tier;
+        entered_at = exit_at;
+    }
+
+    setRayHit(o_hit, RAY_HIT_NONE, sector, tier, INVALID_WALL_INDEX, max_distance, origin, d);
+    return false;
+}
+
+//
+//      LINE OF SIGHT
+//
+
+// targets this close to where the ray stops, like one standing on a floor, are still seen
+#define SIGHT_EPSILON 1e-4f
+
+bool hasLineOfSight(PortalWorld pod, vec3 from, vec3 to, unsigned sector_hint) {
+    vec3 dir       = { to[0] - from[0], to[1] - from[1], to[2] - from[2] };
+    float distance = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+
+    RayHit hit;
+    if (!castRay(pod, from, dir, distance, sector_hint, &hit)) return true;
+    return hit.type != RAY_HIT_OUTSIDE && hit.distance >= distance - SIGHT_EPSILON * max(distance, 1.0f);
+}
+
+bool createSightCache(SightCache *o_cache, unsigned capacity, float cell_size) {
+    assert(o_cache != NULL);
+    assert(cell_size > 0.0f);
+
+    unsigned size = 1;
+    while (size < capacity && size < (1u << 31)) size <<= 1;
+
+    memset(o_cache, 0, sizeof(*o_cache));
+    o_cache->entries = calloc(size, sizeof(*o_cache->entries));
+    if (o_cache->entries == NULL) {
+        printf("ERROR: Failed to allocate a line of sight cache of %u entries\n", size);
+        return false;
+    }
+
+    o_cache->capacity      = size;
+    o_cache->generation    = 1;
+    o_cache->inv_cell_size = 1.0f / cell_size;
+    return true;
+}
+
+void freeSightCache(SightCache cache) {
+    free(cache.entries);
+}
+
+void clearSightCache(SightCache *cache) {
+    // entries are only cleared for real once the generations wrap
+    if (++cache->generation == 0) {
+        memset(cache->entries, 0, cache->capacity * sizeof(*cache->entries));
+        cache->generation = 1;
+    }
+}
+
+static uint32_t hashSightKey(const SightKey *key) {
+    uint32_t hash = 2166136261u;
+    const uint32_t *words = (const uint32_t *)key;
+    for (unsigned i = 0; i < sizeof(*key) / sizeof(*words); ++i) {
+        hash = (hash ^ words[i]) * 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+void checkLinesOfSight(PortalWorld pod, SightCache *cache, SightQuery *queries, unsigned count, bool *o_visible) {
+    assert(queries != NULL || count == 0);
+    assert(o_visible != NULL || count == 0);
+
+    if (cache != NULL && (cache->world_generation != pod.generation || cache->edits != pod.edits)) {
+        clearSightCache(cache);
+        cache->world_generation = pod.generation;
+        cache->edits            = pod.edits;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        SightQuery *query  = &queries[i];
+        query->from_sector = locateSector(&pod, query->from, query->from_sector);
+        query->to_sector   = locateSector(&pod, query->to, query->to_sector);
+
+        // nothing outside the world sees or is seen, and nothing outside the baked sets either
+        if (query->from_sector >= pod.num_sectors || query->to_sector >= pod.num_sectors ||
+            !isSectorVisible(pod, query->from_sector, query->to_sector)) {
+            o_visible[i] = false;
+            continue;
+        }
+
+        if (cache == NULL) {
+            o_visible[i] = hasLineOfSight(pod, query->from, query->to, query->from_sector);
+            continue;
+        }
+
+        SightKey key;
+        memset(&key, 0, sizeof(key));
+        key.from_sector = query->from_sector;
+        key.to_sector   = query->to_sector;
+        for (unsigned k = 0; k < 3; ++k) {
+            key.cells[k]     = (int)floorf(query->from[k] * cache->inv_cell_size);
+            key.cells[k + 3] = (int)floorf(query->to[k] * cache->inv_cell_size);
+        }
+
+        SightEntry *entry = &cache->entries[hashSightKey(&key) & (cache->capacity - 1)];
+        if (entry->generation == cache->generation && memcmp(&entry->key, &key, sizeof(key)) == 0) {
+            o_visible[i] = entry->visible;
+            cache->hits++;
+            continue;
+        }
+
+        o_visible[i]      = hasLineOfSight(pod, query->from, query->to, query->from_sector);
+        entry->key        = key;
+        entry->generation = cache->generation;
+        entry->visible    = o_visible[i];
+        cache->misses++;
+    }
+}
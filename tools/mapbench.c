@@ -0,0 +1,461 @@
+// Measures how a map scales: load time, world memory, point location, collision, line of sight, traversal and headless frame time.
+//
+//  mapbench [-frames n] [-res WxH] [-locates n] [-bodies n] [-sights n] [-visits n] [-o results.csv] map
+//  mapbench -kernels
+//
+// Prints a single CSV row, or appends it to -o, so runs over generated maps can be plotted:
+//  sectors,walls,load_ms,world_bytes,locate_neighbor_ns,locate_teleport_ns,locate_batch_ns,collide_ns,sight_ns,sight_cached_ns,visit_us,frame_ms
+//
+// -kernels instead times the packed and vector color arithmetic, over single pixels and over the
+// spans fog is drawn with, against doing it a channel at a time, and the batched ray against
+// segments test against testing a segment at a time, checking that both give the same results.
+
+#include "../src/portals.h"
+#include "../src/draw.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <time.h>
+
+#define BENCH_TICKS 10
+#define BENCH_VISIT_RADIUS 32.0f
+#define BENCH_KERNEL_PIXELS (320 * 240)
+#define BENCH_KERNEL_PASSES 200
+#define BENCH_KERNEL_SEGMENTS 65536
+#define BENCH_KERNEL_RAYS 100000
+
+// the renderer expects these from main.c
+Image g_image_array[3];
+Image g_sky_image_array[1];
+bool g_render_occlusion = false;
+
+static double nowMs(void) {
+    return clock() * 1000.0 / CLOCKS_PER_SEC;
+}
+
+static size_t worldBytes(PortalWorld world) {
+    WorldMemory memory = getWorldMemory(world);
+    return memory.allocated + memory.mapped;
+}
+
+// average of the sector's wall starts, inside for the convex cells mapgen makes
+static void sectorCenter(PortalWorld world, unsigned sector_index, vec2 o_center) {
+    SectorDef sector = world.sectors[sector_index];
+    o_center[0]      = 0.0f;
+    o_center[1]      = 0.0f;
+    for (unsigned i = 0; i < sector.length; ++i) {
+        o_center[0] += world.wall_lines[sector.start + i].points[0][0] / sector.length;
+        o_center[1] += world.wall_lines[sector.start + i].points[0][1] / sector.length;
+    }
+}
+
+static bool countVisit(unsigned sector_index, unsigned hops, float distance, void *user_data) {
+    return true;
+}
+
+static unsigned firstNeighbor(PortalWorld world, unsigned sector_index) {
+    SectorDef sector = world.sectors[sector_index];
+    return sector.num_portals > 0 ? world.portals[sector.first_portal].sector : sector_index;
+}
+
+// round(x / 255), as color.c divides channel products
+static unsigned div255(unsigned x) {
+    return (x + 128 + ((x + 128) >> 8)) >> 8;
+}
+
+static Color mulChannels(Color c, uint8_t m) {
+    return (Color){ .r = div255(c.r * m), .g = div255(c.g * m), .b = div255(c.b * m), .a = div255(c.a * m) };
+}
+
+static Color mixChannels(Color c0, Color c1) {
+    return (Color){ .r = div255(c0.r * c1.r), .g = div255(c0.g * c1.g), .b = div255(c0.b * c1.b), .a = div255(c0.a * c1.a) };
+}
+
+static Color lerpChannels(Color c0, Color c1, uint8_t t) {
+    unsigned s = 255 - t;
+    return (Color){
+        .r = div255(c0.r * s + c1.r * t),
+        .g = div255(c0.g * s + c1.g * t),
+        .b = div255(c0.b * s + c1.b * t),
+        .a = div255(c0.a * s + c1.a * t),
+    };
+}
+
+// Both are called through a pointer, as the renderer calls the packed ones from another file, so
+// neither is inlined into the loop.
+static double timeMulColor(Color (*mul_color)(Color, uint8_t), const Color *colors, const uint8_t *factors, Color *o_results) {
+    double start = nowMs();
+    for (unsigned pass = 0; pass < BENCH_KERNEL_PASSES; ++pass) {
+        for (unsigned i = 0; i < BENCH_KERNEL_PIXELS; ++i) {
+            o_results[i] = mul_color(colors[i], factors[i] + pass);
+        }
+    }
+    return (nowMs() - start) * 1000000.0 / ((double)BENCH_KERNEL_PIXELS * BENCH_KERNEL_PASSES);
+}
+
+static double timeMixColor(Color (*mix_color)(Color, Color), const Color *colors, const Color *targets, Color *o_results) {
+    double start = nowMs();
+    for (unsigned pass = 0; pass < BENCH_KERNEL_PASSES; ++pass) {
+        for (unsigned i = 0; i < BENCH_KERNEL_PIXELS; ++i) {
+            o_results[i] = mix_color(colors[i], targets[(i + pass) % BENCH_KERNEL_PIXELS]);
+        }
+    }
+    return (nowMs() - start) * 1000000.0 / ((double)BENCH_KERNEL_PIXELS * BENCH_KERNEL_PASSES);
+}
+
+static double timeLerpColor(Color (*lerp_color)(Color, Color, uint8_t), const Color *colors, const Color *targets, const uint8_t *factors,
+                            Color *o_results) {
+    double start = nowMs();
+    for (unsigned pass = 0; pass < BENCH_KERNEL_PASSES; ++pass) {
+        for (unsigned i = 0; i < BENCH_KERNEL_PIXELS; ++i) {
+            o_results[i] = lerp_color(colors[i], targets[i], factors[i] + pass);
+        }
+    }
+    return (nowMs() - start) * 1000000.0 / ((double)BENCH_KERNEL_PIXELS * BENCH_KERNEL_PASSES);
+}
+
+// Each ray against its own run of num_lines segments, which must divide BENCH_KERNEL_SEGMENTS.
+// A segment's t lands at the segment's index either way, so the two runs can be compared.
+static void benchSegmentsRay(Line *lines, vec2 (*rays)[2], unsigned num_lines, float *o_ts, float *o_expected) {
+    double start = nowMs();
+    for (unsigned r = 0; r < BENCH_KERNEL_RAYS; ++r) {
+        unsigned first = r * num_lines % BENCH_KERNEL_SEGMENTS;
+        for (unsigned i = first; i < first + num_lines; ++i) {
+            if (!intersectSegmentRay(lines[i].points, rays[r], &o_expected[i])) o_expected[i] = -1.0f;
+        }
+    }
+    double scalar_ns = (nowMs() - start) * 1000000.0 / ((double)BENCH_KERNEL_RAYS * num_lines);
+
+    start = nowMs();
+    for (unsigned r = 0; r < BENCH_KERNEL_RAYS; ++r) {
+        unsigned first = r * num_lines % BENCH_KERNEL_SEGMENTS;
+        intersectSegmentsRay(&lines[first], num_lines, rays[r], &o_ts[first]);
+    }
+    double batched_ns = (nowMs() - start) * 1000000.0 / ((double)BENCH_KERNEL_RAYS * num_lines);
+
+    bool same = memcmp(o_ts, o_expected, BENCH_KERNEL_SEGMENTS * sizeof(*o_ts)) == 0;
+    printf("intersectSegmentsRay: %.2f ns per segment one at a time, %.2f batched %u at a time%s\n", scalar_ns, batched_ns, num_lines,
+           same ? "" : ", RESULTS DIFFER");
+}
+
+static void benchKernels(void) {
+    Color *colors    = malloc(BENCH_KERNEL_PIXELS * sizeof(*colors));
+    Color *targets   = malloc(BENCH_KERNEL_PIXELS * sizeof(*targets));
+    Color *results   = malloc(BENCH_KERNEL_PIXELS * sizeof(*results));
+    Color *expected  = malloc(BENCH_KERNEL_PIXELS * sizeof(*expected));
+    uint8_t *factors = malloc(BENCH_KERNEL_PIXELS * sizeof(*factors));
+    if (colors == NULL || targets == NULL || results == NULL || expected == NULL || factors == NULL) return;
+
+    srand(1);
+    for (unsigned i = 0; i < BENCH_KERNEL_PIXELS; ++i) {
+        colors[i]  = RGBA(rand(), rand(), rand(), rand());
+        targets[i] = RGBA(rand(), rand(), rand(), rand());
+        factors[i] = rand();
+    }
+
+    double channels_ns = timeMulColor(mulChannels, colors, factors, expected);
+    double packed_ns   = timeMulColor(mulColor, colors, factors, results);
+    bool same          = memcmp(results, expected, BENCH_KERNEL_PIXELS * sizeof(*results)) == 0;
+    printf("mulColor:  %.2f ns per pixel by channel, %.2f packed%s\n", channels_ns, packed_ns, same ? "" : ", RESULTS DIFFER");
+
+    channels_ns = timeLerpColor(lerpChannels, colors, targets, factors, expected);
+    packed_ns   = timeLerpColor(lerpColor, colors, targets, factors, results);
+    same        = memcmp(results, expected, BENCH_KERNEL_PIXELS * sizeof(*results)) == 0;
+    printf("lerpColor: %.2f ns per pixel by channel, %.2f packed%s\n", channels_ns, packed_ns, same ? "" : ", RESULTS DIFFER");
+
+    channels_ns = timeMixColor(mixChannels, colors, targets, expected);
+    packed_ns   = timeMixColor(mixColor, colors, targets, results);
+    same        = memcmp(results, expected, BENCH_KERNEL_PIXELS * sizeof(*results)) == 0;
+    printf("mixColor:  %.2f ns per pixel by channel, %.2f vector%s\n", channels_ns, packed_ns, same ? "" : ", RESULTS DIFFER");
+
+    // a span works in place, so each pass blends the last one's results further
+    memcpy(results, colors, BENCH_KERNEL_PIXELS * sizeof(*results));
+    double start = nowMs();
+    for (unsigned pass = 0; pass < BENCH_KERNEL_PASSES; ++pass) {
+        lerpColorSpan(results, targets, factors, BENCH_KERNEL_PIXELS);
+    }
+    double span_ns = (nowMs() - start) * 1000000.0 / ((double)BENCH_KERNEL_PIXELS * BENCH_KERNEL_PASSES);
+
+    memcpy(results, colors, BENCH_KERNEL_PIXELS * sizeof(*results));
+    lerpColorSpan(results, targets, factors, BENCH_KERNEL_PIXELS);
+    for (unsigned i = 0; i < BENCH_KERNEL_PIXELS; ++i) {
+        expected[i] = lerpChannels(colors[i], targets[i], factors[i]);
+    }
+    same = memcmp(results, expected, BENCH_KERNEL_PIXELS * sizeof(*results)) == 0;
+    printf("lerpColorSpan: %.2f ns per pixel%s\n", span_ns, same ? "" : ", RESULTS DIFFER");
+
+    free(colors);
+    free(targets);
+    free(results);
+    free(expected);
+    free(factors);
+
+    // segments and rays on a grid of whole units, like map walls, so some hit ends exactly
+    Line *lines        = malloc(BENCH_KERNEL_SEGMENTS * sizeof(*lines));
+    vec2(*rays)[2]     = malloc(BENCH_KERNEL_RAYS * sizeof(*rays));
+    float *ts          = calloc(BENCH_KERNEL_SEGMENTS, sizeof(*ts));
+    float *expected_ts = calloc(BENCH_KERNEL_SEGMENTS, sizeof(*expected_ts));
+    if (lines == NULL || rays == NULL || ts == NULL || expected_ts == NULL) return;
+
+    for (unsigned i = 0; i < BENCH_KERNEL_SEGMENTS; ++i) {
+        for (unsigned k = 0; k < 4; ++k) {
+            lines[i].points[k / 2][k % 2] = (float)(rand() % 64);
+        }
+    }
+    for (unsigned i = 0; i < BENCH_KERNEL_RAYS; ++i) {
+        for (unsigned k = 0; k < 4; ++k) {
+            rays[i][k / 2][k % 2] = (float)(rand() % 64);
+        }
+    }
+
+    benchSegmentsRay(lines, rays, 4, ts, expected_ts);
+    benchSegmentsRay(lines, rays, 64, ts, expected_ts);
+
+    free(lines);
+    free(rays);
+    free(ts);
+    free(expected_ts);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned num_frames  = 100;
+    int width            = DEFAULT_SCREEN_WIDTH;
+    int height           = DEFAULT_SCREEN_HEIGHT;
+    unsigned num_locates = 100000;
+    unsigned num_bodies  = 1000;
+    unsigned num_sights  = 10000;
+    unsigned num_visits  = 1000;
+    const char *path     = NULL;
+    const char *results  = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            num_frames = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-res") == 0 && i + 1 < argc) {
+            if (!parseResolution(argv[++i], &width, &height)) {
+                printf("ERROR: Resolution %s is not WxH from %i to %i\n", argv[i], MIN_SCREEN_SIZE, MAX_SCREEN_SIZE);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-locates") == 0 && i + 1 < argc) {
+            num_locates = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-bodies") == 0 && i + 1 < argc) {
+            num_bodies = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-sights") == 0 && i + 1 < argc) {
+            num_sights = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-visits") == 0 && i + 1 < argc) {
+            num_visits = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            results = argv[++i];
+        } else if (strcmp(argv[i], "-kernels") == 0) {
+            benchKernels();
+            return EXIT_SUCCESS;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (path == NULL) {
+        printf("usage: mapbench [-frames n] [-res WxH] [-locates n] [-bodies n] [-sights n] [-visits n] [-o results.csv] map\n");
+        printf("       mapbench -kernels\n");
+        return EXIT_FAILURE;
+    }
+
+    PortalWorld world;
+    double start = nowMs();
+    if (!loadWorld(path, &world, 1.0f)) return EXIT_FAILURE;
+    double load_ms = nowMs() - start;
+
+    if (world.num_sectors == 0) {
+        printf("ERROR: %s has no sectors\n", path);
+        return EXIT_FAILURE;
+    }
+
+    // locating from a neighboring sector, the common case for moving things
+    srand(1);
+    unsigned found = 0;
+    start          = nowMs();
+    for (unsigned i = 0; i < num_locates; ++i) {
+        unsigned sector = (unsigned)rand() % world.num_sectors;
+        vec2 point;
+        sectorCenter(world, sector, point);
+        found += getCurrentSector(world, point, firstNeighbor(world, sector)) == sector;
+    }
+    double neighbor_ns = (nowMs() - start) * 1000000.0 / max(num_locates, 1);
+
+    // locating without a hint, which falls back to the sector grid
+    unsigned num_teleports = max(num_locates / 100, 1);
+    start                  = nowMs();
+    for (unsigned i = 0; i < num_teleports; ++i) {
+        unsigned sector = (unsigned)rand() % world.num_sectors;
+        vec2 point;
+        sectorCenter(world, sector, point);
+        found += getCurrentSector(world, point, INVALID_SECTOR_INDEX) == sector;
+    }
+    double teleport_ns = (nowMs() - start) * 1000000.0 / num_teleports;
+
+    // the same neighbor locates as one batch, with tiers
+    vec3 *positions   = malloc(max(num_locates, 1) * sizeof(*positions));
+    unsigned *sectors = malloc(max(num_locates, 1) * sizeof(*sectors));
+    unsigned *expect  = malloc(max(num_locates, 1) * sizeof(*expect));
+    unsigned *tiers   = malloc(max(num_locates, 1) * sizeof(*tiers));
+    if (positions == NULL || sectors == NULL || expect == NULL || tiers == NULL) return EXIT_FAILURE;
+
+    for (unsigned i = 0; i < num_locates; ++i) {
+        expect[i]  = (unsigned)rand() % world.num_sectors;
+        sectors[i] = firstNeighbor(world, expect[i]);
+        sectorCenter(world, expect[i], positions[i]);
+        positions[i][2] = world.sectors[expect[i]].floor_heights[0];
+    }
+
+    start = nowMs();
+    locateSectors(world, positions, num_locates, sectors, tiers);
+    double batch_ns = (nowMs() - start) * 1000000.0 / max(num_locates, 1);
+
+    for (unsigned i = 0; i < num_locates; ++i) {
+        found += sectors[i] == expect[i] && tiers[i] == 0;
+    }
+    free(positions);
+    free(sectors);
+    free(expect);
+    free(tiers);
+
+    // bodies wandering from sector centers for a number of ticks, each moving about its radius
+    CollisionBody *bodies = malloc(max(num_bodies, 1) * sizeof(*bodies));
+    vec2 *moves           = malloc(max(num_bodies, 1) * sizeof(*moves));
+    if (bodies == NULL || moves == NULL) return EXIT_FAILURE;
+
+    for (unsigned i = 0; i < num_bodies; ++i) {
+        unsigned sector = (unsigned)rand() % world.num_sectors;
+        bodies[i]       = (CollisionBody){ .radius = 0.5f, .height = 1.8f, .step_height = 0.6f, .sector = sector };
+        sectorCenter(world, sector, bodies[i].pos);
+        bodies[i].pos[2] = world.sectors[sector].floor_heights[0];
+    }
+
+    double collide_ms = 0.0;
+    for (unsigned tick = 0; tick < BENCH_TICKS; ++tick) {
+        for (unsigned i = 0; i < num_bodies; ++i) {
+            float angle = rand() * (2.0f * M_PI / RAND_MAX);
+            moves[i][0] = cosf(angle) * 0.5f;
+            moves[i][1] = sinf(angle) * 0.5f;
+        }
+
+        start = nowMs();
+        moveBodies(world, bodies, moves, num_bodies);
+        collide_ms += nowMs() - start;
+    }
+    double collide_ns = collide_ms * 1000000.0 / max(num_bodies * BENCH_TICKS, 1);
+    free(bodies);
+    free(moves);
+
+    // eye to eye between sectors a few random portals apart, then the same queries from the cache
+    SightQuery *queries = malloc(max(num_sights, 1) * sizeof(*queries));
+    bool *visible       = malloc(max(num_sights, 1) * sizeof(*visible));
+    if (queries == NULL || visible == NULL) return EXIT_FAILURE;
+
+    for (unsigned i = 0; i < num_sights; ++i) {
+        unsigned from = (unsigned)rand() % world.num_sectors;
+        unsigned to   = from;
+        for (unsigned k = 0; k < 4 && world.sectors[to].num_portals > 0; ++k) {
+            SectorDef sector = world.sectors[to];
+            to               = world.portals[sector.first_portal + (unsigned)rand() % sector.num_portals].sector;
+        }
+
+        queries[i] = (SightQuery){ .from_sector = from, .to_sector = to };
+        sectorCenter(world, from, queries[i].from);
+        sectorCenter(world, to, queries[i].to);
+        queries[i].from[2] = world.sectors[from].floor_heights[0] + 1.65f;
+        queries[i].to[2]   = world.sectors[to].floor_heights[0] + 1.65f;
+    }
+
+    SightCache cache;
+    if (!createSightCache(&cache, num_sights * 2, 1.0f)) return EXIT_FAILURE;
+
+    start           = nowMs();
+    checkLinesOfSight(world, NULL, queries, num_sights, visible);
+    double sight_ns = (nowMs() - start) * 1000000.0 / max(num_sights, 1);
+
+    checkLinesOfSight(world, &cache, queries, num_sights, visible);
+    start                  = nowMs();
+    checkLinesOfSight(world, &cache, queries, num_sights, visible);
+    double sight_cached_ns = (nowMs() - start) * 1000000.0 / max(num_sights, 1);
+    freeSightCache(cache);
+    free(queries);
+    free(visible);
+
+    // every sector within a radius of random sector centers, as a light or a sound would gather them
+    SectorVisitor visitor;
+    if (!createSectorVisitor(&visitor, world.num_sectors)) return EXIT_FAILURE;
+
+    VisitLimits limits = { .max_distance = BENCH_VISIT_RADIUS, .max_hops = ~0u, .max_sectors = ~0u };
+    start              = nowMs();
+    for (unsigned i = 0; i < num_visits; ++i) {
+        unsigned sector = (unsigned)rand() % world.num_sectors;
+        vec2 origin;
+        sectorCenter(world, sector, origin);
+        visitSectors(world, &visitor, sector, origin, limits, countVisit, NULL);
+    }
+    double visit_us = (nowMs() - start) * 1000.0 / max(num_visits, 1);
+    freeSectorVisitor(visitor);
+
+    unsigned num_checked = 2 * num_locates + num_teleports;
+    if (found != num_checked) {
+        printf("WARNING: %u of %u locates found the wrong sector\n", num_checked - found, num_checked);
+    }
+
+    // headless frames with flat textures, turning on the spot in a random sector
+    Color flat      = COLOR_WHITE;
+    Image flat_image = { .data = &flat, .width = 1, .height = 1 };
+    for (unsigned i = 0; i < 3; ++i) {
+        g_image_array[i] = flat_image;
+    }
+    g_sky_image_array[0] = flat_image;
+
+    RenderTarget target = {
+        .pixels       = malloc((size_t)width * height * sizeof(*target.pixels)),
+        .depth_buffer = malloc((size_t)width * height * sizeof(*target.depth_buffer)),
+        .width        = width,
+        .height       = height,
+    };
+    if (target.pixels == NULL || target.depth_buffer == NULL) return EXIT_FAILURE;
+    setRenderTarget(target);
+
+    Camera cam;
+    memset(&cam, 0, sizeof(cam));
+    cam.sector = (unsigned)rand() % world.num_sectors;
+    cam.tier   = 0;
+    cam.fov    = 90.0f * TO_RADS;
+    sectorCenter(world, cam.sector, cam.pos);
+    cam.pos[2] = world.sectors[cam.sector].floor_heights[0] + 1.65f;
+
+    start = nowMs();
+    for (unsigned i = 0; i < num_frames; ++i) {
+        cam.rot        = i * (2.0f * M_PI / max(num_frames, 1));
+        cam.rot_cos    = cosf(cam.rot);
+        cam.rot_sin    = sinf(cam.rot);
+        cam.forward[0] = cam.rot_sin;
+        cam.forward[1] = -cam.rot_cos;
+        cam.forward[2] = 0.0f;
+
+        clearFrame(target.depth_buffer, NULL);
+        renderPortalWorld(world, cam);
+        fillUncovered(target.depth_buffer, COLOR_BLACK);
+    }
+    double frame_ms = (nowMs() - start) / max(num_frames, 1);
+
+    FILE *out = results != NULL ? fopen(results, "a") : stdout;
+    if (out == NULL) {
+        printf("ERROR: Failed to open %s\n", results);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "%u,%u,%.3f,%zu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.3f\n", world.num_sectors, world.num_walls, load_ms, worldBytes(world), neighbor_ns,
+            teleport_ns, batch_ns, collide_ns, sight_ns, sight_cached_ns, visit_us, frame_ms);
+    if (out != stdout) fclose(out);
+
+    free(target.pixels);
+    free(target.depth_buffer);
+    freeWorld(world);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+// Compiles a text .map into a binary world that loadWorld can map directly.
+//
+//  mapc [-s scale] [-r region_size] [-split] [-pvs] [-j threads] input.map output.mapb
+//
+// The map is validated first and nothing is written if it has errors. With -split, concave
+// sectors are split into convex pieces joined by portals, which point location and the renderer
+// handle faster and without overlapping walls.
+//
+// With -pvs the sectors each sector may see are baked in, on -j threads or one per CPU, and the
+// renderer skips portals into the rest. Moving a vertex at runtime turns the sets off.
+//
+// The scale is baked into the wall coordinates. Loading with the same scale is zero-copy,
+// any other scale rescales the walls at load time.
+//
+// With -r the output is a paged world for streaming instead, split into square regions of the
+// given size in scaled units. Paged worlds only load at the scale they were compiled with and
+// never have visible sets, since paging renumbers the sectors.
+
+#include "../src/portals.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void printUsage(void) {
+    printf("usage: mapc [-s scale] [-r region_size] [-split] [-pvs] [-j threads] input.map output.mapb\n");
+}
+
+int main(int argc, char *argv[]) {
+    float scale        = 1.0f;
+    float region_size  = 0.0f;
+    bool split         = false;
+    bool pvs           = false;
+    unsigned threads   = 0;
+    const char *input  = NULL;
+    const char *output = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            scale = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            region_size = strtof(argv[++i], NULL);
+            if (!(region_size > 0.0f)) {
+                printUsage();
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "-split") == 0) {
+            split = true;
+        } else if (strcmp(argv[i], "-pvs") == 0) {
+            pvs = true;
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = strtoul(argv[++i], NULL, 10);
+        } else if (input == NULL) {
+            input = argv[i];
+        } else if (output == NULL) {
+            output = argv[i];
+        } else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (input == NULL || output == NULL) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    PortalWorld world;
+    if (!loadWorld(input, &world, scale)) return EXIT_FAILURE;
+
+    if (validateWorld(world) > 0) {
+        printf("ERROR: %s has errors, nothing was written\n", input);
+        freeWorld(world);
+        return EXIT_FAILURE;
+    }
+
+    if (split) {
+        PortalWorld split_world;
+        unsigned num_split;
+        if (!splitConcaveSectors(world, &split_world, &num_split)) {
+            freeWorld(world);
+            return EXIT_FAILURE;
+        }
+
+        printf("Split %u concave sectors into %u more sectors\n", num_split, split_world.num_sectors - world.num_sectors);
+        freeWorld(world);
+        world = split_world;
+    }
+
+    unsigned num_convex = 0;
+    for (unsigned i = 0; i < world.num_sectors; ++i) {
+        num_convex += world.sectors[i].is_convex;
+    }
+    printf("%u of %u sectors are convex\n", num_convex, world.num_sectors);
+
+    if (pvs && region_size > 0.0f) {
+        printf("WARNING: Paged worlds have no visible sets, ignoring -pvs\n");
+    } else if (pvs) {
+        PortalWorld pvs_world;
+        unsigned num_saturated;
+        struct timespec start, end;
+        timespec_get(&start, TIME_UTC);
+        if (!bakeVisibility(world, &pvs_world, threads, &num_saturated)) {
+            freeWorld(world);
+            return EXIT_FAILURE;
+        }
+        timespec_get(&end, TIME_UTC);
+        double bake_ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+        freeWorld(world);
+        world = pvs_world;
+
+        // average set size, decoded, so it says how much the renderer can skip
+        uint8_t *bits        = malloc((world.num_sectors + 7) / 8 + 1);
+        uint64_t num_visible = 0;
+        for (unsigned i = 0; bits != NULL && i < world.num_sectors; ++i) {
+            getVisibleSectors(world, i, bits);
+            for (unsigned k = 0; k < world.num_sectors; ++k) {
+                num_visible += (bits[k >> 3] >> (k & 7)) & 1;
+            }
+        }
+        free(bits);
+
+        printf("Baked visible sets in %.0f ms: %.1f sectors seen on average, %u bytes, %u sectors see everything\n", bake_ms,
+               (double)num_visible / max(world.num_sectors, 1), world.visibility.size, num_saturated);
+    }
+
+    bool ok = region_size > 0.0f ? saveWorldPaged(output, world, scale, region_size) : saveWorldBinary(output, world, scale);
+    if (ok) {
+        printf("Wrote %s: %u sectors, %u walls\n", output, world.num_sectors, world.num_walls);
+    }
+
+    freeWorld(world);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
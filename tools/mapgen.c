@@ -0,0 +1,302 @@
+// Generates stress maps for scaling benchmarks.
+//
+//  mapgen [options] output
+//      -n sectors      number of sectors, laid out on a square grid (default 1000)
+//      -w walls        walls per sector, rounded down to a multiple of 4 (default 4)
+//      -p density      chance that a shared edge is a portal, on top of the maze (default 0.3)
+//      -t tiers        maximum tiers per sector (default 1)
+//      -open           every shared edge is a portal, instead of maze corridors
+//      -s scale        scale baked into binary output (default 1)
+//      -b              write a binary world instead of text
+//      -seed n         random seed (default 1)
+//
+// Corridor maps carve a random spanning tree through the grid so every sector is reachable,
+// then open extra portals with the given density. Every sector is a convex cell whose edges are
+// split evenly, so the walls of neighboring cells line up as portals.
+
+#include "../src/portals.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <malloc.h>
+#include <stdint.h>
+
+#define CELL_SIZE 4.0f
+#define TIER_HEIGHT 4.0f
+#define TIER_GAP 1.0f
+
+static uint64_t s_rng_state = 1;
+
+static uint32_t nextRandom(void) {
+    // xorshift64*
+    s_rng_state ^= s_rng_state >> 12;
+    s_rng_state ^= s_rng_state << 25;
+    s_rng_state ^= s_rng_state >> 27;
+    return (uint32_t)((s_rng_state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+static float randomFloat(void) {
+    return nextRandom() / 4294967296.0f;
+}
+
+static unsigned findRoot(unsigned *parents, unsigned i) {
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i          = parents[i];
+    }
+    return i;
+}
+
+static void printUsage(void) {
+    printf("usage: mapgen [-n sectors] [-w walls] [-p density] [-t tiers] [-open] [-s scale] [-b] [-seed n] output\n");
+}
+
+static bool writeWorldText(const char *path, PortalWorld world) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        printf("ERROR: Failed to open %s for writing\n", path);
+        return false;
+    }
+
+    fprintf(file, "VERSION 1\n\nSECTORS %u\n", world.num_sectors);
+    fprintf(file, "// start wall, num walls, num tiers, {floor height 0, ceiling height 0, is sky, floor_texture, ceiling_texture} ...\n");
+    for (unsigned i = 0; i < world.num_sectors; ++i) {
+        SectorDef sector = world.sectors[i];
+        fprintf(file, "%u %u %u", sector.start, sector.length, sector.num_tiers);
+        for (unsigned t = 0; t < sector.num_tiers; ++t) {
+            fprintf(file, " | %g %g %u %u %u", sector.floor_heights[t], sector.ceiling_heights[t], sector.is_skys[t],
+                    sector.floor_texture_ids[t], sector.ceiling_texture_ids[t]);
+        }
+        fprintf(file, "\n");
+    }
+    fprintf(file, "END\n\nWALLS %u\n", world.num_walls);
+    fprintf(file, "// x0, y0, x1, y1, next sector, is sky, texture\n");
+    for (unsigned i = 0; i < world.num_walls; ++i) {
+        Line line     = world.wall_lines[i];
+        unsigned next = world.wall_nexts[i] == INVALID_SECTOR_INDEX ? 0 : world.wall_nexts[i] + 1;
+        fprintf(file, "%g %g %g %g %u %u %u\n", line.points[0][0], line.points[0][1], line.points[1][0], line.points[1][1],
+                next, world.wall_is_skys[i], world.wall_texture_ids[i]);
+    }
+    fprintf(file, "END\n");
+
+    if (fclose(file) != 0) {
+        printf("ERROR: Failed to write %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned num_sectors     = 1000;
+    unsigned walls_per_side  = 1;
+    float density            = 0.3f;
+    unsigned max_tiers       = 1;
+    bool open                = false;
+    float scale              = 1.0f;
+    bool binary              = false;
+    const char *output       = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            num_sectors = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            walls_per_side = strtoul(argv[++i], NULL, 10) / 4;
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            density = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            max_tiers = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-open") == 0) {
+            open = true;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            scale = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            binary = true;
+        } else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+            s_rng_state = strtoull(argv[++i], NULL, 10) | 1;
+        } else if (output == NULL && argv[i][0] != '-') {
+            output = argv[i];
+        } else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (output == NULL || num_sectors == 0) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    walls_per_side = max(walls_per_side, 1);
+    max_tiers      = max(max_tiers, 1);
+
+    unsigned grid_width = 1;
+    while (grid_width * grid_width < num_sectors) {
+        ++grid_width;
+    }
+
+    // edge i * 2 is the east edge of cell i, edge i * 2 + 1 is the south edge
+    unsigned num_edges = num_sectors * 2;
+    bool *edge_open    = calloc(num_edges, sizeof(*edge_open));
+    unsigned *parents  = malloc(num_sectors * sizeof(*parents));
+    unsigned *order    = malloc(num_edges * sizeof(*order));
+    if (edge_open == NULL || parents == NULL || order == NULL) {
+        printf("ERROR: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    for (unsigned i = 0; i < num_sectors; ++i) {
+        parents[i] = i;
+    }
+
+    // randomized kruskal over the grid edges, so corridors form a maze that reaches every cell
+    for (unsigned i = 0; i < num_edges; ++i) {
+        order[i] = i;
+    }
+    for (unsigned i = num_edges; i > 1; --i) {
+        unsigned j = nextRandom() % i;
+        swap(unsigned, order[i - 1], order[j]);
+    }
+
+    for (unsigned i = 0; i < num_edges; ++i) {
+        unsigned edge  = order[i];
+        unsigned cell  = edge / 2;
+        unsigned other = (edge % 2 == 0) ? cell + 1 : cell + grid_width;
+
+        if (edge % 2 == 0 && (cell % grid_width == grid_width - 1)) continue;
+        if (other >= num_sectors) continue;
+
+        unsigned a = findRoot(parents, cell);
+        unsigned b = findRoot(parents, other);
+        if (open || a != b || randomFloat() < density) {
+            edge_open[edge] = true;
+            parents[a]      = b;
+        }
+    }
+
+    free(order);
+    free(parents);
+
+    // build the world in memory so binary output can reuse saveWorldBinary
+    unsigned walls_per_sector = walls_per_side * 4;
+
+    PortalWorld world;
+    memset(&world, 0, sizeof(world));
+    world.num_sectors      = num_sectors;
+    world.num_walls        = num_sectors * walls_per_sector;
+    world.sectors          = malloc(world.num_sectors * sizeof(*world.sectors));
+    world.wall_lines       = malloc(world.num_walls * sizeof(*world.wall_lines));
+    world.wall_nexts       = malloc(world.num_walls * sizeof(*world.wall_nexts));
+    world.wall_is_skys     = calloc(world.num_walls, sizeof(*world.wall_is_skys));
+    world.wall_texture_ids = calloc(world.num_walls, sizeof(*world.wall_texture_ids));
+
+    unsigned num_tiers   = 0;
+    unsigned *tier_count = malloc(num_sectors * sizeof(*tier_count));
+    for (unsigned i = 0; tier_count != NULL && i < num_sectors; ++i) {
+        tier_count[i] = 1 + nextRandom() % max_tiers;
+        num_tiers += tier_count[i];
+    }
+
+    float *floor_heights          = malloc(num_tiers * sizeof(*floor_heights));
+    float *ceiling_heights        = malloc(num_tiers * sizeof(*ceiling_heights));
+    bool *is_skys                 = calloc(num_tiers, sizeof(*is_skys));
+    unsigned *floor_texture_ids   = malloc(num_tiers * sizeof(*floor_texture_ids));
+    unsigned *ceiling_texture_ids = malloc(num_tiers * sizeof(*ceiling_texture_ids));
+
+    if (world.sectors == NULL || world.wall_lines == NULL || world.wall_nexts == NULL || world.wall_is_skys == NULL ||
+        world.wall_texture_ids == NULL || tier_count == NULL || floor_heights == NULL || ceiling_heights == NULL ||
+        is_skys == NULL || floor_texture_ids == NULL || ceiling_texture_ids == NULL) {
+        printf("ERROR: Out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned tier = 0;
+    for (unsigned s = 0; s < num_sectors; ++s) {
+        unsigned cx = s % grid_width;
+        unsigned cy = s / grid_width;
+
+        SectorDef *sector           = &world.sectors[s];
+        sector->start               = s * walls_per_sector;
+        sector->length              = walls_per_sector;
+        sector->num_tiers           = tier_count[s];
+        sector->floor_heights       = &floor_heights[tier];
+        sector->ceiling_heights     = &ceiling_heights[tier];
+        sector->is_skys             = &is_skys[tier];
+        sector->floor_texture_ids   = &floor_texture_ids[tier];
+        sector->ceiling_texture_ids = &ceiling_texture_ids[tier];
+
+        float floor = randomFloat();
+        for (unsigned t = 0; t < sector->num_tiers; ++t) {
+            sector->floor_heights[t]       = floor;
+            sector->ceiling_heights[t]     = floor + TIER_HEIGHT + randomFloat() * TIER_HEIGHT;
+            sector->floor_texture_ids[t]   = 1;
+            sector->ceiling_texture_ids[t] = 2;
+            floor                          = sector->ceiling_heights[t] + TIER_GAP;
+        }
+        tier += sector->num_tiers;
+
+        // counter clockwise: south, east, north, west
+        vec2 corners[4] = {
+            { cx * CELL_SIZE, cy * CELL_SIZE },
+            { (cx + 1) * CELL_SIZE, cy * CELL_SIZE },
+            { (cx + 1) * CELL_SIZE, (cy + 1) * CELL_SIZE },
+            { cx * CELL_SIZE, (cy + 1) * CELL_SIZE },
+        };
+
+        unsigned neighbors[4] = {
+            (cy > 0 && edge_open[(s - grid_width) * 2 + 1]) ? s - grid_width : INVALID_SECTOR_INDEX,
+            (cx + 1 < grid_width && s + 1 < num_sectors && edge_open[s * 2]) ? s + 1 : INVALID_SECTOR_INDEX,
+            (s + grid_width < num_sectors && edge_open[s * 2 + 1]) ? s + grid_width : INVALID_SECTOR_INDEX,
+            (cx > 0 && edge_open[(s - 1) * 2]) ? s - 1 : INVALID_SECTOR_INDEX,
+        };
+
+        for (unsigned side = 0; side < 4; ++side) {
+            float *a = corners[side];
+            float *b = corners[(side + 1) % 4];
+
+            for (unsigned k = 0; k < walls_per_side; ++k) {
+                float t0 = (float)k / walls_per_side;
+                float t1 = (float)(k + 1) / walls_per_side;
+
+                unsigned wall               = sector->start + side * walls_per_side + k;
+                world.wall_lines[wall]      = (Line){ .points = { { lerp(a[0], b[0], t0), lerp(a[1], b[1], t0) },
+                                                                  { lerp(a[0], b[0], t1), lerp(a[1], b[1], t1) } } };
+                world.wall_nexts[wall]      = neighbors[side];
+                world.wall_texture_ids[wall] = 0;
+            }
+        }
+    }
+
+    free(edge_open);
+    free(tier_count);
+
+    bool ok;
+    if (binary) {
+        for (unsigned i = 0; i < world.num_walls; ++i) {
+            world.wall_lines[i].points[0][0] *= scale;
+            world.wall_lines[i].points[0][1] *= scale;
+            world.wall_lines[i].points[1][0] *= scale;
+            world.wall_lines[i].points[1][1] *= scale;
+        }
+        ok = saveWorldBinary(output, world, scale);
+    } else {
+        ok = writeWorldText(output, world);
+    }
+
+    if (ok) {
+        printf("Wrote %s: %u sectors, %u walls, %u tiers\n", output, world.num_sectors, world.num_walls, num_tiers);
+    }
+
+    free(world.sectors);
+    free(world.wall_lines);
+    free(world.wall_nexts);
+    free(world.wall_is_skys);
+    free(world.wall_texture_ids);
+    free(floor_heights);
+    free(ceiling_heights);
+    free(is_skys);
+    free(floor_texture_ids);
+    free(ceiling_texture_ids);
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}